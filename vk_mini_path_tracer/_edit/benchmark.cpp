@@ -0,0 +1,230 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "distributed.hpp"  // For QuoteArgument
+
+// The scenes of the suite, and the arguments that select them.
+struct BenchmarkScene
+{
+  const char*              name;
+  std::vector<std::string> arguments;
+};
+static const BenchmarkScene benchmark_corpus[] = {
+    {"cornell_box", {}},
+    {"dense", {"--scene", "spheres:1000000"}},
+    {"instanced", {"--scene", "spheres:20000", "--instances", "64"}},
+    {"outdoor", {"--scene", "outdoor:200000"}},
+};
+
+// Escapes a string for a JSON string literal.
+static std::string JsonString(const std::string& text)
+{
+  std::string escaped = "\"";
+  for(const char c : text)
+  {
+    if(c == '"' || c == '\\')
+    {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped + "\"";
+}
+
+double MedianRenderMs(const BenchmarkResult& result)
+{
+  std::vector<double> sorted = result.renderMs;
+  std::sort(sorted.begin(), sorted.end());
+  const size_t count = sorted.size();
+  return (count == 0) ? 0.0 : (count % 2 == 1) ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+}
+
+bool WriteBenchmarkJson(const std::string& path, const BenchmarkResult& result)
+{
+  std::vector<double> sorted = result.renderMs;
+  std::sort(sorted.begin(), sorted.end());
+  const size_t count    = sorted.size();
+  const double minMs    = (count > 0) ? sorted[0] : 0.0;
+  const double medianMs = MedianRenderMs(result);
+  const double meanMs   = (count > 0) ? std::accumulate(sorted.begin(), sorted.end(), 0.0) / double(count) : 0.0;
+
+  FILE* file = fopen(path.c_str(), "w");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  fprintf(file, "{\n");
+  fprintf(file, "  \"scene\": %s,\n", JsonString(result.scene).c_str());
+  fprintf(file, "  \"triangles\": %u,\n  \"instances\": %u,\n", result.triangles, result.instances);
+  fprintf(file, "  \"width\": %u,\n  \"height\": %u,\n  \"spp\": %u,\n", result.width, result.height, result.spp);
+  fprintf(file, "  \"warmup\": %u,\n  \"repetitions\": %zu,\n", result.warmup, count);
+  fprintf(file, "  \"load_ms\": %.3f,\n  \"upload_ms\": %.3f,\n  \"as_build_ms\": %.3f,\n", result.loadMs, result.uploadMs,
+          result.buildMs);
+  fprintf(file, "  \"render_ms\": {\"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"all\": [", minMs, medianMs, meanMs);
+  for(size_t i = 0; i < result.renderMs.size(); i++)
+  {
+    fprintf(file, "%s%.3f", (i > 0) ? ", " : "", result.renderMs[i]);
+  }
+  fprintf(file, "]},\n");
+  fprintf(file, "  \"rays\": %llu,\n", static_cast<unsigned long long>(result.rays));
+  fprintf(file, "  \"mrays_per_s\": %.3f,\n", (medianMs > 0.0) ? double(result.rays) / (medianMs * 1000.0) : 0.0);
+  fprintf(file, "  \"peak_host_memory_mb\": %.1f,\n", double(result.peakHostBytes) / (1024.0 * 1024.0));
+  if(result.peakDeviceBytes > 0)
+  {
+    fprintf(file, "  \"peak_device_memory_mb\": %.1f\n", double(result.peakDeviceBytes) / (1024.0 * 1024.0));
+  }
+  else
+  {
+    fprintf(file, "  \"peak_device_memory_mb\": null\n");
+  }
+  fprintf(file, "}\n");
+  return fclose(file) == 0;
+}
+
+uint64_t PeakHostMemoryBytes()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? uint64_t(counters.PeakWorkingSetSize) : 0;
+#else
+  rusage usage{};
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return 0;
+  }
+#ifdef __APPLE__
+  return uint64_t(usage.ru_maxrss);  // In bytes on macOS
+#else
+  return uint64_t(usage.ru_maxrss) * 1024;  // In KiB on Linux
+#endif
+#endif
+}
+
+bool RunBenchmarkSuite(const BenchmarkSuiteSettings& settings)
+{
+  bool        ok = true;
+  std::string json = "{\n  \"scenes\": [\n";
+  for(size_t i = 0; i < std::size(benchmark_corpus); i++)
+  {
+    const BenchmarkScene& scene      = benchmark_corpus[i];
+    const std::string     resultPath = settings.outputPath + "." + scene.name + ".json";
+    // The scene's arguments come last, so that they win over any --scene in `settings.arguments`
+    std::string command = QuoteArgument(settings.executable);
+    for(const std::vector<std::string>* arguments : {&settings.arguments, &scene.arguments})
+    {
+      for(const std::string& argument : *arguments)
+      {
+        command += " " + QuoteArgument(argument);
+      }
+    }
+    command += " --benchmark-json " + QuoteArgument(resultPath);
+    remove(resultPath.c_str());  // So that a file from an earlier run doesn't count as this run's result
+
+    printf("Benchmark suite: %s\n", scene.name);
+    fflush(stdout);  // Before the scene's process writes to the same terminal
+    const int          status = std::system(command.c_str());
+    std::ifstream      resultFile(resultPath);
+    std::ostringstream result;
+    result << resultFile.rdbuf();
+    json += std::string("    {\"name\": ") + JsonString(scene.name) + ", ";
+    if(status == 0 && resultFile && !result.str().empty())
+    {
+      std::string text = result.str();
+      text.erase(text.find_last_not_of(" \n") + 1);
+      json += "\"result\": " + text;
+    }
+    else
+    {
+      fprintf(stderr, "Benchmark suite: %s failed (exit status %d)\n", scene.name, status);
+      json += "\"error\": " + JsonString("exit status " + std::to_string(status));
+      ok = false;
+    }
+    json += (i + 1 < std::size(benchmark_corpus)) ? "},\n" : "}\n";
+    resultFile.close();
+    remove(resultPath.c_str());
+  }
+  json += "  ]\n}\n";
+
+  FILE* file    = fopen(settings.outputPath.c_str(), "w");
+  bool  written = (file != nullptr) && (fwrite(json.data(), 1, json.size(), file) == json.size());
+  written       = (file != nullptr) && (fclose(file) == 0) && written;
+  if(!written)
+  {
+    fprintf(stderr, "Could not write %s\n", settings.outputPath.c_str());
+  }
+  else
+  {
+    printf("Benchmark suite: wrote %s\n", settings.outputPath.c_str());
+  }
+  return ok && written;
+}
+
+bool WriteQualityCsv(const std::string& path, const std::vector<QualityResult>& results)
+{
+  FILE* file = fopen(path.c_str(), "w");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  fprintf(file, "budget_ms,spp,rmse,relmse,flip\n");
+  for(const QualityResult& result : results)
+  {
+    fprintf(file, "%.3f,%u,%.8g,%.8g,%.8g\n", result.budgetMs, result.spp, result.rmse, result.relMse, result.flip);
+  }
+  return fclose(file) == 0;
+}
+
+bool ReadQualityCsv(const std::string& path, std::vector<QualityResult>& results)
+{
+  std::ifstream file(path);
+  std::string   line;
+  if(!std::getline(file, line))  // The header
+  {
+    return false;
+  }
+  results.clear();
+  while(std::getline(file, line))
+  {
+    QualityResult result;
+    if(sscanf(line.c_str(), "%lf,%u,%lf,%lf,%lf", &result.budgetMs, &result.spp, &result.rmse, &result.relMse, &result.flip) == 5)
+    {
+      results.push_back(result);
+    }
+  }
+  return !results.empty();
+}
+
+bool CheckQualityGate(const std::vector<QualityResult>& results, const std::vector<QualityResult>& baseline, double tolerance)
+{
+  bool passed = true;
+  for(const QualityResult& result : results)
+  {
+    const auto found = std::find_if(baseline.begin(), baseline.end(), [&result](const QualityResult& candidate) {
+      return std::abs(candidate.budgetMs - result.budgetMs) < 1e-3;
+    });
+    if(found == baseline.end())
+    {
+      printf("Quality gate: %.1f ms not in the baseline\n", result.budgetMs);
+      continue;
+    }
+    const bool ok = (result.relMse <= found->relMse * (1.0 + tolerance)) && (result.flip <= found->flip * (1.0 + tolerance));
+    printf("Quality gate: %.1f ms: relMSE %.6g (baseline %.6g), FLIP %.6f (baseline %.6f), %u spp (baseline %u): %s\n",
+           result.budgetMs, result.relMse, found->relMse, result.flip, found->flip, result.spp, found->spp, ok ? "pass" : "FAIL");
+    passed = passed && ok;
+  }
+  return passed;
+}
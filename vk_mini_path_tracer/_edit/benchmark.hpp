@@ -0,0 +1,76 @@
+// End-to-end benchmarks: the results of one scene as JSON, and the suite that renders a fixed corpus of scenes
+// with this executable, one process per scene, and collects their results in one JSON file. Then the results of
+// the equal-time quality gate, and the check against a baseline that makes it a gate.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What --benchmark-json measures for one scene.
+struct BenchmarkResult
+{
+  std::string         scene;  // The --scene value ("" for the Cornell box)
+  uint32_t            triangles  = 0;  // Of the mesh, once per instance
+  uint32_t            instances  = 1;
+  uint32_t            width      = 0;
+  uint32_t            height     = 0;
+  uint32_t            spp        = 0;  // Samples per pixel of each render
+  uint32_t            warmup     = 0;  // Renders before the timed ones
+  double              loadMs     = 0.0;  // Loading or generating the mesh, and preprocessing it
+  double              uploadMs   = 0.0;  // Uploading it to the GPU
+  double              buildMs    = 0.0;  // Building the BLAS and TLAS
+  std::vector<double> renderMs;          // GPU time of each timed render
+  uint64_t            rays       = 0;    // Rays traced by one render
+  uint64_t            peakHostBytes   = 0;  // Peak resident memory of the process
+  uint64_t            peakDeviceBytes = 0;  // Peak device-local memory use, 0 if the device can't report it
+};
+
+// Returns the median of `result.renderMs`, or 0 if there are none.
+double MedianRenderMs(const BenchmarkResult& result);
+
+// Writes `result` as a JSON object, with the minimum, median and mean render times and the Mrays/s of the
+// median. Returns false if the file can't be written.
+bool WriteBenchmarkJson(const std::string& path, const BenchmarkResult& result);
+
+// Returns the peak resident memory of this process so far, in bytes (0 if the platform can't tell).
+uint64_t PeakHostMemoryBytes();
+
+// Settings of RunBenchmarkSuite.
+struct BenchmarkSuiteSettings
+{
+  std::string              executable;  // The renderer
+  std::vector<std::string> arguments;   // Arguments every scene gets, e.g. --benchmark-repeat
+  std::string              outputPath = "benchmark.json";
+};
+
+// Runs `<executable> <arguments> <scene arguments> --benchmark-json <file>` for each scene of the corpus:
+//   cornell_box  the Cornell box (32 triangles)
+//   dense        a field of spheres with 1M triangles
+//   instanced    64 instances of a field of spheres with 20k triangles
+//   outdoor      open terrain with scattered boxes, 200k triangles, where most bounces escape to the sky
+// and writes {"scenes": [{"name": ..., "result": <the scene's JSON>}, ...]} to `outputPath`. A scene whose process
+// fails gets "error" instead of "result". Returns false if a scene failed or the file can't be written.
+bool RunBenchmarkSuite(const BenchmarkSuiteSettings& settings);
+
+// What --quality-gate measures for one wall-time budget: how many samples per pixel the render took, and its errors
+// against the reference (see image_metrics.hpp).
+struct QualityResult
+{
+  double   budgetMs = 0.0;
+  uint32_t spp      = 0;
+  double   rmse     = 0.0;
+  double   relMse   = 0.0;
+  double   flip     = 0.0;
+};
+
+// Writes `results` as CSV, one line per budget after a header line. Returns false if the file can't be written.
+bool WriteQualityCsv(const std::string& path, const std::vector<QualityResult>& results);
+
+// Reads a file written by WriteQualityCsv. Returns false if the file can't be read or has no results.
+bool ReadQualityCsv(const std::string& path, std::vector<QualityResult>& results);
+
+// Compares `results` with `baseline` at each budget both have: a budget fails if its relMSE or FLIP error is more
+// than `tolerance` (e.g. 0.05 for 5%) above the baseline's, i.e. if this build renders a worse image in the same
+// time. Prints each comparison; returns false if a budget failed. Budgets the baseline doesn't have pass.
+bool CheckQualityGate(const std::vector<QualityResult>& results, const std::vector<QualityResult>& baseline, double tolerance);
@@ -0,0 +1,149 @@
+#include "camera.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using Vec3 = std::array<float, 3>;
+
+static Vec3 Subtract(const Vec3& a, const Vec3& b)
+{
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+static Vec3 Cross(const Vec3& a, const Vec3& b)
+{
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+static Vec3 Normalize(const Vec3& v)
+{
+  const float invLength = 1.0f / std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  return {v[0] * invLength, v[1] * invLength, v[2] * invLength};
+}
+
+// Builds a camera from its origin and basis.
+static Camera MakeCamera(const Vec3& origin, const Vec3& right, const Vec3& up, const Vec3& forward, float fovVerticalSlope)
+{
+  Camera camera{};
+  for(int axis = 0; axis < 3; axis++)
+  {
+    camera.origin[axis]  = origin[axis];
+    camera.right[axis]   = right[axis];
+    camera.up[axis]      = up[axis];
+    camera.forward[axis] = forward[axis];
+  }
+  camera.fovVerticalSlope = fovVerticalSlope;
+  return camera;
+}
+
+static const Vec3  default_origin = {-0.001f, 1.0f, 6.0f};
+static const Vec3  default_target = {0.0f, 1.0f, 0.0f};  // Where the turntable turns around
+static const float default_slope  = 1.0f / 5.0f;
+
+Camera DefaultCamera()
+{
+  return MakeCamera(default_origin, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, default_slope);
+}
+
+Camera LookAtCamera(const Vec3& origin, const Vec3& target, float fovVerticalSlope)
+{
+  const Vec3 forward = Normalize(Subtract(target, origin));
+  const Vec3 right   = Normalize(Cross(forward, {0.0f, 1.0f, 0.0f}));
+  return MakeCamera(origin, right, Cross(right, forward), forward, fovVerticalSlope);
+}
+
+std::vector<Camera> TurntableCameras(uint32_t count)
+{
+  const float         distance = default_origin[2] - default_target[2];
+  std::vector<Camera> cameras;
+  for(uint32_t i = 0; i < count; i++)
+  {
+    const float angle = 6.2831853f * float(i) / float(count);
+    const Vec3  origin = {default_target[0] + distance * std::sin(angle), default_target[1],
+                          default_target[2] + distance * std::cos(angle)};
+    cameras.push_back(LookAtCamera(origin, default_target, default_slope));
+  }
+  return cameras;
+}
+
+std::vector<Camera> CubemapCameras()
+{
+  // Row 0 of each layer is its top, so "up" is the direction in which the t coordinate of the cube map decreases
+  // (see the cube map face selection table of the Vulkan specification).
+  struct Face
+  {
+    Vec3 right, up, forward;
+  };
+  static const Face faces[6] = {{{0, 0, -1}, {0, 1, 0}, {1, 0, 0}},    // +x
+                                {{0, 0, 1}, {0, 1, 0}, {-1, 0, 0}},    // -x
+                                {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},    // +y
+                                {{1, 0, 0}, {0, 0, 1}, {0, -1, 0}},    // -y
+                                {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},     // +z
+                                {{-1, 0, 0}, {0, 1, 0}, {0, 0, -1}}};  // -z
+  std::vector<Camera> cameras;
+  for(const Face& face : faces)
+  {
+    cameras.push_back(MakeCamera(default_origin, face.right, face.up, face.forward, 1.0f));
+  }
+  return cameras;
+}
+
+bool ReadCameras(const std::string& path, std::vector<Camera>& cameras)
+{
+  std::ifstream file(path);
+  if(!file)
+  {
+    return false;
+  }
+  cameras.clear();
+  for(std::string line; std::getline(file, line);)
+  {
+    if(line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#')
+    {
+      continue;
+    }
+    std::istringstream stream(line);
+    Vec3               origin, target;
+    float              fovDegrees = 0.0f;
+    if(!(stream >> origin[0] >> origin[1] >> origin[2] >> target[0] >> target[1] >> target[2] >> fovDegrees)
+       || !(fovDegrees > 0.0f && fovDegrees < 180.0f))
+    {
+      return false;
+    }
+    const Vec3 direction = Subtract(target, origin);
+    if(direction[0] == 0.0f && direction[2] == 0.0f)
+    {
+      return false;  // Looking straight up or down, so +y can't be up
+    }
+    cameras.push_back(LookAtCamera(origin, target, std::tan(0.5f * fovDegrees * 3.14159265f / 180.0f)));
+  }
+  return true;
+}
+
+bool MakeViewCameras(const std::string& views, std::vector<Camera>& cameras)
+{
+  if(views.compare(0, 10, "turntable:") == 0)
+  {
+    const int count = atoi(views.c_str() + 10);
+    cameras         = TurntableCameras(uint32_t(std::max(count, 0)));
+  }
+  else if(views == "cubemap")
+  {
+    cameras = CubemapCameras();
+  }
+  else if(!ReadCameras(views, cameras))
+  {
+    fprintf(stderr, "Could not read the cameras of %s\n", views.c_str());
+    return false;
+  }
+  if(cameras.empty())
+  {
+    fprintf(stderr, "--views %s has no cameras\n", views.c_str());
+    return false;
+  }
+  return true;
+}
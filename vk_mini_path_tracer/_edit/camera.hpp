@@ -0,0 +1,36 @@
+// Cameras of multi-view rendering: the default view of the scene, turntables and cubemaps around it, and camera lists
+// read from text files. Each camera renders one layer of the output image array (see BINDING_CAMERAS).
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// The camera of single-view rendering: at (-0.001, 1, 6), looking down -z with +y up, and a vertical slope of 1/5.
+// The CPU renderer hardcodes the same camera.
+Camera DefaultCamera();
+
+// A camera at `origin` looking at `target`, with +y up. `fovVerticalSlope` is the tangent of half the vertical
+// field of view. `origin` must not be straight above or below `target`.
+Camera LookAtCamera(const std::array<float, 3>& origin, const std::array<float, 3>& target, float fovVerticalSlope);
+
+// `count` cameras evenly spaced on a circle around the vertical axis through (0, 1, 0), at the default camera's
+// distance and field of view, all looking at (0, 1, 0). The first one is at (0, 1, 6).
+std::vector<Camera> TurntableCameras(uint32_t count);
+
+// The 6 faces of a cube map around the default camera's origin, with 90 degree fields of view, in the layer order
+// (+x, -x, +y, -y, +z, -z) and orientation of Vulkan cube maps, so that the layers can be sampled as a cube map
+// as they are. The views must be square.
+std::vector<Camera> CubemapCameras();
+
+// Reads cameras from a text file with one camera per line: "originX originY originZ targetX targetY targetZ fov",
+// fov being the vertical field of view in degrees. Empty lines and lines starting with # are skipped.
+// Returns false if the file can't be read or a line isn't a valid camera.
+bool ReadCameras(const std::string& path, std::vector<Camera>& cameras);
+
+// Returns the cameras --views asks for: "turntable:<N>", "cubemap", or the path of a file for ReadCameras.
+// Returns false and prints why if there are none.
+bool MakeViewCameras(const std::string& views, std::vector<Camera>& cameras);
@@ -0,0 +1,123 @@
+#include "checkpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// First word of a checkpoint file ("VKCP" in little-endian).
+static const uint32_t checkpoint_magic = 0x50434B56u;
+
+// 64-bit FNV-1a of `size` bytes, continuing from `hash`.
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for(size_t i = 0; i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+uint64_t HashScene(const Mesh& mesh, const SceneSettings& settings)
+{
+  // Word by word rather than the struct, whose padding bytes are undefined
+  uint32_t noiseThreshold = 0;
+  if(settings.adaptive)
+  {
+    memcpy(&noiseThreshold, &settings.noiseThreshold, sizeof(noiseThreshold));
+  }
+  const uint32_t words[8] = {settings.width,
+                             settings.height,
+                             settings.sampler,
+                             settings.adaptive ? 1u : 0u,
+                             noiseThreshold,
+                             settings.instances,
+                             (settings.quantizedVertices ? 1u : 0u) | (settings.shadingRecords ? 2u : 0u),
+                             settings.sampleSplit};
+  uint64_t       hash     = HashBytes(words, sizeof(words), 0xCBF29CE484222325ull);
+  hash                       = HashBytes(mesh.vertices.data(), mesh.vertices.size() * sizeof(float), hash);
+  hash                       = HashBytes(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), hash);
+  return HashBytes(mesh.materialIDs.data(), mesh.materialIDs.size() * sizeof(uint32_t), hash);
+}
+
+// Writes or reads a vector as its size, then its elements. `remainingBytes` is the size of the rest of the file.
+template <typename T>
+static bool WriteVector(FILE* file, const std::vector<T>& v)
+{
+  const uint64_t size = v.size();
+  return (fwrite(&size, sizeof(size), 1, file) == 1) && (fwrite(v.data(), sizeof(T), v.size(), file) == v.size());
+}
+template <typename T>
+static bool ReadVector(FILE* file, std::vector<T>& v, uint64_t& remainingBytes)
+{
+  uint64_t size = 0;
+  if((remainingBytes < sizeof(size)) || (fread(&size, sizeof(size), 1, file) != 1))
+  {
+    return false;
+  }
+  remainingBytes -= sizeof(size);
+  // A corrupt size mustn't allocate more than the rest of the file can hold:
+  if(size > remainingBytes / sizeof(T))
+  {
+    return false;
+  }
+  remainingBytes -= size * sizeof(T);
+  v.resize(size_t(size));
+  return fread(v.data(), sizeof(T), v.size(), file) == v.size();
+}
+
+bool WriteCheckpoint(const std::string& path, const RenderCheckpoint& checkpoint)
+{
+  const std::string temporaryPath = path + ".tmp";
+  FILE*             file          = fopen(temporaryPath.c_str(), "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  const uint32_t header[3] = {checkpoint_magic, checkpoint.sampleCount, checkpoint.numBatches};
+  bool           ok        = (fwrite(header, sizeof(uint32_t), 3, file) == 3);
+  ok = ok && (fwrite(&checkpoint.sceneHash, sizeof(uint64_t), 1, file) == 1);
+  ok = ok && (fwrite(&checkpoint.tileSamples, sizeof(uint64_t), 1, file) == 1);
+  ok = ok && WriteVector(file, checkpoint.activeTiles) && WriteVector(file, checkpoint.sums) && WriteVector(file, checkpoint.image);
+  ok = (fclose(file) == 0) && ok;
+  if(!ok)
+  {
+    remove(temporaryPath.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  // rename() doesn't replace existing files on Windows; elsewhere, it replaces `path` atomically.
+  remove(path.c_str());
+#endif
+  return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+bool ReadCheckpoint(const std::string& path, RenderCheckpoint& checkpoint)
+{
+  std::error_code error;
+  const uint64_t  fileSize   = std::filesystem::file_size(path, error);
+  const uint64_t  headerSize = 3 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+  if(error || fileSize < headerSize)
+  {
+    return false;
+  }
+  FILE* file = fopen(path.c_str(), "rb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  uint64_t remainingBytes = fileSize - headerSize;
+  uint32_t header[3];
+  bool     ok = (fread(header, sizeof(uint32_t), 3, file) == 3) && (header[0] == checkpoint_magic);
+  ok = ok && (fread(&checkpoint.sceneHash, sizeof(uint64_t), 1, file) == 1);
+  ok = ok && (fread(&checkpoint.tileSamples, sizeof(uint64_t), 1, file) == 1);
+  ok = ok && ReadVector(file, checkpoint.activeTiles, remainingBytes) && ReadVector(file, checkpoint.sums, remainingBytes)
+       && ReadVector(file, checkpoint.image, remainingBytes);
+  fclose(file);
+  if(ok)
+  {
+    checkpoint.sampleCount = header[1];
+    checkpoint.numBatches  = header[2];
+  }
+  return ok;
+}
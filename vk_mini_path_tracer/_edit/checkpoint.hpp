@@ -0,0 +1,47 @@
+// Checkpoints of long progressive renders: everything a restarted process needs to continue a render from the
+// last checkpoint instead of from the first sample.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+
+// The state of a progressive render after a batch. Since each sample only depends on its pixel and sample index,
+// a render continued from a checkpoint gives the same image as one that never stopped.
+struct RenderCheckpoint
+{
+  uint64_t              sceneHash   = 0;  // See HashScene; a checkpoint of another scene or image size isn't resumed
+  uint32_t              sampleCount = 0;  // Samples per pixel of the active tiles; the first sample index of the next batch
+  uint32_t              numBatches  = 0;
+  uint64_t              tileSamples = 0;  // Sum of the samples per pixel of all tiles
+  std::vector<uint32_t> activeTiles;      // Tiles that the next batch samples, as in BINDING_ACTIVE_TILES
+  std::vector<float>    sums;             // 4 floats per pixel, as in BINDING_ACCUMULATION
+  std::vector<float>    image;            // 3 floats per pixel: the averages the shader last wrote
+};
+
+// What determines the image of a render besides the mesh.
+struct SceneSettings
+{
+  uint32_t width             = 0;
+  uint32_t height            = 0;
+  uint32_t sampler           = 0;
+  bool     adaptive          = false;  // Whether tiles are dropped when they converge,
+  float    noiseThreshold    = 0.0f;   // and at which noise (ignored without `adaptive`)
+  uint32_t instances         = 1;      // Instances of the mesh in the TLAS
+  bool     quantizedVertices = false;  // Whether the shader reads 16-bit vertex positions,
+  bool     shadingRecords    = false;  // or precomputed PrimitiveRecords
+  uint32_t sampleSplit       = 1;      // Invocations per pixel, which changes the order in which samples are summed
+};
+
+// Hashes what determines the samples of a render: the mesh and `settings`.
+uint64_t HashScene(const Mesh& mesh, const SceneSettings& settings);
+
+// Writes `checkpoint` to a temporary file, then renames it to `path`, so that a process killed while writing
+// leaves the last checkpoint intact. Returns false if the file can't be written.
+bool WriteCheckpoint(const std::string& path, const RenderCheckpoint& checkpoint);
+
+// Reads a file written by WriteCheckpoint. Returns false if the file doesn't exist, isn't a checkpoint or is
+// truncated.
+bool ReadCheckpoint(const std::string& path, RenderCheckpoint& checkpoint);
@@ -0,0 +1,178 @@
+// Common definitions shared between the C++ code in main.cpp and the GLSL code in shaders/.
+// Only preprocessor constants and plain structs of 32-bit scalars go here, so that both languages
+// can read them.
+#ifndef VK_MINI_PATH_TRACER_COMMON_H
+#define VK_MINI_PATH_TRACER_COMMON_H
+
+#ifdef __cplusplus
+#include <cstdint>
+using uint = uint32_t;
+#endif
+
+// Size of a workgroup of raytrace.comp.glsl. With adaptive sampling, the pixels of one workgroup form a tile
+// that is sampled until all of its pixels have converged.
+#define WORKGROUP_WIDTH 16
+#define WORKGROUP_HEIGHT 8
+
+// Bindings of the descriptor set used by raytrace.comp.glsl
+#define BINDING_IMAGE_DATA 0          // Output image (vec3 per pixel)
+#define BINDING_TLAS 1                // Top-level acceleration structure
+#define BINDING_VERTICES 2            // Vertex positions (vec3 per vertex)
+#define BINDING_INDICES 3             // Vertex indices (3 per triangle)
+#define BINDING_PRIMITIVES 4          // Precomputed shading records (PRIMITIVE_RECORD_VEC4S vec4s per triangle)
+#define BINDING_QUANTIZED_VERTICES 5  // Quantized vertex positions for shading (origin, scale, uvec2 per vertex)
+#define BINDING_ACCUMULATION 6        // Adaptive sampling: per pixel vec4(sum of colors, sum of squared luminances)
+#define BINDING_ACTIVE_TILES 7        // Adaptive sampling: tiles to sample in this dispatch (x | y << 16 per tile)
+#define BINDING_SOBOL_DIRECTIONS 8    // Sobol direction numbers (32 uints per dimension, SOBOL_DIMENSIONS dimensions)
+#define BINDING_ALBEDO 9              // AOV_ALBEDO: average first-hit albedo (vec3 per pixel); also a denoiser guide
+#define BINDING_NORMAL 10             // AOV_NORMAL: average first-hit world normal (vec3 per pixel); also a denoiser guide
+#define BINDING_AOV_DEPTH 11          // AOV_DEPTH: first-hit distance t (float per pixel)
+#define BINDING_AOV_IDS 12            // AOV_IDS: first-hit primitive and instance ID (uvec2 per pixel)
+#define BINDING_AOV_BARYCENTRICS 13   // AOV_BARYCENTRICS: first-hit barycentrics of v1 and v2 (vec2 per pixel)
+#define BINDING_OUTPUT_IMAGE 14       // SPEC_OUTPUT_IMAGE: output image array (rgba32f or rgba16f, optimal tiling, a layer per view)
+#define BINDING_WORK_COUNTERS 15      // SPEC_PERSISTENT_THREADS: WORK_COUNTER_COUNT pairs (next work item, finished workgroups)
+#define BINDING_CAMERAS 16            // Cameras (Camera per view; one with single-view rendering)
+#define BINDING_RAY_COUNT 17          // SPEC_COUNT_RAYS: number of rays traced (a 64-bit count as 2 uints, low word first,
+                                      // which each workgroup adds to)
+
+// Specialization constant IDs of raytrace.comp.glsl. Each value is a 32-bit uint.
+#define SPEC_HIT_FETCH_MODE 0      // One of the HIT_FETCH_* values below
+#define SPEC_INDEX_16BIT 1         // 1 if BINDING_INDICES holds 16-bit indices, 2 per uint
+#define SPEC_QUANTIZED_VERTICES 2  // 1 if getObjectHitInfo reads BINDING_QUANTIZED_VERTICES instead of BINDING_VERTICES
+#define SPEC_ADAPTIVE_SAMPLING 3   // 1 if each dispatch samples the tiles in BINDING_ACTIVE_TILES, see PushConstants
+#define SPEC_SAMPLER 4              // One of the SAMPLER_* values below
+#define SPEC_AOV_MASK 5             // Combination of the AOV_* bits below: the AOVs the shader writes
+#define SPEC_OUTPUT_IMAGE 6         // 1 if the color goes to BINDING_OUTPUT_IMAGE instead of BINDING_IMAGE_DATA
+#define SPEC_PIXEL_SWIZZLE 7        // One of the SWIZZLE_* values below
+#define SPEC_PRIMARY_RAYS_ONLY 8    // 1 to trace only the camera rays of each path (for benchmarks; the image is wrong)
+#define SPEC_PERSISTENT_THREADS 9   // 1 if a fixed number of workgroups take tiles from a work counter, see PushConstants
+#define SPEC_SAMPLE_SPLIT 10        // Invocations per pixel, each taking a range of its samples (1: one per pixel)
+#define SPEC_COUNT_RAYS 11          // 1 to add the number of rays traced to BINDING_RAY_COUNT (for benchmarks)
+#define SPEC_TRAVERSAL_RAYS 12      // One of the TRAVERSAL_* values below (for benchmarks; not 0 replaces path tracing)
+#define SPEC_CONSTANT_COUNT 13
+
+// Number of work counters in BINDING_WORK_COUNTERS, so that dispatches that may overlap can use different ones.
+#define WORK_COUNTER_COUNT 64
+
+// Largest SPEC_SAMPLE_SPLIT; it is a power of 2, so that it divides the WORKGROUP_WIDTH * WORKGROUP_HEIGHT invocations
+// of a workgroup. Each workgroup then renders one of SPEC_SAMPLE_SPLIT blocks of the pixels of its tile, in the order
+// of SPEC_PIXEL_SWIZZLE, and dispatches have SPEC_SAMPLE_SPLIT workgroups in z per tile (persistent threads: work items per tile).
+#define MAX_SAMPLE_SPLIT 16
+
+// Values of SPEC_HIT_FETCH_MODE: how getObjectHitInfo reads the triangle that was hit.
+#define HIT_FETCH_INDEXED 0  // 3 index loads + 3 vertex loads, then the normal is computed
+#define HIT_FETCH_RECORDS 1  // 1 load of the precomputed PrimitiveRecord
+
+// Values of SPEC_SAMPLER: where the random numbers for pixel jitter and bounce directions come from.
+#define SAMPLER_PCG 0    // Independent pseudo-random numbers from a PCG stream per pixel
+#define SAMPLER_SOBOL 1  // Owen-scrambled Sobol points, indexed by (pixel, sample index, dimension)
+
+// Values of SPEC_PIXEL_SWIZZLE: which pixel of its workgroup's tile each invocation renders. The workgroup always
+// covers the same tile, so the image doesn't change; only which rays are traced together does.
+#define SWIZZLE_ROW_MAJOR 0  // gl_LocalInvocationID, so each subgroup covers whole rows of the tile
+#define SWIZZLE_MORTON 1     // Z-order curve through each 8x8 half of the tile
+#define SWIZZLE_HILBERT 2    // Hilbert curve through each 8x8 half of the tile
+#define SWIZZLE_SUBGROUP 3   // Each subgroup covers one block of the tile, as square as its size allows (8x4 for 32)
+
+// Values of SPEC_TRAVERSAL_RAYS. The traversal benchmark traces one ray per pixel without shading, sampling or
+// bounces, and writes its hit distance (AOV_NO_HIT_DEPTH if it misses) to the pixel, so that its time is that of
+// BVH traversal alone and the image is a checksum of the hits.
+#define TRAVERSAL_OFF 0     // Path tracing
+#define TRAVERSAL_CAMERA 1  // The camera ray through the center of the pixel
+#define TRAVERSAL_RANDOM 2  // A ray from a random point of [sceneMin, sceneMax] in a random direction (see rayCoherence)
+
+// Bits of SPEC_AOV_MASK. Albedo and normal are averaged over the pixel's samples; the others come from its
+// first sample, as averaging them wouldn't make sense.
+#define AOV_ALBEDO 1u
+#define AOV_NORMAL 2u
+#define AOV_DEPTH 4u
+#define AOV_IDS 8u
+#define AOV_BARYCENTRICS 16u
+#define AOV_NO_HIT_DEPTH 10000.0  // Depth of pixels whose first ray hits the sky (the ray's maximum t)
+#define AOV_NO_HIT_ID 0xFFFFFFFFu  // Primitive and instance ID of pixels whose first ray hits the sky
+
+// Number of Sobol dimensions in BINDING_SOBOL_DIRECTIONS. Longer paths reuse them with other scrambles.
+#define SOBOL_DIMENSIONS 4
+
+// Number of vec4s in a PrimitiveRecord (see mesh.hpp for the layout).
+#define PRIMITIVE_RECORD_VEC4S 3
+
+// Push constants of raytrace.comp.glsl.
+struct PushConstants
+{
+  uint imageWidth;          // Size of the whole image in pixels
+  uint imageHeight;
+  uint tileOffsetX;         // Tiled rendering: first pixel of the tile this dispatch renders (0 without tiling)
+  uint tileOffsetY;
+  uint tileWidth;           // Tiled rendering: size of the tile (the image size without tiling). The per-pixel
+  uint tileHeight;          // buffers hold the tile's pixels in scanline order, tileWidth pixels per row.
+  uint outputOffset;        // Tiled rendering: index of the tile's first pixel in BINDING_IMAGE_DATA
+  uint firstSample;         // Adaptive sampling: index of the first sample of this dispatch in each pixel's sequence
+  uint sampleCount;         // Adaptive sampling: number of samples per pixel to take in this dispatch
+  uint accumulatedSamples;  // Adaptive sampling: number of samples in BINDING_ACCUMULATION to add this dispatch's samples to
+  uint activeTileCount;     // Persistent threads with adaptive sampling: number of tiles in BINDING_ACTIVE_TILES
+  uint workCounter;         // Persistent threads: which of the WORK_COUNTER_COUNT work counters this dispatch uses
+  uint viewCount;           // Multi-view with persistent threads: number of cameras in BINDING_CAMERAS (0 counts as 1)
+  float sceneMin[3];        // TRAVERSAL_RANDOM: bounds of the scene, where the rays start
+  float sceneMax[3];
+  float rayCoherence;       // TRAVERSAL_RANDOM: each ray is a mix of its own random ray and its workgroup tile's, from 0
+                            // (incoherent rays in all directions) to 1 (the same ray in the whole tile)
+};
+
+// A camera of BINDING_CAMERAS. The ray through screen point (x, y), with y in [-1, 1] from the bottom to the top of
+// the image and x scaled by the aspect ratio, goes from `origin` towards forward + fovVerticalSlope * (x * right + y * up).
+// View i renders into layer i of BINDING_OUTPUT_IMAGE; without persistent threads, with the workgroups of z slices
+// [i * SPEC_SAMPLE_SPLIT, (i + 1) * SPEC_SAMPLE_SPLIT) of the dispatch.
+struct Camera
+{
+  float origin[3];
+  float fovVerticalSlope;  // Tangent of half the vertical field of view
+  float right[3];          // Orthonormal basis of the view
+  float up[3];
+  float forward[3];        // Viewing direction
+};
+
+// Bindings of the descriptor sets used by denoise.comp.glsl; each A-trous iteration reads one buffer and writes another.
+#define DENOISE_BINDING_INPUT 0   // Color to filter (vec3 per pixel)
+#define DENOISE_BINDING_OUTPUT 1  // Filtered color (vec3 per pixel)
+#define DENOISE_BINDING_ALBEDO 2  // Same as BINDING_ALBEDO
+#define DENOISE_BINDING_NORMAL 3  // Same as BINDING_NORMAL
+
+// Push constants of denoise.comp.glsl, for one A-trous iteration.
+struct DenoisePushConstants
+{
+  uint  width;      // Image size in pixels
+  uint  height;
+  uint  stepWidth;  // Distance between the taps of the 5x5 kernel: 1, 2, 4, ...
+  float colorPhi;   // Edge-stopping strengths: larger values blur more across color, normal and albedo edges
+  float normalPhi;
+  float albedoPhi;
+};
+
+// Bindings of the descriptor set used by tonemap.comp.glsl.
+#define TONEMAP_BINDING_INPUT 0   // Linear color (vec3 per pixel)
+#define TONEMAP_BINDING_OUTPUT 1  // Encoded color (TonemapBytesPerPixel bytes per pixel, as uints)
+
+// Tonemapping curves of tonemap.comp.glsl, applied after the exposure for the 8- and 10-bit encodings.
+#define TONEMAP_CLAMP 0     // None: values above 1 are clipped
+#define TONEMAP_REINHARD 1  // c / (1 + c) per channel
+#define TONEMAP_ACES 2      // Narkowicz's fit of the ACES filmic curve
+
+// Pixel encodings of tonemap.comp.glsl. The 8- and 10-bit ones are tonemapped and sRGB-encoded display images;
+// the others keep linear HDR values, only scaled by the exposure.
+#define ENCODING_RGBA8 0    // 4 x 8-bit sRGB, alpha 255 (4 bytes per pixel)
+#define ENCODING_RGB10A2 1  // 3 x 10-bit sRGB, 2-bit alpha 3 (4 bytes per pixel)
+#define ENCODING_RGB9E5 2   // 3 x 9-bit mantissa, shared 5-bit exponent, as VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 (4 bytes per pixel)
+#define ENCODING_RGBA16F 3  // 4 x half float, alpha 1 (8 bytes per pixel)
+
+// Push constants of tonemap.comp.glsl.
+struct TonemapPushConstants
+{
+  uint  width;     // Image size in pixels
+  uint  height;
+  float exposure;  // Factor the linear color is multiplied with, 2^EV
+  uint  curve;     // One of the TONEMAP_* values
+  uint  encoding;  // One of the ENCODING_* values
+};
+
+#endif  // VK_MINI_PATH_TRACER_COMMON_H
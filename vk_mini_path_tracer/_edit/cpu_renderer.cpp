@@ -0,0 +1,392 @@
+#include "cpu_renderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "common.h"
+
+namespace {
+
+struct Vec3
+{
+  float x, y, z;
+
+  Vec3  operator+(const Vec3& b) const { return {x + b.x, y + b.y, z + b.z}; }
+  Vec3  operator-(const Vec3& b) const { return {x - b.x, y - b.y, z - b.z}; }
+  Vec3  operator*(const Vec3& b) const { return {x * b.x, y * b.y, z * b.z}; }
+  Vec3  operator*(float s) const { return {x * s, y * s, z * s}; }
+  float operator[](int axis) const { return (axis == 0) ? x : (axis == 1) ? y : z; }
+};
+
+float Dot(const Vec3& a, const Vec3& b)
+{
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Vec3 Cross(const Vec3& a, const Vec3& b)
+{
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+Vec3 Normalize(const Vec3& v)
+{
+  return v * (1.0f / std::sqrt(Dot(v, v)));
+}
+
+Vec3 Vertex(const CpuScene& scene, uint32_t triangle, int corner)
+{
+  const float* v = &scene.vertices[9 * size_t(triangle) + 3 * corner];
+  return {v[0], v[1], v[2]};
+}
+
+// The vertex that hits on the triangle are shaded with, as getVertex in raytrace.comp.glsl reads it.
+Vec3 ShadingVertex(const CpuScene& scene, uint32_t triangle, int corner)
+{
+  if(scene.shadingVertices.empty())
+  {
+    return Vertex(scene, triangle, corner);
+  }
+  const float* v = &scene.shadingVertices[9 * size_t(triangle) + 3 * corner];
+  return {v[0], v[1], v[2]};
+}
+
+// Recursively builds the subtree of node `nodeIndex`, which holds triangles [first, first + count) of scene.triangles.
+void BuildNode(CpuScene& scene, const std::vector<Vec3>& centroids, uint32_t nodeIndex, uint32_t first, uint32_t count)
+{
+  BvhNode node{{INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY}, first, count};
+  float   centroidMin[3] = {INFINITY, INFINITY, INFINITY};
+  float   centroidMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for(uint32_t i = first; i < first + count; i++)
+  {
+    const uint32_t triangle = scene.triangles[i];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      for(int corner = 0; corner < 3; corner++)
+      {
+        node.min[axis] = std::min(node.min[axis], Vertex(scene, triangle, corner)[axis]);
+        node.max[axis] = std::max(node.max[axis], Vertex(scene, triangle, corner)[axis]);
+      }
+      centroidMin[axis] = std::min(centroidMin[axis], centroids[triangle][axis]);
+      centroidMax[axis] = std::max(centroidMax[axis], centroids[triangle][axis]);
+    }
+  }
+
+  int axis = 0;
+  for(int other = 1; other < 3; other++)
+  {
+    if(centroidMax[other] - centroidMin[other] > centroidMax[axis] - centroidMin[axis])
+    {
+      axis = other;
+    }
+  }
+  // Make a leaf if there are few triangles left, or if their centroids are all at the same place:
+  if(count <= 4 || centroidMax[axis] == centroidMin[axis])
+  {
+    scene.nodes[nodeIndex] = node;
+    return;
+  }
+
+  const uint32_t half  = count / 2;
+  const auto     begin = scene.triangles.begin() + first;
+  std::nth_element(begin, begin + half, begin + count,
+                   [&centroids, axis](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+  node.first  = static_cast<uint32_t>(scene.nodes.size());
+  node.count  = 0;
+  scene.nodes[nodeIndex] = node;
+  scene.nodes.resize(scene.nodes.size() + 2);
+  BuildNode(scene, centroids, node.first, first, half);
+  BuildNode(scene, centroids, node.first + 1, first + half, count - half);
+}
+
+// Returns the distance along the ray (origin, 1 / direction) at which it enters the box of `node`, or INFINITY
+// if it misses the box or enters it after `tMax`.
+float IntersectBox(const BvhNode& node, const Vec3& origin, const Vec3& invDirection, float tMax)
+{
+  float tEnter = 0.0f;
+  float tExit  = tMax;
+  for(int axis = 0; axis < 3; axis++)
+  {
+    float t0 = (node.min[axis] - origin[axis]) * invDirection[axis];
+    float t1 = (node.max[axis] - origin[axis]) * invDirection[axis];
+    if(t0 > t1)
+    {
+      std::swap(t0, t1);
+    }
+    tEnter = std::max(tEnter, t0);
+    tExit  = std::min(tExit, t1);
+  }
+  return (tEnter <= tExit) ? tEnter : INFINITY;
+}
+
+struct Hit
+{
+  float    t = INFINITY;
+  float    u = 0.0f;  // Barycentrics of v1 and v2, as rayQueryGetIntersectionBarycentricsEXT returns them
+  float    v = 0.0f;
+  uint32_t triangle = ~0u;
+};
+
+// Finds the closest intersection of the ray with t in (0, tMax], like rayQueryProceedEXT with gl_RayFlagsOpaqueEXT.
+Hit Trace(const CpuScene& scene, const Vec3& origin, const Vec3& direction, float tMax)
+{
+  Hit        hit;
+  hit.t                   = tMax;
+  const Vec3 invDirection = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+  uint32_t   stack[64];
+  uint32_t   stackSize    = 0;
+  stack[stackSize++]      = 0;
+  while(stackSize > 0)
+  {
+    const BvhNode& node = scene.nodes[stack[--stackSize]];
+    if(IntersectBox(node, origin, invDirection, hit.t) == INFINITY)
+    {
+      continue;
+    }
+    if(node.count == 0)
+    {
+      // Visit the nearer child first:
+      const float tLeft  = IntersectBox(scene.nodes[node.first], origin, invDirection, hit.t);
+      const float tRight = IntersectBox(scene.nodes[node.first + 1], origin, invDirection, hit.t);
+      stack[stackSize++] = (tLeft < tRight) ? node.first + 1 : node.first;
+      stack[stackSize++] = (tLeft < tRight) ? node.first : node.first + 1;
+      continue;
+    }
+    // Moeller-Trumbore ray-triangle intersection
+    for(uint32_t i = node.first; i < node.first + node.count; i++)
+    {
+      const uint32_t triangle = scene.triangles[i];
+      const Vec3     v0       = Vertex(scene, triangle, 0);
+      const Vec3     edge1    = Vertex(scene, triangle, 1) - v0;
+      const Vec3     edge2    = Vertex(scene, triangle, 2) - v0;
+      const Vec3     p        = Cross(direction, edge2);
+      const float    det      = Dot(edge1, p);
+      if(det == 0.0f)
+      {
+        continue;
+      }
+      const float invDet = 1.0f / det;
+      const Vec3  s      = origin - v0;
+      const float u      = Dot(s, p) * invDet;
+      const Vec3  q      = Cross(s, edge1);
+      const float v      = Dot(direction, q) * invDet;
+      const float t      = Dot(edge2, q) * invDet;
+      if(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < hit.t)
+      {
+        hit = {t, u, v, triangle};
+      }
+    }
+  }
+  if(hit.triangle == ~0u)
+  {
+    hit.t = INFINITY;
+  }
+  return hit;
+}
+
+// The random numbers of raytrace.comp.glsl, bit for bit: see stepRNG, hashUint, nestedUniformScramble, sobol and
+// the Sampler there.
+uint32_t StepRng(uint32_t rngState)
+{
+  return rngState * 747796405u + 1u;
+}
+
+float StepAndOutputRngFloat(uint32_t& rngState)
+{
+  rngState      = StepRng(rngState);
+  uint32_t word = ((rngState >> ((rngState >> 28) + 4)) ^ rngState) * 277803737u;
+  word          = (word >> 22) ^ word;
+  return float(word) / 4294967295.0f;
+}
+
+uint32_t HashUint(uint32_t v)
+{
+  const uint32_t state = v * 747796405u + 2891336453u;
+  const uint32_t word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+uint32_t ReverseBits(uint32_t x)
+{
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+  x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+{
+  x = ReverseBits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return ReverseBits(x);
+}
+
+struct Sampler
+{
+  const CpuScene& scene;
+  uint32_t        pixelSeed;
+  uint32_t        rngState    = 0;
+  uint32_t        sampleIndex = 0;
+  uint32_t        dimension   = 0;
+
+  void startSample(uint32_t index)
+  {
+    rngState    = HashUint(pixelSeed ^ HashUint(index));
+    sampleIndex = index;
+    dimension   = 0;
+  }
+
+  float next()
+  {
+    if(scene.sampler != SAMPLER_SOBOL)
+    {
+      return StepAndOutputRngFloat(rngState);
+    }
+    const uint32_t group     = dimension / SOBOL_DIMENSIONS;
+    const uint32_t groupSeed = HashUint(pixelSeed ^ HashUint(group));
+    uint32_t       index     = NestedUniformScramble(sampleIndex, groupSeed);
+    uint32_t       x         = 0;
+    for(uint32_t bit = 0; index != 0; bit++, index >>= 1)
+    {
+      if((index & 1u) != 0)
+      {
+        x ^= scene.sobolDirections[32 * (dimension % SOBOL_DIMENSIONS) + bit];
+      }
+    }
+    x = NestedUniformScramble(x, HashUint(groupSeed + dimension));
+    dimension++;
+    return float(x >> 8) / 16777216.0f;
+  }
+};
+
+Vec3 SkyColor(const Vec3& direction)
+{
+  if(direction.y > 0.0f)
+  {
+    const Vec3 zenith = {0.25f, 0.5f, 1.0f};
+    return Vec3{1.0f, 1.0f, 1.0f} * (1.0f - direction.y) + zenith * direction.y;
+  }
+  return {0.03f, 0.03f, 0.03f};
+}
+
+float Sign(float x)
+{
+  return (x > 0.0f) ? 1.0f : (x < 0.0f) ? -1.0f : 0.0f;
+}
+
+}  // namespace
+
+CpuScene BuildCpuScene(const Mesh& mesh, uint32_t sampler, bool quantizedVertices)
+{
+  CpuScene scene;
+  scene.sampler         = sampler;
+  scene.sobolDirections = BuildSobolDirections();
+  scene.vertices.resize(9 * size_t(mesh.numTriangles()));
+  std::vector<Vec3> centroids(mesh.numTriangles());
+  for(uint32_t triangle = 0; triangle < mesh.numTriangles(); triangle++)
+  {
+    Vec3 centroid = {0.0f, 0.0f, 0.0f};
+    for(int corner = 0; corner < 3; corner++)
+    {
+      const float* v = &mesh.vertices[3 * mesh.indices[3 * triangle + corner]];
+      std::copy(v, v + 3, &scene.vertices[9 * size_t(triangle) + 3 * corner]);
+      centroid = centroid + Vec3{v[0], v[1], v[2]} * (1.0f / 3.0f);
+    }
+    centroids[triangle] = centroid;
+  }
+  if(quantizedVertices)
+  {
+    const QuantizedPositions quantized = QuantizePositions(mesh);
+    scene.shadingVertices.resize(scene.vertices.size());
+    for(uint32_t triangle = 0; triangle < mesh.numTriangles(); triangle++)
+    {
+      for(int corner = 0; corner < 3; corner++)
+      {
+        const uint32_t vertex = mesh.indices[3 * triangle + corner];
+        const uint32_t q[3]   = {quantized.packed[2 * vertex] & 0xFFFFu, quantized.packed[2 * vertex] >> 16,
+                                 quantized.packed[2 * vertex + 1]};
+        float*         v      = &scene.shadingVertices[9 * size_t(triangle) + 3 * corner];
+        for(int axis = 0; axis < 3; axis++)
+        {
+          v[axis] = quantized.origin[axis] + quantized.scale[axis] * float(q[axis]);
+        }
+      }
+    }
+  }
+  scene.triangles.resize(mesh.numTriangles());
+  std::iota(scene.triangles.begin(), scene.triangles.end(), 0);
+  scene.nodes.resize(1);
+  BuildNode(scene, centroids, 0, 0, mesh.numTriangles());
+  return scene;
+}
+
+void RenderTileOnCpu(const CpuScene& scene, const TileGrid& grid, uint32_t tile, uint32_t firstSample, uint32_t sampleCount, float* sums)
+{
+  // Same camera as raytrace.comp.glsl
+  const Vec3  cameraOrigin     = {-0.001f, 1.0f, 6.0f};
+  const float fovVerticalSlope = 1.0f / 5.0f;
+  const float width            = float(grid.width);
+  const float height           = float(grid.height);
+
+  const uint32_t tileX = (tile & 0xFFFFu) * WORKGROUP_WIDTH;
+  const uint32_t tileY = (tile >> 16) * WORKGROUP_HEIGHT;
+  for(uint32_t y = tileY; y < std::min(tileY + WORKGROUP_HEIGHT, grid.height); y++)
+  {
+    for(uint32_t x = tileX; x < std::min(tileX + WORKGROUP_WIDTH, grid.width); x++)
+    {
+      Sampler sampler{scene, HashUint(grid.width * y + x)};
+      Vec3    summedPixelColor       = {0.0f, 0.0f, 0.0f};
+      float   summedSquaredLuminance = 0.0f;
+      for(uint32_t sampleIdx = 0; sampleIdx < sampleCount; sampleIdx++)
+      {
+        sampler.startSample(firstSample + sampleIdx);
+        const float jitterX = sampler.next();
+        const float jitterY = sampler.next();
+        const float screenU = (2.0f * (float(x) + jitterX) - width) / height;
+        const float screenV = -(2.0f * (float(y) + jitterY) - height) / height;
+
+        Vec3 rayOrigin           = cameraOrigin;
+        Vec3 rayDirection        = Normalize({fovVerticalSlope * screenU, fovVerticalSlope * screenV, -1.0f});
+        Vec3 accumulatedRayColor = {1.0f, 1.0f, 1.0f};
+        for(int tracedSegments = 0; tracedSegments < 32; tracedSegments++)
+        {
+          const Hit hit = Trace(scene, rayOrigin, rayDirection, 10000.0f);
+          if(hit.triangle != ~0u)
+          {
+            const Vec3 v0            = ShadingVertex(scene, hit.triangle, 0);
+            const Vec3 v1            = ShadingVertex(scene, hit.triangle, 1);
+            const Vec3 v2            = ShadingVertex(scene, hit.triangle, 2);
+            const Vec3 worldPosition = v0 * (1.0f - hit.u - hit.v) + v1 * hit.u + v2 * hit.v;
+            const Vec3 worldNormal   = Normalize(Cross(v1 - v0, v2 - v0));
+
+            accumulatedRayColor = accumulatedRayColor * 0.7f;
+            rayOrigin           = worldPosition - worldNormal * (0.0001f * Sign(Dot(rayDirection, worldNormal)));
+
+            const float theta = 6.2831853f * sampler.next();
+            const float u     = 2.0f * sampler.next() - 1.0f;
+            const float r     = std::sqrt(1.0f - u * u);
+            rayDirection      = Normalize(worldNormal + Vec3{r * std::cos(theta), r * std::sin(theta), u});
+          }
+          else
+          {
+            accumulatedRayColor   = accumulatedRayColor * SkyColor(rayDirection);
+            summedPixelColor      = summedPixelColor + accumulatedRayColor;
+            const float luminance = Dot(accumulatedRayColor, {0.2126f, 0.7152f, 0.0722f});
+            summedSquaredLuminance += luminance * luminance;
+            break;
+          }
+        }
+      }
+      float* pixelSums = &sums[4 * (size_t(grid.width) * y + x)];
+      pixelSums[0]     = summedPixelColor.x;
+      pixelSums[1]     = summedPixelColor.y;
+      pixelSums[2]     = summedPixelColor.z;
+      pixelSums[3]     = summedSquaredLuminance;
+    }
+  }
+}
@@ -0,0 +1,40 @@
+// CPU backend: the path tracing kernel of raytrace.comp.glsl on a BVH built on the CPU, so that CPU cores can
+// render tiles next to the GPU. It renders the same image, with the same samplers and sample indices.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+#include "sampling.hpp"
+
+// A node of a bounding volume hierarchy. Inner nodes have 2 children, at `first` and `first + 1`; leaves hold
+// `count` triangles, at `first` onwards in CpuScene::triangles.
+struct BvhNode
+{
+  float    min[3];
+  float    max[3];
+  uint32_t first;
+  uint32_t count;  // 0 for inner nodes
+};
+
+// A mesh, as the CPU backend traces it.
+struct CpuScene
+{
+  std::vector<BvhNode>  nodes;      // nodes[0] is the root
+  std::vector<uint32_t> triangles;  // Triangle indices, in the order of the BVH's leaves
+  std::vector<float>    vertices;   // 9 floats (v0, v1, v2) per triangle of the mesh, in the mesh's order
+  std::vector<float>    shadingVertices;  // The same, decoded from QuantizePositions; empty without quantization
+  std::vector<uint32_t> sobolDirections;  // See BuildSobolDirections
+  uint32_t              sampler = 0;      // One of the SAMPLER_* values
+};
+
+// Builds the BVH of `mesh`, splitting nodes at the median of their longest axis, with up to 4 triangles per leaf.
+// With `quantizedVertices`, hits are shaded from the 16-bit positions like SPEC_QUANTIZED_VERTICES does, while
+// the rays are still intersected with the exact ones.
+CpuScene BuildCpuScene(const Mesh& mesh, uint32_t sampler, bool quantizedVertices);
+
+// Renders samples [firstSample, firstSample + sampleCount) of each pixel of tile `tile` of `grid` (see TileGrid),
+// like raytrace.comp.glsl with ADAPTIVE_SAMPLING: `sums` holds 4 floats per pixel of the image, as in
+// BINDING_ACCUMULATION, and the pixels of the tile are set to the sums of their samples.
+void RenderTileOnCpu(const CpuScene& scene, const TileGrid& grid, uint32_t tile, uint32_t firstSample, uint32_t sampleCount, float* sums);
@@ -0,0 +1,285 @@
+#include "distributed.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include "common.h"
+
+// First word of a partial render file ("VKPT" in little-endian), followed by the other words of the header.
+static const uint32_t partial_magic        = 0x54504B56u;
+static const size_t   partial_header_words = 7;
+
+std::vector<RenderJob> PartitionFrame(uint32_t height, uint32_t totalSamples, uint32_t rowBands, uint32_t sampleSlices)
+{
+  const uint32_t tileRows = (height + WORKGROUP_HEIGHT - 1) / WORKGROUP_HEIGHT;
+  rowBands                = std::clamp(rowBands, 1u, std::max(tileRows, 1u));
+  sampleSlices            = std::clamp(sampleSlices, 1u, std::max(totalSamples, 1u));
+
+  std::vector<RenderJob> jobs;
+  for(uint32_t band = 0; band < rowBands; band++)
+  {
+    for(uint32_t slice = 0; slice < sampleSlices; slice++)
+    {
+      RenderJob job;
+      job.rowBegin    = std::min(tileRows * band / rowBands * WORKGROUP_HEIGHT, height);
+      job.rowEnd      = std::min(tileRows * (band + 1) / rowBands * WORKGROUP_HEIGHT, height);
+      job.firstSample = totalSamples * slice / sampleSlices;
+      job.sampleCount = totalSamples * (slice + 1) / sampleSlices - job.firstSample;
+      jobs.push_back(job);
+    }
+  }
+  return jobs;
+}
+
+std::string FormatRenderJob(const RenderJob& job)
+{
+  char text[64];
+  snprintf(text, sizeof(text), "%u,%u,%u,%u", job.rowBegin, job.rowEnd, job.firstSample, job.sampleCount);
+  return text;
+}
+
+bool ParseRenderJob(const char* text, RenderJob& job)
+{
+  return (sscanf(text, "%u,%u,%u,%u", &job.rowBegin, &job.rowEnd, &job.firstSample, &job.sampleCount) == 4)
+         && (job.rowBegin < job.rowEnd) && (job.sampleCount > 0);
+}
+
+bool WritePartial(const std::string& path, const PartialRender& partial)
+{
+  const std::string temporaryPath = path + ".tmp";
+  FILE*             file          = fopen(temporaryPath.c_str(), "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  const uint32_t header[partial_header_words] = {partial_magic,         partial.width,           partial.height,
+                                                 partial.job.rowBegin,  partial.job.rowEnd,      partial.job.firstSample,
+                                                 partial.job.sampleCount};
+  bool           ok = (fwrite(header, sizeof(uint32_t), partial_header_words, file) == partial_header_words);
+  ok = ok && (fwrite(partial.sums.data(), sizeof(float), partial.sums.size(), file) == partial.sums.size());
+  ok = (fclose(file) == 0) && ok;
+  // rename() doesn't replace existing files on Windows:
+  remove(path.c_str());
+  return ok && (rename(temporaryPath.c_str(), path.c_str()) == 0);
+}
+
+bool ReadPartial(const std::string& path, PartialRender& partial, bool headerOnly)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  uint32_t header[partial_header_words];
+  bool     ok = (fread(header, sizeof(uint32_t), partial_header_words, file) == partial_header_words)
+            && (header[0] == partial_magic);
+  if(ok)
+  {
+    partial.width           = header[1];
+    partial.height          = header[2];
+    partial.job.rowBegin    = header[3];
+    partial.job.rowEnd      = header[4];
+    partial.job.firstSample = header[5];
+    partial.job.sampleCount = header[6];
+    ok                      = (partial.job.rowBegin < partial.job.rowEnd) && (partial.job.rowEnd <= partial.height);
+  }
+  if(ok && !headerOnly)
+  {
+    partial.sums.resize(size_t(partial.job.rowEnd - partial.job.rowBegin) * partial.width * 4);
+    ok = (fread(partial.sums.data(), sizeof(float), partial.sums.size(), file) == partial.sums.size());
+  }
+  fclose(file);
+  return ok;
+}
+
+bool MergePartials(const std::vector<std::string>& paths, uint32_t& width, uint32_t& height, std::vector<float>& rgb,
+                   uint32_t& uncoveredPixels)
+{
+  // Read the headers to put the partials in job order, and check that they are of the same image:
+  std::vector<PartialRender> headers(paths.size());
+  for(size_t i = 0; i < paths.size(); i++)
+  {
+    if(!ReadPartial(paths[i], headers[i], true)
+       || ((i > 0) && ((headers[i].width != headers[0].width) || (headers[i].height != headers[0].height))))
+    {
+      return false;
+    }
+  }
+  std::vector<size_t> order(paths.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&headers](size_t a, size_t b) {
+    const RenderJob& jobA = headers[a].job;
+    const RenderJob& jobB = headers[b].job;
+    return (jobA.rowBegin != jobB.rowBegin) ? (jobA.rowBegin < jobB.rowBegin) : (jobA.firstSample < jobB.firstSample);
+  });
+
+  width  = headers.empty() ? 0 : headers[0].width;
+  height = headers.empty() ? 0 : headers[0].height;
+  std::vector<float>    sums(size_t(width) * height * 3, 0.0f);
+  std::vector<uint32_t> sampleCounts(size_t(width) * height, 0);
+  for(const size_t i : order)
+  {
+    // Read one partial at a time, so that memory use doesn't grow with the number of partials
+    PartialRender partial;
+    if(!ReadPartial(paths[i], partial))
+    {
+      return false;
+    }
+    const size_t firstPixel = size_t(partial.job.rowBegin) * width;
+    for(size_t pixel = 0; pixel < partial.sums.size() / 4; pixel++)
+    {
+      for(int channel = 0; channel < 3; channel++)
+      {
+        sums[3 * (firstPixel + pixel) + channel] += partial.sums[4 * pixel + channel];
+      }
+      sampleCounts[firstPixel + pixel] += partial.job.sampleCount;
+    }
+  }
+
+  rgb.resize(sums.size());
+  uncoveredPixels = 0;
+  for(size_t pixel = 0; pixel < sampleCounts.size(); pixel++)
+  {
+    const float invSampleCount = (sampleCounts[pixel] > 0) ? 1.0f / float(sampleCounts[pixel]) : 0.0f;
+    uncoveredPixels += (sampleCounts[pixel] == 0) ? 1 : 0;
+    for(int channel = 0; channel < 3; channel++)
+    {
+      rgb[3 * pixel + channel] = sums[3 * pixel + channel] * invSampleCount;
+    }
+  }
+  return true;
+}
+
+std::string QuoteArgument(const std::string& argument)
+{
+#ifdef _WIN32
+  // cmd.exe has no quotes that keep everything literal; double quotes, with the ones inside escaped for the
+  // program's argument parser, keep spaces together.
+  std::string quoted = "\"";
+  for(const char c : argument)
+  {
+    if(c == '"')
+    {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+#else
+  // POSIX shells keep everything between single quotes literal, including $, ` and \. A single quote ends the
+  // quoted string, adds an escaped quote and starts a new quoted string.
+  std::string quoted = "'";
+  for(const char c : argument)
+  {
+    if(c == '\'')
+    {
+      quoted += "'\\''";
+    }
+    else
+    {
+      quoted += c;
+    }
+  }
+  return quoted + "'";
+#endif
+}
+
+std::vector<std::string> RunCoordinator(const CoordinatorSettings& settings)
+{
+  std::vector<std::string> paths(settings.jobs.size());
+  for(size_t i = 0; i < paths.size(); i++)
+  {
+    paths[i] = settings.partialDir + "/partial_" + std::to_string(i) + ".bin";
+  }
+
+  // The queue of jobs that no worker is running, and how often each job has failed
+  std::mutex              mutex;
+  std::condition_variable changed;
+  std::deque<size_t>      queue(settings.jobs.size());
+  std::iota(queue.begin(), queue.end(), 0);
+  std::vector<uint32_t> failures(settings.jobs.size(), 0);
+  size_t                running = 0;
+  bool                  givenUp = false;
+
+  const auto runWorker = [&](size_t worker) {
+    uint32_t failuresInARow = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(failuresInARow < 2)
+    {
+      // Wait for a job; a job that another worker fails can come back while jobs are still running.
+      changed.wait(lock, [&]() { return givenUp || !queue.empty() || (running == 0); });
+      if(givenUp || queue.empty())
+      {
+        break;
+      }
+      const size_t job = queue.front();
+      queue.pop_front();
+      running++;
+      lock.unlock();
+
+      // A prefix like "ssh render01" hands the rest of the command line to the remote shell, which parses it a
+      // second time, so each argument is quoted for that shell, then the result for the local one.
+      std::string command = settings.workerPrefixes[worker];
+      const auto  quote   = [remote = !command.empty()](const std::string& argument) {
+        return remote ? QuoteArgument(QuoteArgument(argument)) : QuoteArgument(argument);
+      };
+      command += (command.empty() ? "" : " ") + quote(settings.executable);
+      for(const std::string& argument : settings.arguments)
+      {
+        command += " " + quote(argument);
+      }
+      command += " --worker-job " + FormatRenderJob(settings.jobs[job]) + " --partial " + quote(paths[job]);
+      remove(paths[job].c_str());  // So that a file from an earlier run doesn't count as this job's result
+
+      const auto    start  = std::chrono::steady_clock::now();
+      const int     status = std::system(command.c_str());
+      PartialRender partial;
+      const bool    ok = (status == 0) && ReadPartial(paths[job], partial, true)
+                      && (FormatRenderJob(partial.job) == FormatRenderJob(settings.jobs[job]));
+      const double  ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      lock.lock();
+      running--;
+      if(ok)
+      {
+        printf("Worker %zu: job %zu (%s) done in %.1f ms\n", worker, job, FormatRenderJob(settings.jobs[job]).c_str(), ms);
+        failuresInARow = 0;
+      }
+      else
+      {
+        fprintf(stderr, "Worker %zu: job %zu failed (exit status %d), reassigning it\n", worker, job, status);
+        failuresInARow++;
+        queue.push_back(job);
+        givenUp = givenUp || (++failures[job] >= settings.maxAttempts);
+      }
+      changed.notify_all();
+    }
+    if(failuresInARow >= 2)
+    {
+      fprintf(stderr, "Worker %zu failed twice in a row; giving it no more jobs\n", worker);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for(size_t worker = 0; worker < settings.workerPrefixes.size(); worker++)
+  {
+    threads.emplace_back(runWorker, worker);
+  }
+  for(std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  // If every worker died, jobs can be left in the queue:
+  if(givenUp || !queue.empty())
+  {
+    return {};
+  }
+  return paths;
+}
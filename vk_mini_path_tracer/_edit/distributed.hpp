@@ -0,0 +1,79 @@
+// Rendering one frame with several processes: the jobs a frame is split into, the partial renders workers write,
+// merging them, and the coordinator that runs the jobs on local or remote worker processes.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A piece of a frame: samples [firstSample, firstSample + sampleCount) of each pixel in rows [rowBegin, rowEnd).
+struct RenderJob
+{
+  uint32_t rowBegin    = 0;
+  uint32_t rowEnd      = 0;
+  uint32_t firstSample = 0;
+  uint32_t sampleCount = 0;
+};
+
+// Splits the rows of a `height`-pixel image into `rowBands` bands of whole WORKGROUP_HEIGHT tile rows, and the
+// `totalSamples` samples per pixel into `sampleSlices` ranges. Returns one job per (band, range), in that order.
+std::vector<RenderJob> PartitionFrame(uint32_t height, uint32_t totalSamples, uint32_t rowBands, uint32_t sampleSlices);
+
+// Formats a job as "rowBegin,rowEnd,firstSample,sampleCount", the value of main.cpp's --worker-job option.
+std::string FormatRenderJob(const RenderJob& job);
+// Parses the output of FormatRenderJob. Returns false if `text` isn't a valid job.
+bool ParseRenderJob(const char* text, RenderJob& job);
+
+// What a worker sends back for a job: for each pixel of the job's rows, the sums of its samples as in
+// BINDING_ACCUMULATION (sum of colors, sum of squared luminances).
+struct PartialRender
+{
+  uint32_t           width  = 0;  // Size of the whole image
+  uint32_t           height = 0;
+  RenderJob          job;
+  std::vector<float> sums;  // 4 floats per pixel of rows [job.rowBegin, job.rowEnd)
+};
+
+// Writes `partial` to a temporary file, then renames it to `path`, so that a worker that dies while writing never
+// leaves a file that looks complete. Returns false if the file can't be written.
+bool WritePartial(const std::string& path, const PartialRender& partial);
+
+// Reads a file written by WritePartial; with `headerOnly`, everything but the sums. Returns false if the file
+// can't be read, isn't a partial render or is truncated.
+bool ReadPartial(const std::string& path, PartialRender& partial, bool headerOnly = false);
+
+// Merges the partial render files `paths` of one image into `rgb` (3 floats per pixel): each pixel is the sum of
+// its sums over all partials that cover it, divided by their total sample count. Pixels no partial covers are
+// black, and are counted in `uncoveredPixels`.
+// The partials are added in job order (row band, then first sample) and not in the order they are given or were
+// rendered in. Since each sample only depends on its pixel and index, the same jobs always merge into the same
+// bits, whichever worker rendered each of them and however many times it was reassigned.
+// Returns false if a file can't be read or the partials are of different image sizes.
+bool MergePartials(const std::vector<std::string>& paths, uint32_t& width, uint32_t& height, std::vector<float>& rgb,
+                   uint32_t& uncoveredPixels);
+
+// Quotes a command-line argument for the shell that std::system runs (sh, or cmd.exe on Windows), so that it reaches
+// the program unchanged.
+std::string QuoteArgument(const std::string& argument);
+
+// Settings of RunCoordinator.
+struct CoordinatorSettings
+{
+  // One command prefix per worker, which the worker's command line is appended to: "" runs a local process, and
+  // e.g. "ssh render01" a remote one. A prefix must run the command line through a shell, as ssh does, since its
+  // arguments are quoted twice. Remote workers must see `partialDir` under the same path.
+  std::vector<std::string> workerPrefixes;
+  std::string              executable;  // The renderer, as the workers see it
+  std::vector<std::string> arguments;   // Arguments every worker gets, e.g. the scene options
+  std::string              partialDir = ".";  // Where the workers write their partial render files
+  std::vector<RenderJob>   jobs;
+  uint32_t                 maxAttempts = 3;  // Number of times a job is tried before the coordinator gives up
+};
+
+// Runs each job as `<prefix> <executable> <arguments> --worker-job <job> --partial <file>` on one of the workers,
+// each worker taking the next job when it has finished its last one. A job fails if its worker exits with an error
+// or doesn't write a partial file for it; the job then goes back to the queue for the other workers, and a worker
+// that fails twice in a row is considered dead and gets no more jobs.
+// Returns the paths of the partial files in job order, or an empty vector if a job failed `maxAttempts` times or
+// all workers died.
+std::vector<std::string> RunCoordinator(const CoordinatorSettings& settings);
@@ -0,0 +1,523 @@
+#include "image_io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+// The zlib compressor of stb_image_write, whose implementation main.cpp compiles in.
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+bool WritePfm(const char* path, const float* data, uint32_t width, uint32_t height, uint32_t channels)
+{
+  if((channels != 1) && (channels != 3))
+  {
+    return false;
+  }
+  FILE* file = fopen(path, "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  // "PF" is RGB and "Pf" is grayscale; a negative scale means little-endian floats.
+  fprintf(file, "%s\n%u %u\n-1.0\n", (channels == 3) ? "PF" : "Pf", width, height);
+  // PFM stores the scanlines from the bottom to the top of the image:
+  const size_t rowFloats = size_t(width) * channels;
+  bool         ok        = true;
+  for(uint32_t y = height; y-- > 0;)
+  {
+    ok = ok && (fwrite(data + y * rowFloats, sizeof(float), rowFloats, file) == rowFloats);
+  }
+  return (fclose(file) == 0) && ok;
+}
+
+bool ReadPfm(const char* path, std::vector<float>& data, uint32_t& width, uint32_t& height, uint32_t& channels)
+{
+  FILE* file = fopen(path, "rb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  char  type[3] = {};
+  float scale   = 0.0f;
+  // The header is the type, the size and the scale, separated by single whitespace characters
+  bool ok = (fscanf(file, "%2s %u %u %f", type, &width, &height, &scale) == 4) && (fgetc(file) != EOF)
+            && (type[0] == 'P') && (type[1] == 'F' || type[1] == 'f') && (width > 0) && (height > 0);
+  if(ok)
+  {
+    // Only little-endian files (negative scale), which is what WritePfm and little-endian machines write
+    channels               = (type[1] == 'F') ? 3 : 1;
+    const size_t rowFloats = size_t(width) * channels;
+    data.resize(rowFloats * height);
+    for(uint32_t y = height; ok && (y-- > 0);)
+    {
+      ok = (scale < 0.0f) && (fread(data.data() + y * rowFloats, sizeof(float), rowFloats, file) == rowFloats);
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+bool WriteRaw(const char* path, const void* data, size_t size)
+{
+  FILE* file = fopen(path, "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  const bool ok = (fwrite(data, 1, size, file) == size);
+  return (fclose(file) == 0) && ok;
+}
+
+float HalfToFloat(uint16_t half)
+{
+  const uint32_t sign     = uint32_t(half & 0x8000u) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1Fu;
+  const uint32_t mantissa = half & 0x3FFu;
+  if(exponent == 0)
+  {
+    // Zero or subnormal: mantissa * 2^-24
+    const float magnitude = std::ldexp(float(mantissa), -24);
+    return sign ? -magnitude : magnitude;
+  }
+  // Rebias the exponent from 15 to 127; infinities and NaNs keep the maximum exponent
+  const uint32_t bits = sign | ((exponent == 31) ? 0x7F800000u : ((exponent + 112) << 23)) | (mantissa << 13);
+  float          value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void EncodeRgbe(const float rgb[3], uint8_t rgbe[4])
+{
+  EncodeRgbeRow(rgb, 1, rgbe);
+}
+
+void EncodeRgbeRow(const float* rgb, size_t count, uint8_t* rgbe)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    const float r            = std::max(rgb[3 * i + 0], 0.0f);
+    const float g            = std::max(rgb[3 * i + 1], 0.0f);
+    const float b            = std::max(rgb[3 * i + 2], 0.0f);
+    const float maxComponent = std::max(r, std::max(g, b));
+    // frexp(maxComponent) = m * 2^exponent with m in [0.5, 1), read from the float's exponent bits. stb_image_write
+    // scales by m * 256 / maxComponent, which is exactly 2^(8 - exponent).
+    uint32_t bits;
+    memcpy(&bits, &maxComponent, sizeof(bits));
+    const int32_t  exponent  = int32_t((bits >> 23) & 0xFFu) - 126;
+    const uint32_t scaleBits = uint32_t(127 + 8 - exponent) << 23;
+    float          scale;
+    memcpy(&scale, &scaleBits, sizeof(scale));
+    const bool black = !(maxComponent >= 1e-32f);
+    rgbe[4 * i + 0]  = black ? 0 : static_cast<uint8_t>(r * scale);
+    rgbe[4 * i + 1]  = black ? 0 : static_cast<uint8_t>(g * scale);
+    rgbe[4 * i + 2]  = black ? 0 : static_cast<uint8_t>(b * scale);
+    rgbe[4 * i + 3]  = black ? 0 : static_cast<uint8_t>(exponent + 128);
+  }
+}
+
+void EncodeHdrScanline(const uint8_t* rgbe, uint32_t width, std::vector<uint8_t>& out)
+{
+  if((width < 8) || (width > 32767))
+  {
+    const size_t start = out.size();
+    out.insert(out.end(), rgbe, rgbe + size_t(width) * 4);
+    // A flat scanline must not start like a run-length encoded one, (2, 2, < 128); see HdrTileWriter::writeTile.
+    if((width > 0) && (out[start] == 2) && (out[start + 1] == 2) && (out[start + 2] < 128))
+    {
+      out[start] = 3;
+    }
+    return;
+  }
+
+  out.insert(out.end(), {2, 2, uint8_t(width >> 8), uint8_t(width & 0xFF)});
+  for(int channel = 0; channel < 4; channel++)
+  {
+    const auto value = [&](uint32_t x) { return rgbe[4 * size_t(x) + channel]; };
+    uint32_t   x     = 0;
+    while(x < width)
+    {
+      // A run of at least 3 equal values: 128 + length, then the value
+      uint32_t run = 1;
+      while((run < 127) && (x + run < width) && (value(x + run) == value(x)))
+      {
+        run++;
+      }
+      if(run >= 3)
+      {
+        out.insert(out.end(), {uint8_t(128 + run), value(x)});
+        x += run;
+        continue;
+      }
+      // Otherwise, up to 128 literal values until the next run: length, then the values
+      const uint32_t start = x;
+      while((x < width) && (x - start < 128)
+            && !((x + 2 < width) && (value(x) == value(x + 1)) && (value(x) == value(x + 2))))
+      {
+        x++;
+      }
+      out.push_back(uint8_t(x - start));
+      for(uint32_t i = start; i < x; i++)
+      {
+        out.push_back(value(i));
+      }
+    }
+  }
+}
+
+const char* ImageFormatExtension(ImageFormat format)
+{
+  switch(format)
+  {
+    case ImageFormat::Pfm:
+      return "pfm";
+    case ImageFormat::Exr:
+      return "exr";
+    default:
+      return "hdr";
+  }
+}
+
+bool HdrTileWriter::open(const char* path, uint32_t width, uint32_t height)
+{
+  m_file.open(path, std::ios::binary | std::ios::trunc);
+  if(!m_file)
+  {
+    return false;
+  }
+  m_width  = width;
+  m_height = height;
+  m_file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+  m_dataStart = m_file.tellp();
+  return bool(m_file);
+}
+
+bool HdrTileWriter::writeTile(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* rgb)
+{
+  std::vector<uint8_t> row(size_t(width) * 4);
+  for(uint32_t tileY = 0; tileY < height; tileY++)
+  {
+    for(uint32_t tileX = 0; tileX < width; tileX++)
+    {
+      uint8_t* rgbe = &row[size_t(tileX) * 4];
+      EncodeRgbe(&rgb[3 * (size_t(tileY) * width + tileX)], rgbe);
+      // Readers treat a scanline that starts with (2, 2, < 128) as run-length encoded; nudge such a (very dark)
+      // first pixel so that the flat scanline is read correctly.
+      if((x + tileX == 0) && (rgbe[0] == 2) && (rgbe[1] == 2) && (rgbe[2] < 128))
+      {
+        rgbe[0] = 3;
+      }
+    }
+    m_file.seekp(m_dataStart + std::streamoff((uint64_t(y + tileY) * m_width + x) * 4));
+    m_file.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size()));
+  }
+  return bool(m_file);
+}
+
+bool HdrTileWriter::close()
+{
+  const bool ok = bool(m_file);
+  m_file.close();
+  return ok && !m_file.fail();
+}
+
+ImageWriter::ImageWriter(uint32_t numThreads)
+{
+  numThreads = (numThreads > 0) ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+  for(uint32_t i = 0; i < numThreads; i++)
+  {
+    m_threads.emplace_back([this]() {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while(true)
+      {
+        m_changed.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+        if(m_tasks.empty())
+        {
+          return;
+        }
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_busyThreads++;
+        lock.unlock();
+        task();
+        lock.lock();
+        m_busyThreads--;
+        m_changed.notify_all();
+      }
+    });
+  }
+}
+
+ImageWriter::~ImageWriter()
+{
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_changed.notify_all();
+  for(std::thread& thread : m_threads)
+  {
+    thread.join();
+  }
+}
+
+void ImageWriter::write(Image image)
+{
+  auto shared = std::make_shared<Image>(std::move(image));
+  enqueue([this, shared]() {
+    if(!writeImage(*shared))
+    {
+      fprintf(stderr, "Could not write %s\n", shared->path.c_str());
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_failed = true;
+    }
+  });
+}
+
+bool ImageWriter::wait()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_changed.wait(lock, [this]() { return m_tasks.empty() && (m_busyThreads == 0); });
+  const bool ok = !m_failed;
+  m_failed      = false;
+  return ok;
+}
+
+void ImageWriter::enqueue(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_changed.notify_all();
+}
+
+void ImageWriter::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+  // Items are handed out through a counter. Helpers that only start once all items are taken do nothing, so
+  // this thread can do all the work itself if the pool is busy, and never waits for a helper that hasn't started.
+  struct Progress
+  {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+  };
+  const auto progress = std::make_shared<Progress>();
+  const auto work     = [progress, count, &body]() {
+    for(size_t i; (i = progress->next++) < count;)
+    {
+      body(i);
+      progress->done++;
+    }
+  };
+  for(size_t helper = 1; helper < std::min(count, m_threads.size()); helper++)
+  {
+    enqueue(work);
+  }
+  work();
+  while(progress->done < count)
+  {
+    std::this_thread::yield();
+  }
+}
+
+bool ImageWriter::writeImage(const Image& image)
+{
+  if(image.layers.empty() || (image.layers[0].pixels.size() < size_t(image.width) * image.height * image.layers[0].channels))
+  {
+    return false;
+  }
+  switch(image.format)
+  {
+    case ImageFormat::Pfm:
+      return WritePfm(image.path.c_str(), image.layers[0].pixels.data(), image.width, image.height, image.layers[0].channels);
+    case ImageFormat::Exr:
+      return writeExr(image);
+    default:
+      return writeHdr(image);
+  }
+}
+
+// Number of scanlines each thread encodes at a time.
+static const uint32_t band_height = 16;
+
+bool ImageWriter::writeHdr(const Image& image)
+{
+  const ImageLayer& layer = image.layers[0];
+  if(layer.channels != 3)
+  {
+    return false;
+  }
+  const uint32_t                    numBands = (image.height + band_height - 1) / band_height;
+  std::vector<std::vector<uint8_t>> bands(numBands);
+  parallelFor(numBands, [&](size_t band) {
+    std::vector<uint8_t> rgbe(size_t(image.width) * 4);
+    for(uint32_t y = uint32_t(band) * band_height; y < std::min(uint32_t(band + 1) * band_height, image.height); y++)
+    {
+      EncodeRgbeRow(&layer.pixels[size_t(y) * image.width * 3], image.width, rgbe.data());
+      EncodeHdrScanline(rgbe.data(), image.width, bands[band]);
+    }
+  });
+
+  FILE* file = fopen(image.path.c_str(), "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n", image.height, image.width);
+  bool ok = true;
+  for(const std::vector<uint8_t>& band : bands)
+  {
+    ok = ok && (fwrite(band.data(), 1, band.size(), file) == band.size());
+  }
+  return (fclose(file) == 0) && ok;
+}
+
+// Appends the little-endian bytes of `value` to `out`.
+template <typename T>
+static void AppendBytes(std::vector<uint8_t>& out, const T& value)
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Appends an attribute of an EXR header: its name, type, size and value.
+static void AppendExrAttribute(std::vector<uint8_t>& header, const char* name, const char* type, const std::vector<uint8_t>& value)
+{
+  header.insert(header.end(), name, name + strlen(name) + 1);
+  header.insert(header.end(), type, type + strlen(type) + 1);
+  AppendBytes(header, int32_t(value.size()));
+  header.insert(header.end(), value.begin(), value.end());
+}
+
+bool ImageWriter::writeExr(const Image& image)
+{
+  // The channels of all layers, sorted by name as EXR requires
+  struct Channel
+  {
+    std::string       name;
+    const ImageLayer* layer;
+    uint32_t          component;
+  };
+  std::vector<Channel> channels;
+  for(const ImageLayer& layer : image.layers)
+  {
+    if((layer.channels < 1) || (layer.channels > 3) || (layer.pixels.size() < size_t(image.width) * image.height * layer.channels)
+       || (!layer.components.empty() && (layer.components.size() != layer.channels)))
+    {
+      return false;
+    }
+    const std::string prefix     = layer.name.empty() ? std::string() : layer.name + ".";
+    const std::string components = !layer.components.empty() ? layer.components : (layer.channels == 1) ? "Y" : "RGB";
+    for(uint32_t component = 0; component < layer.channels; component++)
+    {
+      channels.push_back({prefix + components[component], &layer, component});
+    }
+  }
+  std::sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) { return a.name < b.name; });
+
+  std::vector<uint8_t> header = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};  // Magic number, version 2, single-part scanline file
+  std::vector<uint8_t> value;
+  for(const Channel& channel : channels)
+  {
+    value.insert(value.end(), channel.name.c_str(), channel.name.c_str() + channel.name.size() + 1);
+    AppendBytes(value, int32_t(2));      // FLOAT
+    AppendBytes(value, uint32_t(0));     // pLinear and reserved
+    AppendBytes(value, int32_t(1));      // xSampling
+    AppendBytes(value, int32_t(1));      // ySampling
+  }
+  value.push_back(0);
+  AppendExrAttribute(header, "channels", "chlist", value);
+  AppendExrAttribute(header, "compression", "compression", {3});  // ZIP_COMPRESSION: blocks of 16 scanlines
+  value.clear();
+  for(const int32_t coordinate : {0, 0, int32_t(image.width) - 1, int32_t(image.height) - 1})
+  {
+    AppendBytes(value, coordinate);
+  }
+  AppendExrAttribute(header, "dataWindow", "box2i", value);
+  AppendExrAttribute(header, "displayWindow", "box2i", value);
+  AppendExrAttribute(header, "lineOrder", "lineOrder", {0});  // INCREASING_Y
+  value.clear();
+  AppendBytes(value, 1.0f);
+  AppendExrAttribute(header, "pixelAspectRatio", "float", value);
+  AppendExrAttribute(header, "screenWindowWidth", "float", value);
+  value.clear();
+  AppendBytes(value, 0.0f);
+  AppendBytes(value, 0.0f);
+  AppendExrAttribute(header, "screenWindowCenter", "v2f", value);
+  header.push_back(0);
+
+  // Compress the blocks in parallel. Each block is its scanlines, each of which is all pixels of the first channel,
+  // then of the second, and so on; ZIP compression splits the bytes into odd and even halves, stores the
+  // differences of consecutive bytes, and deflates the result.
+  const uint32_t                    numBlocks = (image.height + band_height - 1) / band_height;
+  std::vector<std::vector<uint8_t>> blocks(numBlocks);
+  parallelFor(numBlocks, [&](size_t block) {
+    const uint32_t       firstY = uint32_t(block) * band_height;
+    const uint32_t       endY   = std::min(firstY + band_height, image.height);
+    std::vector<uint8_t> raw;
+    raw.reserve(size_t(endY - firstY) * image.width * channels.size() * sizeof(float));
+    for(uint32_t y = firstY; y < endY; y++)
+    {
+      for(const Channel& channel : channels)
+      {
+        const float* row = &channel.layer->pixels[size_t(y) * image.width * channel.layer->channels];
+        for(uint32_t x = 0; x < image.width; x++)
+        {
+          AppendBytes(raw, row[size_t(x) * channel.layer->channels + channel.component]);
+        }
+      }
+    }
+    std::vector<uint8_t> predicted(raw.size());
+    const size_t         half = (raw.size() + 1) / 2;
+    for(size_t i = 0; i < raw.size(); i++)
+    {
+      predicted[(i % 2 == 0) ? i / 2 : half + i / 2] = raw[i];
+    }
+    for(size_t i = predicted.size(); i-- > 1;)
+    {
+      predicted[i] = uint8_t(int(predicted[i]) - int(predicted[i - 1]) + 128);
+    }
+    int            compressedSize = 0;
+    unsigned char* compressed     = stbi_zlib_compress(predicted.data(), int(predicted.size()), &compressedSize, 8);
+    // Blocks that don't get smaller are stored uncompressed, which readers recognize by their size.
+    std::vector<uint8_t>& out = blocks[block];
+    AppendBytes(out, int32_t(firstY));
+    if((compressed != nullptr) && (size_t(compressedSize) < raw.size()))
+    {
+      AppendBytes(out, int32_t(compressedSize));
+      out.insert(out.end(), compressed, compressed + compressedSize);
+    }
+    else
+    {
+      AppendBytes(out, int32_t(raw.size()));
+      out.insert(out.end(), raw.begin(), raw.end());
+    }
+    free(compressed);
+  });
+
+  // The offset table, then the blocks
+  std::vector<uint8_t> offsets;
+  uint64_t             offset = header.size() + uint64_t(numBlocks) * sizeof(uint64_t);
+  for(const std::vector<uint8_t>& block : blocks)
+  {
+    AppendBytes(offsets, offset);
+    offset += block.size();
+  }
+  FILE* file = fopen(image.path.c_str(), "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  bool ok = (fwrite(header.data(), 1, header.size(), file) == header.size())
+            && (fwrite(offsets.data(), 1, offsets.size(), file) == offsets.size());
+  for(const std::vector<uint8_t>& block : blocks)
+  {
+    ok = ok && (fwrite(block.data(), 1, block.size(), file) == block.size());
+  }
+  return (fclose(file) == 0) && ok;
+}
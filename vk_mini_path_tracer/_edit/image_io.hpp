@@ -0,0 +1,123 @@
+// Writers for the image files main.cpp produces, and the output stage that writes them on a pool of threads.
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes `width` x `height` pixels of `channels` (1 or 3) floats each, in top-to-bottom scanline order, to a
+// Portable Float Map file. Returns false if the file can't be written.
+bool WritePfm(const char* path, const float* data, uint32_t width, uint32_t height, uint32_t channels);
+
+// Reads a Portable Float Map file of 1 or 3 channels into `data`, in top-to-bottom scanline order. Returns false if
+// the file can't be read, isn't a PFM file or is truncated.
+bool ReadPfm(const char* path, std::vector<float>& data, uint32_t& width, uint32_t& height, uint32_t& channels);
+
+// Writes `size` bytes to a file with no header. Returns false if the file can't be written.
+bool WriteRaw(const char* path, const void* data, size_t size);
+
+// Converts a linear RGB color to Radiance's shared-exponent RGBE format, the same way stb_image_write does.
+void EncodeRgbe(const float rgb[3], uint8_t rgbe[4]);
+
+// Same as EncodeRgbe for `count` pixels, without branches or calls to frexp, so that compilers vectorize the loop.
+void EncodeRgbeRow(const float* rgb, size_t count, uint8_t* rgbe);
+
+// Appends a scanline of `width` RGBE pixels to `out` as it is stored in a Radiance HDR file: run-length encoded
+// per channel when the format allows it (widths of 8 to 32767 pixels), flat otherwise.
+void EncodeHdrScanline(const uint8_t* rgbe, uint32_t width, std::vector<uint8_t>& out);
+
+// Converts an IEEE 754 half float, as read back from an rgba16f image, to a float.
+float HalfToFloat(uint16_t half);
+
+// File formats of ImageWriter.
+enum class ImageFormat
+{
+  Hdr,  // Radiance HDR, run-length encoded; the first layer, which must have 3 channels
+  Pfm,  // Portable Float Map; the first layer, which must have 1 or 3 channels
+  Exr,  // OpenEXR with 32-bit float channels and ZIP compression; all layers
+};
+
+// Returns the file extension of `format`, without the dot.
+const char* ImageFormatExtension(ImageFormat format);
+
+// A layer of an image: `channels` (1 to 3) floats per pixel, in top-to-bottom scanline order. In an EXR file,
+// its channels are called <name>.R, <name>.G and <name>.B (or <name>.Y for 1 channel), or R, G, B for the
+// unnamed layer, unless `components` names them with one letter each (e.g. "XYZ" for normal.X, normal.Y, normal.Z).
+struct ImageLayer
+{
+  std::string        name;
+  uint32_t           channels = 3;
+  std::vector<float> pixels;
+  std::string        components;
+};
+
+struct Image
+{
+  std::string             path;
+  ImageFormat             format = ImageFormat::Hdr;
+  uint32_t                width  = 0;
+  uint32_t                height = 0;
+  std::vector<ImageLayer> layers;
+};
+
+// The output stage: writes images on a pool of threads, so that the caller doesn't wait for encoding and disk
+// writes. Images are handed over by ownership (moved), so the caller's readback buffer is free again as soon as
+// it has copied it into an Image. Encoding an image is split into bands of scanlines, which the threads of the
+// pool that aren't busy with other images help with.
+class ImageWriter
+{
+public:
+  // Starts `numThreads` writer threads; 0 means one per core.
+  explicit ImageWriter(uint32_t numThreads = 0);
+  // Waits for all images to be written.
+  ~ImageWriter();
+
+  // Queues `image` to be written, and returns right away.
+  void write(Image image);
+  // Waits until all queued images have been written. Returns false if any of them couldn't be written.
+  bool wait();
+
+private:
+  void enqueue(std::function<void()> task);
+  // Calls body(0), ..., body(count - 1) on this thread and idle threads of the pool, and returns when all are done.
+  void parallelFor(size_t count, const std::function<void(size_t)>& body);
+  bool writeImage(const Image& image);
+  bool writeHdr(const Image& image);
+  bool writeExr(const Image& image);
+
+  std::vector<std::thread>           m_threads;
+  std::mutex                         m_mutex;
+  std::condition_variable            m_changed;
+  std::deque<std::function<void()>>  m_tasks;
+  size_t                             m_busyThreads = 0;
+  bool                               m_stopping    = false;
+  bool                               m_failed      = false;
+};
+
+// Writes a Radiance HDR file (like out.hdr) tile by tile, in any order, without holding the image in memory.
+// The scanlines are stored flat (not run-length encoded), so that every pixel has a fixed position in the file
+// and each tile can be written in place.
+class HdrTileWriter
+{
+public:
+  // Creates the file and writes its header. Returns false if the file can't be created.
+  bool open(const char* path, uint32_t width, uint32_t height);
+  // Writes the `width` x `height` pixels at (x, y) of the image; `rgb` holds 3 floats per pixel, `width` pixels
+  // per row. Returns false if the write failed.
+  bool writeTile(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* rgb);
+  // Closes the file. Returns false if any write failed.
+  bool close();
+
+private:
+  std::ofstream  m_file;
+  std::streamoff m_dataStart = 0;  // Offset of the first pixel in the file
+  uint32_t       m_width     = 0;
+  uint32_t       m_height    = 0;
+};
@@ -0,0 +1,445 @@
+#include "image_metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+static const float pi = 3.14159265358979f;
+
+// Sums term(i) for i in [0, count): within blocks of 4096 terms in 8 float lanes, which compilers keep in vector
+// registers as they are independent sums (a single sum would need -ffast-math to be reordered), and the blocks in
+// double, which keeps the precision of large images.
+template <typename Term>
+static double SumTerms(size_t count, const Term& term)
+{
+  constexpr size_t lanes = 8;
+  constexpr size_t block = 4096;
+  double           total = 0.0;
+  for(size_t blockStart = 0; blockStart < count; blockStart += block)
+  {
+    const size_t blockEnd    = std::min(blockStart + block, count);
+    float        sums[lanes] = {};
+    size_t       i           = blockStart;
+    for(; i + lanes <= blockEnd; i += lanes)
+    {
+      for(size_t lane = 0; lane < lanes; lane++)
+      {
+        sums[lane] += term(i + lane);
+      }
+    }
+    for(; i < blockEnd; i++)
+    {
+      sums[0] += term(i);
+    }
+    for(const float sum : sums)
+    {
+      total += double(sum);
+    }
+  }
+  return total;
+}
+
+double ComputeRmse(const float* a, const float* b, size_t count)
+{
+  const double sumOfSquares = SumTerms(count, [a, b](size_t i) {
+    const float difference = a[i] - b[i];
+    return difference * difference;
+  });
+  return std::sqrt(sumOfSquares / double(std::max<size_t>(count, 1)));
+}
+
+double ComputeRelMse(const float* image, const float* reference, size_t count, float epsilon)
+{
+  const double sum = SumTerms(count, [image, reference, epsilon](size_t i) {
+    const float difference = image[i] - reference[i];
+    return difference * difference / (reference[i] * reference[i] + epsilon);
+  });
+  return sum / double(std::max<size_t>(count, 1));
+}
+
+//-----------------------------------------------------------------------------
+// FLIP
+// The images are split into planes of one channel each, so that each pass reads and writes contiguous floats.
+
+using Plane = std::vector<float>;
+
+// Linear sRGB to CIE XYZ, and back, with the D65 white point
+static const float rgb_to_xyz[3][3] = {{0.4124564f, 0.3575761f, 0.1804375f},
+                                       {0.2126729f, 0.7151522f, 0.0721750f},
+                                       {0.0193339f, 0.1191920f, 0.9503041f}};
+static const float xyz_to_rgb[3][3] = {{3.2404542f, -1.5371385f, -0.4985314f},
+                                       {-0.9692660f, 1.8760108f, 0.0415560f},
+                                       {0.0556434f, -0.2040259f, 1.0572252f}};
+static const float white_xyz[3]     = {0.950428545f, 1.0f, 1.088900371f};
+
+// FLIP's parameters: the exponent of the color error (that of the feature error is 0.5), and the point
+// (pc * maximum error) where the color error map reaches pt
+static const float flip_qc = 0.7f;
+static const float flip_pc = 0.4f;
+static const float flip_pt = 0.95f;
+
+// Cube root of x >= 0 without calls to cbrt, which compilers don't vectorize: an estimate from the exponent
+// bits, refined with Newton's method to a relative error of about 1e-7.
+static inline float CubeRoot(float x)
+{
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  bits = bits / 3 + 709921077u;
+  float y;
+  memcpy(&y, &bits, sizeof(y));
+  // 3 steps, written out so that loops calling this have no inner loop
+  y -= (y * y * y - x) / (3.0f * y * y + 1e-30f);
+  y -= (y * y * y - x) / (3.0f * y * y + 1e-30f);
+  y -= (y * y * y - x) / (3.0f * y * y + 1e-30f);
+  return y;
+}
+
+// Base-2 logarithm of x > 0 without calls to log2, which compilers don't vectorize either: the exponent bits, plus
+// log2 of the mantissa m in [1, 2) from the series of atanh((m - 1) / (m + 1)), to an absolute error of about 6e-6.
+static inline float Log2(float x)
+{
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  const float exponent = float(int32_t(bits >> 23) - 127);
+  bits                 = (bits & 0x007fffffu) | 0x3f800000u;
+  float mantissa;
+  memcpy(&mantissa, &bits, sizeof(mantissa));
+  const float t  = (mantissa - 1.0f) / (mantissa + 1.0f);  // In [0, 1/3)
+  const float t2 = t * t;
+  return exponent + 2.8853901f * t * (1.0f + t2 * (1.0f / 3.0f + t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f + t2 * (1.0f / 9.0f)))));
+}
+
+// 2^x for x in [-126, 126] (clamped to it) without calls to exp2: the integer part of x in the exponent bits, times
+// 2^f for the rest f in (-1, 1) from its Taylor series, to a relative error of about 3e-6.
+static inline float Exp2(float x)
+{
+  x               = std::clamp(x, -126.0f, 126.0f);
+  const int32_t i = int32_t(x);  // Rounds towards 0
+  const float   f = (x - float(i)) * 0.69314718f;
+  const float   p = 1.0f
+                  + f * (1.0f + f * (1.0f / 2.0f + f * (1.0f / 6.0f + f * (1.0f / 24.0f + f * (1.0f / 120.0f + f * (1.0f / 720.0f + f * (1.0f / 5040.0f)))))));
+  const uint32_t bits = uint32_t(i + 127) << 23;
+  float          scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return scale * p;
+}
+
+// x^y for x >= 0 and y >= 0 from Log2 and Exp2, with 0^y = 0 for y > 0 and x^0 = 1 as in std::pow
+static inline float Pow(float x, float y)
+{
+  const float power = Exp2(y * Log2(std::max(x, 1e-30f)));
+  return (y == 0.0f) ? 1.0f : ((x > 0.0f) ? power : 0.0f);
+}
+
+// Converts the linear RGB components r, g, b (clamped to [0, 1]) to CIE L*a*b* with Hunt's adjustment, which
+// scales the chroma with the lightness so that dark colors differ less.
+static inline void RgbToHuntLab(float r, float g, float b, float& l, float& aHunt, float& bHunt)
+{
+  // Cube root above (6/29)^3, linear below
+  const auto f = [](float t) { return (t > 0.008856452f) ? CubeRoot(t) : t * 7.787037f + 4.0f / 29.0f; };
+  r              = std::clamp(r, 0.0f, 1.0f);
+  g              = std::clamp(g, 0.0f, 1.0f);
+  b              = std::clamp(b, 0.0f, 1.0f);
+  const float fx = f((rgb_to_xyz[0][0] * r + rgb_to_xyz[0][1] * g + rgb_to_xyz[0][2] * b) / white_xyz[0]);
+  const float fy = f((rgb_to_xyz[1][0] * r + rgb_to_xyz[1][1] * g + rgb_to_xyz[1][2] * b) / white_xyz[1]);
+  const float fz = f((rgb_to_xyz[2][0] * r + rgb_to_xyz[2][1] * g + rgb_to_xyz[2][2] * b) / white_xyz[2]);
+  l     = 116.0f * fy - 16.0f;
+  aHunt = 0.01f * l * 500.0f * (fx - fy);
+  bHunt = 0.01f * l * 200.0f * (fy - fz);
+}
+
+// The HyAB distance between two Hunt-adjusted L*a*b* colors, raised to flip_qc
+static inline float HyAbError(float l0, float a0, float b0, float l1, float a1, float b1)
+{
+  return Pow(std::abs(l0 - l1) + std::sqrt((a0 - a1) * (a0 - a1) + (b0 - b1) * (b0 - b1)), flip_qc);
+}
+
+// Returns the kernel of 2 * radius + 1 taps of f(x / pixelsPerDegree), x in pixels from the center.
+template <typename Function>
+static std::vector<float> SampleKernel(int radius, float pixelsPerDegree, const Function& f)
+{
+  std::vector<float> kernel(2 * radius + 1);
+  for(int x = -radius; x <= radius; x++)
+  {
+    kernel[x + radius] = f(float(x) / pixelsPerDegree);
+  }
+  return kernel;
+}
+
+// Scales the positive taps of `kernel` to sum to 1, and the negative ones to sum to -1 (or, with
+// `sameScale`, by the same factor as the positive ones).
+static void NormalizeKernel(std::vector<float>& kernel, bool sameScale)
+{
+  float positive = 0.0f;
+  float negative = 0.0f;
+  for(const float weight : kernel)
+  {
+    positive += std::max(weight, 0.0f);
+    negative -= std::min(weight, 0.0f);
+  }
+  for(float& weight : kernel)
+  {
+    weight /= (weight > 0.0f || sameScale || negative == 0.0f) ? positive : negative;
+  }
+}
+
+// Convolves the `width` x `height` plane `in` with `kernelX` along the rows, then with `kernelY` along the
+// columns, into `out`; both kernels have their center in the middle. The image is extended by its edge pixels.
+static void ConvolveSeparable(const Plane& in, uint32_t width, uint32_t height, const std::vector<float>& kernelX,
+                              const std::vector<float>& kernelY, Plane& out)
+{
+  const int radiusX = int(kernelX.size() / 2);
+  const int radiusY = int(kernelY.size() / 2);
+  // Rows: copy each row with its edge pixels repeated, then add one tap at a time to the whole row
+  Plane rows(in.size(), 0.0f);
+  Plane padded(size_t(width) + 2 * radiusX);
+  for(uint32_t y = 0; y < height; y++)
+  {
+    const float* row = in.data() + size_t(y) * width;
+    for(int x = 0; x < int(padded.size()); x++)
+    {
+      padded[x] = row[std::clamp(x - radiusX, 0, int(width) - 1)];
+    }
+    float* outRow = rows.data() + size_t(y) * width;
+    for(size_t tap = 0; tap < kernelX.size(); tap++)
+    {
+      const float  weight = kernelX[tap];
+      const float* source = padded.data() + tap;
+      for(uint32_t x = 0; x < width; x++)
+      {
+        outRow[x] += weight * source[x];
+      }
+    }
+  }
+  // Columns: add one tap, which is a whole row of `rows`, at a time
+  out.assign(in.size(), 0.0f);
+  for(uint32_t y = 0; y < height; y++)
+  {
+    float* outRow = out.data() + size_t(y) * width;
+    for(size_t tap = 0; tap < kernelY.size(); tap++)
+    {
+      const int    sourceY = std::clamp(int(y) + int(tap) - radiusY, 0, int(height) - 1);
+      const float  weight  = kernelY[tap];
+      const float* source  = rows.data() + size_t(sourceY) * width;
+      for(uint32_t x = 0; x < width; x++)
+      {
+        outRow[x] += weight * source[x];
+      }
+    }
+  }
+}
+
+// The filters of FLIP for a given number of pixels per degree.
+struct FlipKernels
+{
+  // The contrast sensitivity functions of the opponent channels Y, Cx and Cz, each a weighted sum of normalized
+  // Gaussians: channel c is filtered with sum over i of csfWeights[c][i] * csf[c][i] (x) csf[c][i].
+  std::array<std::array<std::vector<float>, 2>, 3> csf;
+  std::array<std::array<float, 2>, 3>              csfWeights;
+  // The first and second derivatives of a Gaussian, and the Gaussian, that detect edges and points
+  std::vector<float> gaussian;
+  std::vector<float> edge;
+  std::vector<float> point;
+};
+
+static FlipKernels MakeFlipKernels(float pixelsPerDegree)
+{
+  // Each CSF is a1 * sqrt(pi / b1) * exp(-pi^2 r^2 / b1) + a2 * sqrt(pi / b2) * exp(-pi^2 r^2 / b2), r in degrees
+  static const float csf_parameters[3][4] = {{1.0f, 0.0047f, 0.0f, 1e-5f},  // a1, b1, a2, b2
+                                             {1.0f, 0.0053f, 0.0f, 1e-5f},
+                                             {34.1f, 0.04f, 13.5f, 0.025f}};
+  const int             csfRadius         = int(std::ceil(3.0f * std::sqrt(0.04f / (2.0f * pi * pi)) * pixelsPerDegree));
+
+  FlipKernels kernels;
+  for(int channel = 0; channel < 3; channel++)
+  {
+    float totalWeight = 0.0f;
+    for(int term = 0; term < 2; term++)
+    {
+      const float a = csf_parameters[channel][2 * term];
+      const float b = csf_parameters[channel][2 * term + 1];
+      std::vector<float>& kernel = kernels.csf[channel][term];
+      kernel = SampleKernel(csfRadius, pixelsPerDegree, [b](float x) { return std::exp(-pi * pi * x * x / b); });
+      // Normalizing the 1D kernel scales the 2D one by the square of its sum
+      float sum = 0.0f;
+      for(const float weight : kernel)
+      {
+        sum += weight;
+      }
+      NormalizeKernel(kernel, true);
+      kernels.csfWeights[channel][term] = a * std::sqrt(pi / b) * sum * sum;
+      totalWeight += kernels.csfWeights[channel][term];
+    }
+    for(float& weight : kernels.csfWeights[channel])
+    {
+      weight /= totalWeight;
+    }
+  }
+
+  const float sigma         = 0.5f * 0.082f * pixelsPerDegree;  // In pixels
+  const int   featureRadius = int(std::ceil(3.0f * sigma));
+  const auto  gaussian      = [sigma](float x) { return std::exp(-x * x / (2.0f * sigma * sigma)); };
+  kernels.gaussian          = SampleKernel(featureRadius, 1.0f, gaussian);
+  kernels.edge  = SampleKernel(featureRadius, 1.0f, [&](float x) { return -x * gaussian(x); });
+  kernels.point = SampleKernel(featureRadius, 1.0f, [&](float x) { return (x * x / (sigma * sigma) - 1.0f) * gaussian(x); });
+  NormalizeKernel(kernels.gaussian, true);
+  NormalizeKernel(kernels.edge, true);
+  NormalizeKernel(kernels.point, false);
+  return kernels;
+}
+
+// What FLIP compares of each image: the CSF-filtered colors in Hunt-adjusted L*a*b*, and the magnitudes of the
+// edge and point detectors on the luminance.
+struct FlipImage
+{
+  std::array<Plane, 3> lab;
+  Plane                edges;
+  Plane                points;
+};
+
+static FlipImage PrepareFlipImage(const float* rgb, uint32_t width, uint32_t height, const FlipKernels& kernels)
+{
+  const size_t count = size_t(width) * height;
+
+  // To the opponent color space YCxCz, where the CSFs apply. (The loops read and write through pointers rather than
+  // the vectors, whose data pointers compilers would otherwise reload after each store.)
+  std::array<Plane, 3> ycxcz;
+  for(Plane& plane : ycxcz)
+  {
+    plane.resize(count);
+  }
+  Plane  luminance(count);
+  float* channel0 = ycxcz[0].data();
+  float* channel1 = ycxcz[1].data();
+  float* channel2 = ycxcz[2].data();
+  for(size_t i = 0; i < count; i++)
+  {
+    const float r = std::clamp(rgb[3 * i + 0], 0.0f, 1.0f);
+    const float g = std::clamp(rgb[3 * i + 1], 0.0f, 1.0f);
+    const float b = std::clamp(rgb[3 * i + 2], 0.0f, 1.0f);
+    const float x = (rgb_to_xyz[0][0] * r + rgb_to_xyz[0][1] * g + rgb_to_xyz[0][2] * b) / white_xyz[0];
+    const float y = (rgb_to_xyz[1][0] * r + rgb_to_xyz[1][1] * g + rgb_to_xyz[1][2] * b) / white_xyz[1];
+    const float z = (rgb_to_xyz[2][0] * r + rgb_to_xyz[2][1] * g + rgb_to_xyz[2][2] * b) / white_xyz[2];
+    channel0[i]   = 116.0f * y - 16.0f;
+    channel1[i]   = 500.0f * (x - y);
+    channel2[i]   = 200.0f * (y - z);
+    luminance[i]  = y;
+  }
+
+  // Filter each channel with its CSF
+  Plane filtered;
+  Plane term;
+  for(int channel = 0; channel < 3; channel++)
+  {
+    filtered.assign(count, 0.0f);
+    for(int i = 0; i < 2; i++)
+    {
+      const float weight = kernels.csfWeights[channel][i];
+      if(weight == 0.0f)
+      {
+        continue;
+      }
+      ConvolveSeparable(ycxcz[channel], width, height, kernels.csf[channel][i], kernels.csf[channel][i], term);
+      for(size_t p = 0; p < count; p++)
+      {
+        filtered[p] += weight * term[p];
+      }
+    }
+    ycxcz[channel].swap(filtered);
+  }
+
+  // Back to linear RGB, then to L*a*b*, in place (with separate outputs, the compiler would need more run-time
+  // checks that the planes don't overlap than it is willing to vectorize the loop with)
+  channel0 = ycxcz[0].data();
+  channel1 = ycxcz[1].data();
+  channel2 = ycxcz[2].data();
+  for(size_t i = 0; i < count; i++)
+  {
+    const float y = (channel0[i] + 16.0f) / 116.0f;
+    const float x = (channel1[i] / 500.0f + y) * white_xyz[0];
+    const float z = (y - channel2[i] / 200.0f) * white_xyz[2];
+    const float r = xyz_to_rgb[0][0] * x + xyz_to_rgb[0][1] * y + xyz_to_rgb[0][2] * z;
+    const float g = xyz_to_rgb[1][0] * x + xyz_to_rgb[1][1] * y + xyz_to_rgb[1][2] * z;
+    const float b = xyz_to_rgb[2][0] * x + xyz_to_rgb[2][1] * y + xyz_to_rgb[2][2] * z;
+    float       l, aHunt, bHunt;
+    RgbToHuntLab(r, g, b, l, aHunt, bHunt);
+    channel0[i] = l;
+    channel1[i] = aHunt;
+    channel2[i] = bHunt;
+  }
+  FlipImage image;
+  image.lab = std::move(ycxcz);
+
+  // Edges and points of the unfiltered luminance: the gradient magnitude of the derivative filters
+  Plane alongX;
+  Plane alongY;
+  ConvolveSeparable(luminance, width, height, kernels.edge, kernels.gaussian, alongX);
+  ConvolveSeparable(luminance, width, height, kernels.gaussian, kernels.edge, alongY);
+  image.edges.resize(count);
+  for(size_t i = 0; i < count; i++)
+  {
+    image.edges[i] = std::sqrt(alongX[i] * alongX[i] + alongY[i] * alongY[i]);
+  }
+  ConvolveSeparable(luminance, width, height, kernels.point, kernels.gaussian, alongX);
+  ConvolveSeparable(luminance, width, height, kernels.gaussian, kernels.point, alongY);
+  image.points.resize(count);
+  for(size_t i = 0; i < count; i++)
+  {
+    image.points[i] = std::sqrt(alongX[i] * alongX[i] + alongY[i] * alongY[i]);
+  }
+  return image;
+}
+
+double ComputeFlip(const float* image, const float* reference, uint32_t width, uint32_t height, float pixelsPerDegree)
+{
+  const size_t count = size_t(width) * height;
+  if(count == 0)
+  {
+    return 0.0;
+  }
+  const FlipKernels kernels = MakeFlipKernels(pixelsPerDegree);
+  const FlipImage   test    = PrepareFlipImage(image, width, height, kernels);
+  const FlipImage   ref     = PrepareFlipImage(reference, width, height, kernels);
+
+  // The largest color error is the one between pure green and pure blue
+  float green[3];
+  float blue[3];
+  RgbToHuntLab(0.0f, 1.0f, 0.0f, green[0], green[1], green[2]);
+  RgbToHuntLab(0.0f, 0.0f, 1.0f, blue[0], blue[1], blue[2]);
+  const float maxError  = HyAbError(green[0], green[1], green[2], blue[0], blue[1], blue[2]);
+  const float threshold = flip_pc * maxError;
+
+  const float* testL = test.lab[0].data();
+  const float* testA = test.lab[1].data();
+  const float* testB = test.lab[2].data();
+  const float* refL  = ref.lab[0].data();
+  const float* refA  = ref.lab[1].data();
+  const float* refB  = ref.lab[2].data();
+  const float* testEdges  = test.edges.data();
+  const float* testPoints = test.points.data();
+  const float* refEdges   = ref.edges.data();
+  const float* refPoints  = ref.points.data();
+  const double sum = SumTerms(count, [&](size_t i) {
+    // The color error, compressed above the threshold so that large errors don't dominate the map
+    const float colorError = HyAbError(testL[i], testA[i], testB[i], refL[i], refA[i], refB[i]);
+    const float mapped     = (colorError < threshold) ? colorError * (flip_pt / threshold)
+                                                      : flip_pt + (colorError - threshold) / (maxError - threshold) * (1.0f - flip_pt);
+    const float featureDifference = std::max(std::abs(testEdges[i] - refEdges[i]), std::abs(testPoints[i] - refPoints[i]));
+    const float featureError      = std::sqrt(featureDifference / std::sqrt(2.0f));  // flip_qf = 0.5
+    return Pow(std::min(mapped, 1.0f), 1.0f - featureError);
+  });
+  return sum / double(count);
+}
+
+ImageErrors ComputeImageErrors(const float* image, const float* reference, uint32_t width, uint32_t height)
+{
+  const size_t count = size_t(width) * height * 3;
+  ImageErrors  errors;
+  errors.rmse   = ComputeRmse(image, reference, count);
+  errors.relMse = ComputeRelMse(image, reference, count);
+  errors.flip   = ComputeFlip(image, reference, width, height);
+  return errors;
+}
@@ -0,0 +1,32 @@
+// Error metrics of a rendered image against a reference, for the quality gate and the convergence benchmarks.
+// Images are 3 floats of linear RGB per pixel, in scanline order, like `buffer` in main.cpp.
+// Every pass is a loop without branches over contiguous floats, with sums kept in several independent lanes, so
+// that compilers vectorize them (see SumTerms and Pow in image_metrics.cpp, and the flags CMakeLists.txt compiles it with).
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Returns the root mean square difference between the `count` floats of `a` and `b`.
+double ComputeRmse(const float* a, const float* b, size_t count);
+
+// Returns the relative mean squared error of the `count` floats of `image` against `reference`: the mean of
+// (image - reference)^2 / (reference^2 + epsilon). Unlike the RMSE, it weighs errors in dark and bright regions
+// alike; `epsilon` keeps black pixels from dominating it.
+double ComputeRelMse(const float* image, const float* reference, size_t count, float epsilon = 0.01f);
+
+// Returns the mean of a FLIP-style perceptual error map of `image` against `reference` (Andersson et al. 2020),
+// from 0 (identical) to 1: the colors, filtered by contrast sensitivity functions for a display seen at
+// `pixelsPerDegree` pixels per degree, are compared in a Hunt-adjusted L*a*b* space with the HyAB distance,
+// and the color error grows where the edges and points of the luminance differ. Both images are clamped to
+// [0, 1] first, as LDR-FLIP expects; HDR-FLIP's exposure bracketing isn't done.
+double ComputeFlip(const float* image, const float* reference, uint32_t width, uint32_t height, float pixelsPerDegree = 67.0f);
+
+// All of the above, for one image.
+struct ImageErrors
+{
+  double rmse   = 0.0;
+  double relMse = 0.0;
+  double flip   = 0.0;
+};
+ImageErrors ComputeImageErrors(const float* image, const float* reference, uint32_t width, uint32_t height);
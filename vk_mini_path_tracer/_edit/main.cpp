@@ -1,5 +1,21 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -28,14 +44,29 @@ The color at any given pixel therefore indicates exactly where on the triangle t
 #include <nvvk/resourceallocator_vk.hpp>  // For NVVK memory allocators
 #include <nvvk/shaders_vk.hpp>            // For nvvk::createShaderModule
 
+#include "common.h"  // Constants shared with the shaders
+#include "mesh.hpp"  // For Mesh and the mesh preprocessing passes
+#include "sampling.hpp"  // For the tiles of adaptive sampling
+#include "image_io.hpp"  // For writing the image and AOVs
+#include "distributed.hpp"  // For rendering a frame with several processes
+#include "cpu_renderer.hpp"  // For rendering tiles on the CPU next to the GPU
+#include "camera.hpp"  // For the cameras of multi-view rendering
+#include "checkpoint.hpp"  // For continuing long renders from checkpoints
+#include "procedural.hpp"  // For the generated scenes and instance layouts of --scene and --instances, and the mesh cache settings
+#include "benchmark.hpp"  // For the end-to-end benchmark and its suite
+#include "image_metrics.hpp"  // For the error metrics of the quality gate and the sampler and denoiser benchmarks
 
 
 
 
 static const uint64_t render_width     = 800;
 static const uint64_t render_height    = 600;
-static const uint32_t workgroup_width  = 16;
-static const uint32_t workgroup_height = 8;
+static const uint32_t workgroup_width  = WORKGROUP_WIDTH;
+static const uint32_t workgroup_height = WORKGROUP_HEIGHT;
+static const uint32_t adaptive_batch_samples = 8;  // Samples per pixel that each adaptive sampling dispatch adds
+static const uint32_t max_batch_samples      = 64;  // Most samples per pixel of one dispatch when rendering whole tiles
+static const uint32_t min_split_samples      = 4;  // Sample-parallel rendering: fewest samples per pixel of each invocation
+static const double   hybrid_chunk_seconds   = 0.02;  // Hybrid rendering: the GPU and each CPU thread take chunks of tiles of about this long
 
 
 
@@ -84,8 +115,2793 @@ VkDeviceAddress GetBufferDeviceAddress(VkDevice device, VkBuffer buffer)
 
 
 
+// Values of the specialization constants of raytrace.comp.glsl, indexed by the SPEC_* constant IDs in common.h
+using SpecConstants = std::array<uint32_t, SPEC_CONSTANT_COUNT>;
+
+// Creates a compute pipeline for the "main" entry point of `module`, with optional specialization constants.
+VkPipeline CreateComputePipeline(VkDevice device, VkShaderModule module, VkPipelineLayout layout, const VkSpecializationInfo* specInfo = nullptr)
+{
+    // Describes the entrypoint and the stage to use for this shader module in the pipeline
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                          .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                                                          .module = module,
+                                                          .pName = "main",
+                                                          .pSpecializationInfo = specInfo };
+
+    // Create the compute pipeline
+    VkComputePipelineCreateInfo pipelineCreateInfo{ .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                                                   .stage = shaderStageCreateInfo,
+                                                   .layout = layout };
+    // Don't modify flags, basePipelineHandle, or basePipelineIndex
+    VkPipeline pipeline;
+    NVVK_CHECK(vkCreateComputePipelines(device,                  // Device
+                                        VK_NULL_HANDLE,          // Pipeline cache (uses default)
+                                        1, &pipelineCreateInfo,  // Compute pipeline create info
+                                        nullptr,                 // Allocator (uses default)
+                                        &pipeline));             // Output
+    return pipeline;
+}
+
+// Creates a compute pipeline for raytrace.comp.glsl, with the given specialization constants.
+VkPipeline CreateComputePipeline(VkDevice device, VkShaderModule module, VkPipelineLayout layout, const SpecConstants& specConstants)
+{
+    // Each specialization constant is a 32-bit value; constant i is stored at offset 4*i:
+    std::array<VkSpecializationMapEntry, SPEC_CONSTANT_COUNT> mapEntries;
+    for (uint32_t i = 0; i < SPEC_CONSTANT_COUNT; i++)
+    {
+        mapEntries[i] = { .constantID = i, .offset = i * uint32_t(sizeof(uint32_t)), .size = sizeof(uint32_t) };
+    }
+    VkSpecializationInfo specInfo{ .mapEntryCount = SPEC_CONSTANT_COUNT,
+                                  .pMapEntries = mapEntries.data(),
+                                  .dataSize = sizeof(SpecConstants),
+                                  .pData = specConstants.data() };
+    return CreateComputePipeline(device, module, layout, &specInfo);
+}
+
+
+
+
+
+// Returns the number of milliseconds between timestamp `first` and timestamp `first + 1` of `queryPool`.
+// `timestampPeriod` is VkPhysicalDeviceLimits::timestampPeriod, the number of nanoseconds per timestamp tick.
+double GetElapsedMilliseconds(VkDevice device, VkQueryPool queryPool, uint32_t first, float timestampPeriod)
+{
+    std::array<uint64_t, 2> timestamps{};
+    NVVK_CHECK(vkGetQueryPoolResults(device, queryPool, first, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                                     VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    return double(timestamps[1] - timestamps[0]) * double(timestampPeriod) * 1e-6;
+}
+
+
+
+
+
+// Records a dispatch of `groupCountX` x `groupCountY` x `groupCountZ` workgroups of `pipeline` with the given push
+// constants, submits it, waits for it to finish, and returns how long the dispatch took on the GPU, in milliseconds.
+double DispatchAndTime(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                       VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod,
+                       const PushConstants& pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ = 1)
+{
+    // Create and start recording a command buffer
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+
+    // Bind the compute shader pipeline and the descriptor set
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+    // Run the compute shader between two timestamps:
+    vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    vkCmdDispatch(cmdBuffer, groupCountX, groupCountY, groupCountZ);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+    // Memory Barrier
+    // Add a command that says "Make it so that memory writes by the compute shader
+    // are available to read from the CPU." (In other words, "Flush the GPU caches
+    // so the CPU can read the data.") To do this, we use a memory barrier.
+    // This is one of the most complex parts of Vulkan, so don't worry if this is
+    // confusing! We'll talk about pipeline barriers more in the extras.
+    VkMemoryBarrier memoryBarrier{.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                  .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,  // Make shader writes
+                                  .dstAccessMask = VK_ACCESS_HOST_READ_BIT};    // Readable by the CPU
+    vkCmdPipelineBarrier(cmdBuffer,                                             // The command buffer
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,                  // From the compute shader
+                         VK_PIPELINE_STAGE_HOST_BIT,                            // To the CPU
+                         0,                                                     // No special flags
+                         1, &memoryBarrier,                                     // An array of memory barriers
+                         0, nullptr, 0, nullptr);                               // No other barriers
+
+    // End and submit the command buffer, then wait for it to finish:
+    EndSubmitWaitAndFreeCommandBuffer(device, queue, cmdPool, cmdBuffer);
+    return GetElapsedMilliseconds(device, queryPool, 0, timestampPeriod);
+}
+
+// Returns the push constants for rendering the whole render_width x render_height image as one tile.
+PushConstants WholeImagePushConstants()
+{
+    return PushConstants{ .imageWidth = uint32_t(render_width),
+                          .imageHeight = uint32_t(render_height),
+                          .tileOffsetX = 0,
+                          .tileOffsetY = 0,
+                          .tileWidth = uint32_t(render_width),
+                          .tileHeight = uint32_t(render_height),
+                          .outputOffset = 0 };
+}
+
+// Same as above, for a dispatch with enough workgroups to cover the entire buffer.
+double DispatchAndTime(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                       VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod)
+{
+    return DispatchAndTime(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod, WholeImagePushConstants(),
+                           (uint32_t(render_width) + workgroup_width - 1) / workgroup_width,
+                           (uint32_t(render_height) + workgroup_height - 1) / workgroup_height);
+}
+
+// Records `count` dispatches of `pipeline` in one command buffer without barriers between them, so that the GPU can
+// start each dispatch while the last workgroups of the previous one still run, and returns the average GPU time per
+// dispatch, in milliseconds. Dispatch i uses work counter i % WORK_COUNTER_COUNT. The dispatches write the same
+// pixels concurrently, so the image is only good for timing.
+double DispatchBackToBackAndTime(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                                 VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod, PushConstants pushConstants,
+                                 uint32_t groupCountX, uint32_t groupCountY, uint32_t count)
+{
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pushConstants.workCounter = i % WORK_COUNTER_COUNT;
+        vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+        vkCmdDispatch(cmdBuffer, groupCountX, groupCountY, 1);
+    }
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    VkMemoryBarrier memoryBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                  .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                  .dstAccessMask = VK_ACCESS_HOST_READ_BIT };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    EndSubmitWaitAndFreeCommandBuffer(device, queue, cmdPool, cmdBuffer);
+    return GetElapsedMilliseconds(device, queryPool, 0, timestampPeriod) / count;
+}
+
+// Returns the number of workgroups of a persistent-threads dispatch: enough to fill the GPU, i.e. the number of
+// SMs times the workgroups each SM can hold. Only NVIDIA GPUs report their SMs (VK_NV_shader_sm_builtins); elsewhere,
+// this assumes a large GPU. Register use lowers the real occupancy, but extra workgroups only start later.
+uint32_t DefaultPersistentWorkgroups(VkPhysicalDevice physicalDevice)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+    const bool hasSmBuiltins = std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties& extension) {
+        return strcmp(extension.extensionName, VK_NV_SHADER_SM_BUILTINS_EXTENSION_NAME) == 0;
+    });
+    if (!hasSmBuiltins)
+    {
+        return 512;
+    }
+    VkPhysicalDeviceShaderSMBuiltinsPropertiesNV smProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_SM_BUILTINS_PROPERTIES_NV };
+    VkPhysicalDeviceProperties2 properties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &smProperties };
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+    const uint32_t warpsPerWorkgroup = (workgroup_width * workgroup_height + 31) / 32;
+    return smProperties.shaderSMCount * std::max(1u, smProperties.shaderWarpsPerSM / warpsPerWorkgroup);
+}
+
+// Returns the SPEC_SAMPLE_SPLIT for dispatches of `pixels` pixels with `samplesPerPixel` samples each: the smallest
+// power of 2 that gives the GPU's `concurrentInvocations` something to run, as long as each invocation keeps at least
+// min_split_samples samples. Large images get 1, as one invocation per pixel already fills the GPU.
+uint32_t ChooseSampleSplit(uint64_t pixels, uint32_t samplesPerPixel, uint64_t concurrentInvocations)
+{
+    uint32_t split = 1;
+    while (split < MAX_SAMPLE_SPLIT && pixels * split < concurrentInvocations && samplesPerPixel / (2 * split) >= min_split_samples)
+    {
+        split *= 2;
+    }
+    return split;
+}
+
+
+
+
+
+// Renders `sampleCount` samples per pixel of sample indices `firstSample` onwards into `tiles`, with `pipeline`
+// (which must use ADAPTIVE_SAMPLING), in batches of at most max_batch_samples. `activeTilesData` is the mapped
+// BINDING_ACTIVE_TILES buffer. Returns the GPU time of all dispatches, in milliseconds.
+double RenderTiles(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                   VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod, uint32_t* activeTilesData,
+                   const std::vector<uint32_t>& tiles, uint32_t firstSample, uint32_t sampleCount)
+{
+    memcpy(activeTilesData, tiles.data(), tiles.size() * sizeof(uint32_t));
+    double totalMs = 0.0;
+    for (uint32_t done = 0; done < sampleCount; done += max_batch_samples)
+    {
+        PushConstants pushConstants = WholeImagePushConstants();
+        pushConstants.firstSample = firstSample + done;
+        pushConstants.sampleCount = std::min(max_batch_samples, sampleCount - done);
+        pushConstants.accumulatedSamples = done;
+        totalMs += DispatchAndTime(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod,
+                                   pushConstants, uint32_t(tiles.size()), 1);
+    }
+    return totalMs;
+}
+
+// Same as above, for all tiles of the image.
+double RenderAllTiles(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                      VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod, uint32_t* activeTilesData,
+                      const TileGrid& tileGrid, uint32_t firstSample, uint32_t sampleCount)
+{
+    return RenderTiles(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod, activeTilesData,
+                       AllTiles(tileGrid), firstSample, sampleCount);
+}
+
+
+
+
+
+// What RenderWithinBudget rendered.
+struct BudgetRender
+{
+    uint32_t sampleCount = 0;  // Samples per pixel
+    uint32_t numBatches = 0;
+    double   gpuMs = 0.0;      // GPU time of all batches
+    double   wallMs = 0.0;     // From the start of the first batch to the end of the last one
+};
+
+// Time-budgeted rendering: adds batches of samples to the `tileCount` tiles in BINDING_ACTIVE_TILES with `pipeline`
+// (which must use ADAPTIVE_SAMPLING), in `groupCount` x 1 x `groupCountZ` workgroups per batch, each batch as large as
+// the measured cost of the batches so far predicts to still end within `budgetMs` (see SampleBudget), up to
+// `maxSamples` samples per pixel. The shader writes the average of all samples so far after each batch, so the image
+// is always the best one available.
+BudgetRender RenderWithinBudget(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                                VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod, uint32_t tileCount,
+                                uint32_t groupCount, uint32_t groupCountZ, double budgetMs, uint32_t maxSamples)
+{
+    SampleBudget budget{ .budgetMs = budgetMs };
+    BudgetRender render;
+    const auto   budgetStart = std::chrono::steady_clock::now();
+    const auto   elapsedMs = [&]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - budgetStart).count();
+    };
+    while (render.sampleCount < maxSamples)
+    {
+        const double   batchStartMs = elapsedMs();
+        const uint32_t batchSamples = std::min(budget.nextBatch(batchStartMs, max_batch_samples), maxSamples - render.sampleCount);
+        if (batchSamples == 0)
+        {
+            break;
+        }
+        PushConstants pushConstants = WholeImagePushConstants();
+        pushConstants.firstSample = render.sampleCount;
+        pushConstants.sampleCount = batchSamples;
+        pushConstants.accumulatedSamples = render.sampleCount;
+        pushConstants.activeTileCount = tileCount;
+        const double batchMs = DispatchAndTime(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod,
+                                               pushConstants, groupCount, 1, groupCountZ);
+        budget.add(batchSamples, batchMs, elapsedMs() - batchStartMs);
+        render.gpuMs += batchMs;
+        render.sampleCount += batchSamples;
+        render.numBatches++;
+    }
+    render.wallMs = elapsedMs();
+    return render;
+}
+
+// Quality gate: renders the `tiles` within each of `budgetsMs` with `pipeline`, as RenderWithinBudget does (with the
+// same arguments), and returns the errors of each image in the host-visible `imageBuffer` against `reference` (see
+// ComputeImageErrors). `postProcess`, if any (e.g. the denoiser), runs after each render, and its wall time is taken
+// out of each budget; it is measured once, after a warm-up render of 1 spp dispatched like the others, so that the
+// first budget doesn't pay for the pipeline's first dispatch either. `activeTilesData` is the mapped
+// BINDING_ACTIVE_TILES buffer.
+std::vector<QualityResult> RenderQualityBudgets(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline,
+                                                VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, VkQueryPool queryPool,
+                                                float timestampPeriod, uint32_t* activeTilesData, const std::vector<uint32_t>& tiles,
+                                                uint32_t groupCount, uint32_t groupCountZ, const std::vector<float>& budgetsMs,
+                                                uint32_t maxSamples, nvvk::ResourceAllocatorDedicated& allocator,
+                                                const nvvk::Buffer& imageBuffer, const std::vector<float>& reference, uint32_t width,
+                                                uint32_t height, const std::function<void()>& postProcess)
+{
+    memcpy(activeTilesData, tiles.data(), tiles.size() * sizeof(uint32_t));
+    const auto render = [&](double budgetMs, uint32_t samples) {
+        return RenderWithinBudget(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod,
+                                  uint32_t(tiles.size()), groupCount, groupCountZ, budgetMs, samples);
+    };
+    render(0.0, 1);  // Warm-up
+    double postProcessMs = 0.0;
+    if (postProcess)
+    {
+        const auto postProcessStart = std::chrono::steady_clock::now();
+        postProcess();
+        postProcessMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - postProcessStart).count();
+    }
+
+    std::vector<QualityResult> results;
+    printf("%10s %8s %12s %12s %10s\n", "budget ms", "spp", "rmse", "relmse", "flip");
+    for (const float budgetMs : budgetsMs)
+    {
+        const BudgetRender budgetRender = render(std::max(double(budgetMs) - postProcessMs, 1.0), maxSamples);
+        if (postProcess)
+        {
+            postProcess();
+        }
+        const float*      image = reinterpret_cast<const float*>(allocator.map(imageBuffer));
+        const ImageErrors errors = ComputeImageErrors(image, reference.data(), width, height);
+        allocator.unmap(imageBuffer);
+        results.push_back(QualityResult{
+            .budgetMs = budgetMs, .spp = budgetRender.sampleCount, .rmse = errors.rmse, .relMse = errors.relMse, .flip = errors.flip });
+        printf("%10.1f %8u %12.6f %12.6f %10.6f\n", budgetMs, budgetRender.sampleCount, errors.rmse, errors.relMse, errors.flip);
+    }
+    return results;
+}
+
+
+
+
+
+// Convergence snapshots: renders samples [0, `maxSamples`) of the `tileCount` tiles in BINDING_ACTIVE_TILES with
+// `pipeline` (which must use ADAPTIVE_SAMPLING, and write the image to `imageBuffer`), in `groupCount` x 1 x
+// `groupCountZ` workgroups per batch. Each time the pixels reach a checkpoint of 1, 2, 4, ... spp (and `maxSamples`),
+// the image is copied to the next `imageBytes` slot of the host-visible `snapshotBuffer`. Each checkpoint is one
+// submission, all submitted up front, so the GPU never waits for the CPU; `onSnapshot(checkpoint, spp, gpuMs)` is
+// called as each one finishes, in order, with the GPU time of all batches so far, while the next ones render.
+// Returns the number of checkpoints.
+uint32_t RenderSnapshots(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                         VkDescriptorSet descriptorSet, float timestampPeriod, uint32_t tileCount, uint32_t groupCount, uint32_t groupCountZ,
+                         VkBuffer imageBuffer, VkDeviceSize imageBytes, VkBuffer snapshotBuffer, uint32_t maxSamples,
+                         const std::function<void(uint32_t, uint32_t, double)>& onSnapshot)
+{
+    std::vector<uint32_t> checkpoints;
+    for (uint32_t spp = 1; spp < maxSamples; spp *= 2)
+    {
+        checkpoints.push_back(spp);
+    }
+    checkpoints.push_back(maxSamples);
+
+    // Two timestamps per checkpoint, around its batches
+    const VkQueryPoolCreateInfo queryPoolInfo{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                               .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                               .queryCount = 2 * uint32_t(checkpoints.size()) };
+    VkQueryPool queryPool;
+    NVVK_CHECK(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+    std::vector<VkCommandBuffer> cmdBuffers(checkpoints.size());
+    std::vector<VkFence>         fences(checkpoints.size());
+    uint32_t                     sampleCount = 0;
+    for (size_t i = 0; i < checkpoints.size(); i++)
+    {
+        VkCommandBuffer& cmdBuffer = cmdBuffers[i];
+        cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+        vkCmdResetQueryPool(cmdBuffer, queryPool, 2 * uint32_t(i), 2);
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        // Each batch adds to the sums of the last one, and overwrites the image that the last copy read
+        const VkMemoryBarrier batchBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT };
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &batchBarrier, 0, nullptr, 0, nullptr);
+        vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 2 * uint32_t(i));
+        while (sampleCount < checkpoints[i])
+        {
+            PushConstants pushConstants = WholeImagePushConstants();
+            pushConstants.firstSample = sampleCount;
+            pushConstants.sampleCount = std::min(max_batch_samples, checkpoints[i] - sampleCount);
+            pushConstants.accumulatedSamples = sampleCount;
+            pushConstants.activeTileCount = tileCount;
+            if (sampleCount > 0)
+            {
+                vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &batchBarrier,
+                                     0, nullptr, 0, nullptr);
+            }
+            vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+            vkCmdDispatch(cmdBuffer, groupCount, 1, groupCountZ);
+            sampleCount += pushConstants.sampleCount;
+        }
+        vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * uint32_t(i) + 1);
+
+        // Copy the image to the checkpoint's slot, and make the copy readable by the CPU
+        const VkMemoryBarrier copyBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                           .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                           .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT };
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+        const VkBufferCopy region{ .srcOffset = 0, .dstOffset = i * imageBytes, .size = imageBytes };
+        vkCmdCopyBuffer(cmdBuffer, imageBuffer, snapshotBuffer, 1, &region);
+        const VkMemoryBarrier hostBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                           .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                           .dstAccessMask = VK_ACCESS_HOST_READ_BIT };
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                             &hostBarrier, 0, nullptr, 0, nullptr);
+        NVVK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+        VkFenceCreateInfo fenceInfo{ .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        NVVK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &fences[i]));
+        VkSubmitInfo submitInfo{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &cmdBuffer };
+        NVVK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fences[i]));
+    }
+
+    double gpuMs = 0.0;
+    for (size_t i = 0; i < checkpoints.size(); i++)
+    {
+        NVVK_CHECK(vkWaitForFences(device, 1, &fences[i], VK_TRUE, UINT64_MAX));
+        gpuMs += GetElapsedMilliseconds(device, queryPool, 2 * uint32_t(i), timestampPeriod);
+        onSnapshot(uint32_t(i), checkpoints[i], gpuMs);
+        vkDestroyFence(device, fences[i], nullptr);
+        vkFreeCommandBuffers(device, cmdPool, 1, &cmdBuffers[i]);
+    }
+    vkDestroyQueryPool(device, queryPool, nullptr);
+    return uint32_t(checkpoints.size());
+}
+
+
+
+
+
+// Renders a `width` x `height` image in tiles of at most `tileSize` x `tileSize` pixels, and streams them to the Radiance
+// HDR file `path`. Up to `ringSlots` tiles are in flight at once: tile i renders into slot i % ringSlots of the image
+// buffer (`ringData` is its mapping), and the CPU writes a tile to the file while the GPU renders the next ones.
+// So memory use depends on the tile size and ring size, but not on the image size. `sampleSplit` is the
+// SPEC_SAMPLE_SPLIT of `pipeline`. Returns false if writing failed.
+bool RenderTiled(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                 VkDescriptorSet descriptorSet, const float* ringData, uint32_t width, uint32_t height, uint32_t tileSize,
+                 uint32_t ringSlots, uint32_t sampleSplit, const char* path)
+{
+    HdrTileWriter writer;
+    if (!writer.open(path, width, height))
+    {
+        return false;
+    }
+
+    // A slot of the ring: the tile it holds, and the command buffer and fence of the dispatch that renders it
+    struct Slot
+    {
+        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;  // VK_NULL_HANDLE if the slot is free
+        VkFence         fence = VK_NULL_HANDLE;
+        PushConstants   tile{};
+    };
+    std::vector<Slot> slots(ringSlots);
+    for (Slot& slot : slots)
+    {
+        VkFenceCreateInfo fenceInfo{ .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        NVVK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &slot.fence));
+    }
+
+    // Waits for the tile in `slot` to finish rendering, then writes it to the file.
+    bool ok = true;
+    const auto finishSlot = [&](Slot& slot) {
+        if (slot.cmdBuffer == VK_NULL_HANDLE)
+        {
+            return;
+        }
+        NVVK_CHECK(vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+        NVVK_CHECK(vkResetFences(device, 1, &slot.fence));
+        vkFreeCommandBuffers(device, cmdPool, 1, &slot.cmdBuffer);
+        slot.cmdBuffer = VK_NULL_HANDLE;
+        ok = ok && writer.writeTile(slot.tile.tileOffsetX, slot.tile.tileOffsetY, slot.tile.tileWidth, slot.tile.tileHeight,
+                                    ringData + 3 * size_t(slot.tile.outputOffset));
+    };
+
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    for (uint32_t tileIndex = 0; tileIndex < tilesX * tilesY; tileIndex++)
+    {
+        Slot& slot = slots[tileIndex % ringSlots];
+        finishSlot(slot);
+
+        const uint32_t x = (tileIndex % tilesX) * tileSize;
+        const uint32_t y = (tileIndex / tilesX) * tileSize;
+        slot.tile = PushConstants{ .imageWidth = width,
+                                   .imageHeight = height,
+                                   .tileOffsetX = x,
+                                   .tileOffsetY = y,
+                                   .tileWidth = std::min(tileSize, width - x),
+                                   .tileHeight = std::min(tileSize, height - y),
+                                   .outputOffset = (tileIndex % ringSlots) * tileSize * tileSize };
+
+        slot.cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+        vkCmdBindPipeline(slot.cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(slot.cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdPushConstants(slot.cmdBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &slot.tile);
+        vkCmdDispatch(slot.cmdBuffer, (slot.tile.tileWidth + workgroup_width - 1) / workgroup_width,
+                      (slot.tile.tileHeight + workgroup_height - 1) / workgroup_height, sampleSplit);
+        // Make the tile readable by the CPU
+        VkMemoryBarrier memoryBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                      .dstAccessMask = VK_ACCESS_HOST_READ_BIT };
+        vkCmdPipelineBarrier(slot.cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0,
+                             nullptr, 0, nullptr);
+        NVVK_CHECK(vkEndCommandBuffer(slot.cmdBuffer));
+        VkSubmitInfo submitInfo{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &slot.cmdBuffer };
+        NVVK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, slot.fence));
+    }
+
+    // Write the tiles that are still in flight, oldest first
+    for (uint32_t i = 0; i < ringSlots; i++)
+    {
+        finishSlot(slots[(tilesX * tilesY + i) % ringSlots]);
+    }
+    for (Slot& slot : slots)
+    {
+        vkDestroyFence(device, slot.fence, nullptr);
+    }
+    return writer.close() && ok;
+}
+
+
+
+
+
+// Hybrid rendering: renders `sampleCount` samples per pixel of the whole image with the GPU (`pipeline`, which must
+// use ADAPTIVE_SAMPLING) and `cpuThreads` CPU threads at once. All of them take chunks of tiles from one TileQueue,
+// each sized to take about hybrid_chunk_seconds at the measured throughput of its renderer, so the faster side gets
+// more of the image. The GPU renders into the mapped BINDING_ACCUMULATION buffer `accumulation`, and the CPU into
+// its own buffer. Returns the merged image, 3 floats per pixel.
+std::vector<float> RenderHybrid(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                                VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod, uint32_t* activeTilesData,
+                                const float* accumulation, const CpuScene& cpuScene, const TileGrid& tileGrid, uint32_t sampleCount,
+                                uint32_t cpuThreads)
+{
+    TileQueue             tileQueue(AllTiles(tileGrid), cpuThreads + 1);
+    std::vector<float>    cpuSums(size_t(tileGrid.width) * tileGrid.height * 4);
+    std::atomic<uint32_t> cpuTiles{ 0 };
+    std::vector<std::thread> threads;
+    for (uint32_t thread = 0; thread < cpuThreads; thread++)
+    {
+        threads.emplace_back([&]() {
+            Throughput            throughput;
+            std::vector<uint32_t> chunk;
+            while (tileQueue.take(throughput.chunkSize(hybrid_chunk_seconds, 1), chunk))
+            {
+                const auto start = std::chrono::steady_clock::now();
+                for (const uint32_t tile : chunk)
+                {
+                    RenderTileOnCpu(cpuScene, tileGrid, tile, 0, sampleCount, cpuSums.data());
+                }
+                throughput.add(uint32_t(chunk.size()), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                cpuTiles += uint32_t(chunk.size());
+            }
+        });
+    }
+
+    // The GPU is fed from this thread. Its first chunk is bigger, as a dispatch has a fixed cost.
+    std::vector<bool>     renderedOnGpu(tileGrid.numTiles(), false);
+    Throughput            gpuThroughput;
+    std::vector<uint32_t> chunk;
+    while (tileQueue.take(gpuThroughput.chunkSize(hybrid_chunk_seconds, 64), chunk))
+    {
+        const auto start = std::chrono::steady_clock::now();
+        RenderTiles(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod, activeTilesData, chunk, 0,
+                    sampleCount);
+        gpuThroughput.add(uint32_t(chunk.size()), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        for (const uint32_t tile : chunk)
+        {
+            renderedOnGpu[(tile >> 16) * tileGrid.tilesX() + (tile & 0xFFFFu)] = true;
+        }
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Each pixel comes from the side that rendered its tile:
+    std::vector<float> image(size_t(tileGrid.width) * tileGrid.height * 3);
+    for (uint32_t y = 0; y < tileGrid.height; y++)
+    {
+        for (uint32_t x = 0; x < tileGrid.width; x++)
+        {
+            const size_t pixel = size_t(tileGrid.width) * y + x;
+            const bool   onGpu = renderedOnGpu[(y / workgroup_height) * tileGrid.tilesX() + x / workgroup_width];
+            const float* sums = onGpu ? accumulation : cpuSums.data();
+            for (int channel = 0; channel < 3; channel++)
+            {
+                image[3 * pixel + channel] = sums[4 * pixel + channel] / float(sampleCount);
+            }
+        }
+    }
+    printf("Hybrid: GPU rendered %u tiles (%.0f tiles/s), %u CPU threads %u tiles\n", tileGrid.numTiles() - cpuTiles.load(),
+           gpuThroughput.tilesPerSecond, cpuThreads, cpuTiles.load());
+    return image;
+}
+
+
+
+
+
+// Descriptor sets of denoise.comp.glsl, one per pair of buffers an A-trous iteration reads from and writes to.
+// The first iteration reads the image and the last one writes it; the ones in between ping-pong between 2 scratch buffers.
+enum DenoiseSet : uint32_t
+{
+    DENOISE_SET_IMAGE_TO_A,
+    DENOISE_SET_A_TO_B,
+    DENOISE_SET_B_TO_A,
+    DENOISE_SET_A_TO_IMAGE,
+    DENOISE_SET_B_TO_IMAGE,
+    DENOISE_SET_COUNT
+};
+
+// Filters the image with `iterations` (at least 2) A-trous iterations of `pipeline` (denoise.comp.glsl), in one
+// command buffer, and returns how long the filter took on the GPU, in milliseconds.
+double DenoiseAndTime(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline,
+                      const nvvk::DescriptorSetContainer& descriptorSetContainer, uint32_t iterations, VkQueryPool queryPool,
+                      float timestampPeriod)
+{
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+    // Make the image and guides written by earlier submissions of raytrace.comp.glsl visible to the first iteration
+    VkMemoryBarrier renderBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                  .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                  .dstAccessMask = VK_ACCESS_SHADER_READ_BIT };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &renderBarrier, 0,
+                         nullptr, 0, nullptr);
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        // Iteration 0 writes A; after that, odd iterations read A and even iterations read B.
+        uint32_t set = DENOISE_SET_IMAGE_TO_A;
+        if (i + 1 == iterations)
+        {
+            set = (i % 2 == 1) ? DENOISE_SET_A_TO_IMAGE : DENOISE_SET_B_TO_IMAGE;
+        }
+        else if (i > 0)
+        {
+            set = (i % 2 == 1) ? DENOISE_SET_A_TO_B : DENOISE_SET_B_TO_A;
+        }
+        VkDescriptorSet descriptorSet = descriptorSetContainer.getSet(set);
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, descriptorSetContainer.getPipeLayout(), 0, 1, &descriptorSet, 0, nullptr);
+
+        // The taps get further apart, and color edges count more, with each iteration:
+        const DenoisePushConstants pushConstants{ .width = uint32_t(render_width),
+                                                  .height = uint32_t(render_height),
+                                                  .stepWidth = 1u << i,
+                                                  .colorPhi = 1.0f / float(1u << i),
+                                                  .normalPhi = 0.1f,
+                                                  .albedoPhi = 0.01f };
+        vkCmdPushConstants(cmdBuffer, descriptorSetContainer.getPipeLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkCmdDispatch(cmdBuffer, (uint32_t(render_width) + workgroup_width - 1) / workgroup_width,
+                      (uint32_t(render_height) + workgroup_height - 1) / workgroup_height, 1);
+
+        // Make this iteration's writes visible to the next iteration, or to the CPU after the last one
+        const bool isLast = (i + 1 == iterations);
+        VkMemoryBarrier memoryBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                      .dstAccessMask = isLast ? VkAccessFlags(VK_ACCESS_HOST_READ_BIT) : VkAccessFlags(VK_ACCESS_SHADER_READ_BIT) };
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             isLast ? VK_PIPELINE_STAGE_HOST_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    EndSubmitWaitAndFreeCommandBuffer(device, queue, cmdPool, cmdBuffer);
+    return GetElapsedMilliseconds(device, queryPool, 0, timestampPeriod);
+}
+
+
+
+
+
+// Names of the TONEMAP_* and ENCODING_* values in --tonemap and --encode.
+static const char* const tonemap_names[]  = { "clamp", "reinhard", "aces" };
+static const char* const encoding_names[] = { "rgba8", "rgb10a2", "rgb9e5", "rgba16f" };
+// Names of the SWIZZLE_* values in --swizzle.
+static const char* const swizzle_names[] = { "row", "morton", "hilbert", "subgroup" };
+
+// Size of one pixel in the output buffer of tonemap.comp.glsl.
+uint32_t EncodingBytesPerPixel(uint32_t encoding)
+{
+    return (encoding == ENCODING_RGBA16F) ? 8 : 4;
+}
+
+// Encodes the image into the output buffer of `descriptorSetContainer` with `pipeline` (tonemap.comp.glsl), and
+// returns how long it took on the GPU, in milliseconds.
+double TonemapAndTime(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline,
+                      const nvvk::DescriptorSetContainer& descriptorSetContainer, const TonemapPushConstants& pushConstants,
+                      VkQueryPool queryPool, float timestampPeriod)
+{
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    VkDescriptorSet descriptorSet = descriptorSetContainer.getSet(0);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, descriptorSetContainer.getPipeLayout(), 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, descriptorSetContainer.getPipeLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+    // Make the image written by earlier submissions (rendering, denoising, or the CPU for hybrid rendering) visible
+    VkMemoryBarrier inputBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                 .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT,
+                                 .dstAccessMask = VK_ACCESS_SHADER_READ_BIT };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &inputBarrier, 0, nullptr, 0, nullptr);
+    vkCmdDispatch(cmdBuffer, (pushConstants.width + workgroup_width - 1) / workgroup_width,
+                  (pushConstants.height + workgroup_height - 1) / workgroup_height, 1);
+
+    // Make the encoded image visible to the CPU
+    VkMemoryBarrier outputBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                  .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                  .dstAccessMask = VK_ACCESS_HOST_READ_BIT };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &outputBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    EndSubmitWaitAndFreeCommandBuffer(device, queue, cmdPool, cmdBuffer);
+    return GetElapsedMilliseconds(device, queryPool, 0, timestampPeriod);
+}
+
+
+
+
+
+// A storage image that raytrace.comp.glsl writes the color to with SPEC_OUTPUT_IMAGE, instead of the vec3 buffer.
+// It is an array with one layer per view of multi-view rendering.
+struct OutputImage
+{
+    nvvk::Image image;
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat    format = VK_FORMAT_R32G32B32A32_SFLOAT;  // VK_FORMAT_R32G32B32A32_SFLOAT or VK_FORMAT_R16G16B16A16_SFLOAT
+    uint32_t    width = 0;
+    uint32_t    height = 0;
+    uint32_t    layers = 1;
+};
+
+// Creates a `width` x `height` storage image array of `layers` layers with optimal tiling, and moves it to the
+// GENERAL layout that both the shader and the readback copy use.
+OutputImage CreateOutputImage(VkDevice device, nvvk::ResourceAllocatorDedicated& allocator, VkCommandPool cmdPool, VkQueue queue,
+                              VkFormat format, uint32_t width, uint32_t height, uint32_t layers = 1)
+{
+    OutputImage outputImage{ .format = format, .width = width, .height = height, .layers = layers };
+    const VkImageCreateInfo imageInfo{ .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                       .imageType = VK_IMAGE_TYPE_2D,
+                                       .format = format,
+                                       .extent = { width, height, 1 },
+                                       .mipLevels = 1,
+                                       .arrayLayers = layers,
+                                       .samples = VK_SAMPLE_COUNT_1_BIT,
+                                       .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                       .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED };
+    outputImage.image = allocator.createImage(imageInfo);
+
+    const VkImageSubresourceRange colorRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = layers };
+    const VkImageViewCreateInfo viewInfo{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                          .image = outputImage.image.image,
+                                          .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                                          .format = format,
+                                          .subresourceRange = colorRange };
+    NVVK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &outputImage.view));
+
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+    const VkImageMemoryBarrier layoutBarrier{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                              .srcAccessMask = 0,
+                                              .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                              .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                              .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                              .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                              .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                              .image = outputImage.image.image,
+                                              .subresourceRange = colorRange };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &layoutBarrier);
+    EndSubmitWaitAndFreeCommandBuffer(device, queue, cmdPool, cmdBuffer);
+    return outputImage;
+}
+
+void DestroyOutputImage(VkDevice device, nvvk::ResourceAllocatorDedicated& allocator, OutputImage& outputImage)
+{
+    vkDestroyImageView(device, outputImage.view, nullptr);
+    allocator.destroy(outputImage.image);
+}
+
+// Points BINDING_OUTPUT_IMAGE of the descriptor set of raytrace.comp.glsl at `outputImage`.
+void WriteOutputImageDescriptor(VkDevice device, const nvvk::DescriptorSetContainer& descriptorSetContainer, const OutputImage& outputImage)
+{
+    const VkDescriptorImageInfo imageInfo{ .imageView = outputImage.view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+    const VkWriteDescriptorSet  write = descriptorSetContainer.makeWrite(0, BINDING_OUTPUT_IMAGE, &imageInfo);
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+// Copies `outputImage` to a linear staging buffer, and converts its texels to 3 floats per pixel in `rgb`, the layout
+// the rest of the program reads, one layer after the other. Returns how long the copy took on the GPU, in milliseconds.
+double ReadBackOutputImage(VkDevice device, VkQueue queue, VkCommandPool cmdPool, nvvk::ResourceAllocatorDedicated& allocator,
+                           const OutputImage& outputImage, VkQueryPool queryPool, float timestampPeriod, float* rgb)
+{
+    const bool   isHalf = (outputImage.format == VK_FORMAT_R16G16B16A16_SFLOAT);
+    const size_t numPixels = size_t(outputImage.width) * outputImage.height * outputImage.layers;
+    nvvk::Buffer staging = allocator.createBuffer(numPixels * (isHalf ? 4 * sizeof(uint16_t) : 4 * sizeof(float)), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                                                      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(device, cmdPool);
+    vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    // Copy once the shader has written the image, and make the copy visible to the CPU
+    const VkMemoryBarrier renderBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                         .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                         .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &renderBarrier, 0, nullptr, 0, nullptr);
+    const VkBufferImageCopy region{ .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = outputImage.layers },
+                                    .imageExtent = { outputImage.width, outputImage.height, 1 } };
+    vkCmdCopyImageToBuffer(cmdBuffer, outputImage.image.image, VK_IMAGE_LAYOUT_GENERAL, staging.buffer, 1, &region);
+    const VkMemoryBarrier copyBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                       .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                       .dstAccessMask = VK_ACCESS_HOST_READ_BIT };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    EndSubmitWaitAndFreeCommandBuffer(device, queue, cmdPool, cmdBuffer);
+    const double copyMs = GetElapsedMilliseconds(device, queryPool, 0, timestampPeriod);
+
+    // Drop the alpha channel, and widen half floats
+    const void* texels = allocator.map(staging);
+    for (size_t pixel = 0; pixel < numPixels; pixel++)
+    {
+        for (size_t channel = 0; channel < 3; channel++)
+        {
+            rgb[3 * pixel + channel] = isHalf ? HalfToFloat(reinterpret_cast<const uint16_t*>(texels)[4 * pixel + channel])
+                                              : reinterpret_cast<const float*>(texels)[4 * pixel + channel];
+        }
+    }
+    allocator.unmap(staging);
+    allocator.destroy(staging);
+    return copyMs;
+}
+
+
+
+
+
+// Returns a copy of the first `count` floats of a host-visible buffer, e.g. to keep an image while the next one renders.
+std::vector<float> CopyBufferFloats(nvvk::ResourceAllocatorDedicated& allocator, const nvvk::Buffer& buffer, size_t count)
+{
+    const float* data = reinterpret_cast<const float*>(allocator.map(buffer));
+    std::vector<float> floats(data, data + count);
+    allocator.unmap(buffer);
+    return floats;
+}
+
+
+
+
+
+// The AOVs raytrace.comp.glsl can write (see the AOV_* bits in common.h), with their bindings and output files.
+struct AovInfo
+{
+    uint32_t    bit;
+    uint32_t    binding;
+    const char* name;           // Name in --aovs, and of the output file
+    uint32_t    bytesPerPixel;  // Size of one pixel in the AOV's buffer
+};
+static constexpr std::array<AovInfo, 5> aov_infos = { { { AOV_ALBEDO, BINDING_ALBEDO, "albedo", 3 * sizeof(float) },
+                                                    { AOV_NORMAL, BINDING_NORMAL, "normal", 3 * sizeof(float) },
+                                                    { AOV_DEPTH, BINDING_AOV_DEPTH, "depth", sizeof(float) },
+                                                    { AOV_IDS, BINDING_AOV_IDS, "ids", 2 * sizeof(uint32_t) },
+                                                    { AOV_BARYCENTRICS, BINDING_AOV_BARYCENTRICS, "barycentrics", 2 * sizeof(float) } } };
+
+// Parses a comma-separated list of AOV names (or "all") into a combination of AOV_* bits.
+uint32_t ParseAovMask(const char* list)
+{
+    uint32_t mask = 0;
+    std::string remaining(list);
+    while (!remaining.empty())
+    {
+        const size_t comma = remaining.find(',');
+        const std::string name = remaining.substr(0, comma);
+        remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+        bool found = false;
+        for (const AovInfo& aov : aov_infos)
+        {
+            if (name == aov.name || name == "all")
+            {
+                mask |= aov.bit;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            fprintf(stderr, "Unknown AOV: %s\n", name.c_str());
+        }
+    }
+    return mask;
+}
+
+// Writes the AOVs in `mask` from their mapped buffers to out_<name>.pfm with `writer`, or, if `exrLayers` isn't null,
+// adds them to it as layers <name> of the EXR image. The IDs go to out_primitive_id.raw and out_instance_id.raw
+// instead (one little-endian uint32 per pixel, AOV_NO_HIT_ID for the sky). Primitive IDs are mapped back to the
+// triangles of the source file with `originalPrimitiveIDs`.
+void WriteAovs(uint32_t mask, const std::array<const void*, aov_infos.size()>& aovData, const std::vector<uint32_t>& originalPrimitiveIDs,
+               ImageWriter& writer, std::vector<ImageLayer>* exrLayers)
+{
+    const size_t numPixels = size_t(render_width) * render_height;
+    for (size_t i = 0; i < aov_infos.size(); i++)
+    {
+        const AovInfo& aov = aov_infos[i];
+        if ((mask & aov.bit) == 0)
+        {
+            continue;
+        }
+        ImageLayer layer{ aov.name, 3, {} };
+        if (aov.bit == AOV_IDS)
+        {
+            const uint32_t* ids = reinterpret_cast<const uint32_t*>(aovData[i]);
+            std::vector<uint32_t> primitiveIDs(numPixels), instanceIDs(numPixels);
+            for (size_t pixel = 0; pixel < numPixels; pixel++)
+            {
+                const uint32_t primitiveID = ids[2 * pixel + 0];
+                primitiveIDs[pixel] = (primitiveID == AOV_NO_HIT_ID) ? AOV_NO_HIT_ID : originalPrimitiveIDs[primitiveID];
+                instanceIDs[pixel] = ids[2 * pixel + 1];
+            }
+            if (!WriteRaw("out_primitive_id.raw", primitiveIDs.data(), numPixels * sizeof(uint32_t))
+                || !WriteRaw("out_instance_id.raw", instanceIDs.data(), numPixels * sizeof(uint32_t)))
+            {
+                fprintf(stderr, "Could not write the %s AOV\n", aov.name);
+            }
+            continue;
+        }
+        else if (aov.bit == AOV_BARYCENTRICS)
+        {
+            // PFM has 1 or 3 channels, so store all 3 barycentrics: (1-u-v, u, v)
+            const float* uv = reinterpret_cast<const float*>(aovData[i]);
+            layer.pixels.resize(3 * numPixels);
+            for (size_t pixel = 0; pixel < numPixels; pixel++)
+            {
+                layer.pixels[3 * pixel + 0] = 1.0f - uv[2 * pixel] - uv[2 * pixel + 1];
+                layer.pixels[3 * pixel + 1] = uv[2 * pixel];
+                layer.pixels[3 * pixel + 2] = uv[2 * pixel + 1];
+            }
+        }
+        else
+        {
+            const float* data = reinterpret_cast<const float*>(aovData[i]);
+            layer.channels = aov.bytesPerPixel / sizeof(float);
+            layer.pixels.assign(data, data + layer.channels * numPixels);
+            if (aov.bit == AOV_NORMAL)
+            {
+                layer.components = "XYZ";  // normal.X, normal.Y, normal.Z in EXR files
+            }
+        }
+
+        if (exrLayers != nullptr)
+        {
+            exrLayers->push_back(std::move(layer));
+        }
+        else
+        {
+            writer.write(Image{ std::string("out_") + aov.name + ".pfm", ImageFormat::Pfm, uint32_t(render_width), uint32_t(render_height),
+                                { std::move(layer) } });
+        }
+    }
+}
+
+
+
+
+
+// Command-line options
+struct Options
+{
+    bool  useShadingRecords = false;  // --shading-records: read PrimitiveRecords instead of indices and vertices on each hit
+    int   benchmarkHitFetch = 0;      // --benchmark-hit-fetch <N>: time N dispatches of each hit fetch mode
+    bool  forceIndex32      = false;  // --index32: keep 32-bit indices even if the mesh has at most 65536 vertices
+    bool  quantizeVertices  = false;  // --quantize-vertices: shade from 16-bit fixed point vertex positions
+    bool  reorderMesh       = false;  // --reorder: sort triangles and vertices for memory locality before upload
+    float splitBudget       = 0.0f;   // --split-budget <F>: split large triangles, adding at most F * (triangle count) triangles
+    float splitThreshold    = 4.0f;   // --split-threshold <T>: split triangles whose bounds area is > T * average
+    int   benchmarkSplit    = 0;      // --benchmark-split <N>: time N dispatches for a sweep of split budgets
+    VkBuildAccelerationStructureFlagsKHR blasBuildFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+                                      // --blas-build <trace|build>: prefer fast traversal or fast builds; --blas-compact:
+                                      // also compact the BLAS
+    int   benchmarkTraversal = 0;     // --benchmark-traversal <N>: time N dispatches of camera and random rays without
+                                      // shading, for each BLAS build mode
+    bool  adaptiveSampling  = false;  // --adaptive: sample tiles in batches until they converge, instead of 64 spp everywhere
+    float noiseThreshold    = 0.02f;  // --noise-threshold <E>: relative standard error at which a pixel has converged
+    int   maxSamples        = 256;    // --max-spp <N>: adaptive sampling stops after N samples per pixel
+    int   snapshotSamples   = 0;      // --snapshots <N>: render N spp, writing the image at 1, 2, 4, ... spp as out_spp<n>.<format>
+    float timeBudgetMs      = 0.0f;   // --time-budget <ms>: add batches of samples while they are predicted to end within <ms>
+                                      // of the first one, then write what has been rendered (0: off)
+    std::string checkpointPath;           // --checkpoint <file>: render --max-spp in batches, saving the render to <file> and
+                                          // continuing from it if it exists (with --adaptive, until the tiles converge)
+    float checkpointInterval = 300.0f;    // --checkpoint-interval <s>: seconds between checkpoints
+    uint32_t sampler        = SAMPLER_SOBOL;  // --sampler <pcg|sobol>: where the random numbers of each path come from
+    int   benchmarkSampler  = 0;      // --benchmark-sampler <N>: print the RMSE of both samplers for 1 to N spp
+    bool  denoise           = false;  // --denoise: filter the image with the A-trous denoiser before writing it
+    int   denoiseIterations = 5;      // --denoise-iterations <N>: number of A-trous iterations (at least 2)
+    bool  benchmarkDenoiser = false;  // --benchmark-denoiser: compare time and RMSE of 8 spp + denoiser against 64 spp
+    uint32_t aovMask        = 0;      // --aovs <list>: comma-separated AOVs to write, from albedo, normal, depth, ids, barycentrics, all
+    uint32_t tiledWidth     = 0;      // --tiled <W>x<H>: render a W x H image tile by tile, streaming it to out.hdr (0: off)
+    uint32_t tiledHeight    = 0;
+    uint32_t tileSize       = 512;    // --tile-size <N>: tiled rendering uses tiles of N x N pixels
+    uint32_t tileRingSlots  = 3;      // --tile-ring <N>: tiled rendering keeps N tiles in flight
+    bool        isWorker = false;            // --worker-job <rowBegin,rowEnd,firstSample,sampleCount>: render one job of a
+    RenderJob   workerJob;                   // coordinator (see distributed.hpp) into a partial render file
+    std::string partialPath = "partial.bin";  // --partial <path>: where a worker writes its partial render
+    int         localWorkers = 0;            // --coordinate <N>: render the frame with N local worker processes
+    std::string workerHostsPath;             // --worker-hosts <file>: also one worker per line of the file, which is the
+                                             // command prefix that starts it, e.g. "ssh render01"
+    std::string partialDir = ".";            // --partial-dir <dir>: where workers write partial renders (shared with remote workers)
+    int         totalSamples = 64;           // --spp <N>: samples per pixel the coordinator splits into jobs, or of --hybrid
+    int         rowBands = 0;                // --row-bands <N>: number of bands of rows the coordinator splits the frame into (0: one per worker)
+    int         sampleSlices = 1;            // --spp-slices <N>: number of sample ranges the coordinator splits each band into
+    std::string mergeInputs;                 // --merge <list>: merge the comma-separated partial render files into out.hdr
+    std::vector<std::string> workerArguments;  // The options that aren't about distributed rendering, which workers get too
+    ImageFormat outputFormat = ImageFormat::Hdr;  // --format <hdr|pfm|exr>: file format of the image (out.hdr, out.pfm or out.exr)
+    bool        hybrid = false;              // --hybrid: render with the GPU and CPU threads at once
+    uint32_t    cpuThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;  // --cpu-threads <N>: CPU threads of --hybrid
+    bool        encodeOutput = false;           // --encode <rgba8|rgb10a2|rgb9e5|rgba16f>: encode the image on the GPU and read
+    uint32_t    encoding = ENCODING_RGBA8;      // back the encoded pixels, writing out.png (rgba8) or out_<encoding>.raw
+    uint32_t    tonemapCurve = TONEMAP_ACES;    // --tonemap <clamp|reinhard|aces>: curve of the rgba8 and rgb10a2 encodings
+    float       exposure = 0.0f;                // --exposure <EV>: the encodings scale the linear color by 2^EV
+    VkFormat    outputImageFormat = VK_FORMAT_UNDEFINED;  // --output-image <rgba32f|rgba16f>: render into a storage image
+                                                          // with optimal tiling instead of the vec3 buffer (UNDEFINED: off)
+    int         benchmarkOutput = 0;            // --benchmark-output <N>: time N dispatches into the buffer and each image format
+    uint32_t    pixelSwizzle = SWIZZLE_ROW_MAJOR;  // --swizzle <row|morton|hilbert|subgroup>: pixel of each invocation in its tile
+    int         benchmarkSwizzle = 0;           // --benchmark-swizzle <N>: time N dispatches of each swizzle, primary rays and paths
+    bool        persistentThreads = false;      // --persistent: render with a fixed number of workgroups that take tiles from a counter
+    uint32_t    persistentWorkgroups = 0;       // --persistent-workgroups <N>: their number (0: SMs x workgroups per SM)
+    int         benchmarkPersistent = 0;        // --benchmark-persistent <N>: time N dispatches with and without persistent threads
+    uint32_t    sampleSplit = 0;                // --sample-split <N|auto>: invocations per pixel, a power of 2 up to MAX_SAMPLE_SPLIT
+                                                // (0: auto, from the pixels per dispatch and the size of the GPU)
+    int         benchmarkSampleSplit = 0;       // --benchmark-sample-split <N>: time N dispatches of small images with each split
+    std::string views;                          // --views <turntable:N|cubemap|file>: render one image per camera in one dispatch
+                                                // into the layers of the output image, and write them to out_view<i>.<format>
+    uint32_t    viewWidth = 256;                // --view-size <W>x<H>: size of the images of --views
+    uint32_t    viewHeight = 256;
+    std::string scene;                          // --scene <file.obj|file.mesh|spheres:N|outdoor:N>: the OBJ file, the mesh cache
+                                                // file of tools/scene_generator, or a generated scene of about N triangles (see
+                                                // procedural.hpp), instead of the Cornell box
+    uint32_t    instances = 1;                  // --instances <N>: put N scaled-down instances of the mesh in the TLAS, in a grid
+    std::string benchmarkJson;                  // --benchmark-json <file>: time loading, AS builds and renders, and write them as JSON
+    int         benchmarkWarmup = 2;            // --benchmark-warmup <N>: untimed renders before the timed ones
+    int         benchmarkRepeat = 5;            // --benchmark-repeat <N>: timed renders
+    int         benchmarkSpp = 16;              // --benchmark-spp <N>: samples per pixel of each render
+    std::string benchmarkSuite;                 // --benchmark-suite <file>: run --benchmark-json on the scene corpus of
+                                                // benchmark.cpp, one process per scene, and collect the results in <file>
+    std::string qualityGate;                    // --quality-gate <file>: render for each of --quality-budgets, and write the
+                                                // errors against a cached reference to <file> as CSV
+    std::vector<float> qualityBudgets = { 250.0f, 1000.0f };  // --quality-budgets <ms,ms,...>: wall-time budgets of the gate
+    int         qualityReferenceSpp = 4096;     // --quality-reference-spp <N>: samples per pixel of the reference
+    std::string qualityBaseline;                // --quality-baseline <file>: the CSV of an earlier --quality-gate run; exit with
+                                                // an error if a budget's relMSE or FLIP error is worse than in <file> by more
+    float       qualityTolerance = 0.05f;       // --quality-tolerance <F>: than the fraction F
+};
+
+// Options that only concern the coordinator, a worker's job or the benchmark suite, so the coordinator doesn't pass
+// them on to workers, nor the suite to its scenes.
+static const char* const distribution_options[] = { "--worker-job", "--partial", "--coordinate", "--worker-hosts", "--partial-dir",
+                                                    "--spp", "--row-bands", "--spp-slices", "--merge", "--benchmark-suite" };
+
+// An option that another one can override: its name in the messages, whether it is given, and how to unset it.
+struct OptionSwitch
+{
+    const char* name;
+    bool (*isSet)(const Options&);
+    void (*unset)(Options&);
+};
+
+// Unsets the options that the modes given in `options` can't honour, from the mode that wins most conflicts to the
+// least, with one message per mode that lists what it ignores.
+void ResolveOptionConflicts(Options& options)
+{
+    const OptionSwitch worker{ "--worker-job", [](const Options& o) { return o.isWorker; }, [](Options& o) { o.isWorker = false; } };
+    const OptionSwitch hybrid{ "--hybrid", [](const Options& o) { return o.hybrid; }, [](Options& o) { o.hybrid = false; } };
+    const OptionSwitch tiled{ "--tiled", [](const Options& o) { return o.tiledWidth > 0; },
+                              [](Options& o) { o.tiledWidth = o.tiledHeight = 0; } };
+    const OptionSwitch snapshots{ "--snapshots", [](const Options& o) { return o.snapshotSamples > 0; },
+                                  [](Options& o) { o.snapshotSamples = 0; } };
+    const OptionSwitch timeBudget{ "--time-budget", [](const Options& o) { return o.timeBudgetMs > 0.0f; },
+                                   [](Options& o) { o.timeBudgetMs = 0.0f; } };
+    const OptionSwitch checkpoint{ "--checkpoint", [](const Options& o) { return !o.checkpointPath.empty(); },
+                                   [](Options& o) { o.checkpointPath.clear(); } };
+    const OptionSwitch views{ "--views", [](const Options& o) { return !o.views.empty(); }, [](Options& o) { o.views.clear(); } };
+    const OptionSwitch adaptive{ "--adaptive", [](const Options& o) { return o.adaptiveSampling; },
+                                 [](Options& o) { o.adaptiveSampling = false; } };
+    const OptionSwitch denoise{ "--denoise", [](const Options& o) { return o.denoise; }, [](Options& o) { o.denoise = false; } };
+    const OptionSwitch aovs{ "--aovs", [](const Options& o) { return o.aovMask != 0; }, [](Options& o) { o.aovMask = 0; } };
+    const OptionSwitch encode{ "--encode", [](const Options& o) { return o.encodeOutput; }, [](Options& o) { o.encodeOutput = false; } };
+    const OptionSwitch format{ "--format", [](const Options& o) { return o.outputFormat != ImageFormat::Hdr; },
+                               [](Options& o) { o.outputFormat = ImageFormat::Hdr; } };
+    const OptionSwitch outputImage{ "--output-image", [](const Options& o) { return o.outputImageFormat != VK_FORMAT_UNDEFINED; },
+                                    [](Options& o) { o.outputImageFormat = VK_FORMAT_UNDEFINED; } };
+    const OptionSwitch persistent{ "--persistent", [](const Options& o) { return o.persistentThreads; },
+                                   [](Options& o) { o.persistentThreads = false; } };
+    const OptionSwitch instances{ "--instances", [](const Options& o) { return o.instances > 1; }, [](Options& o) { o.instances = 1; } };
+    const OptionSwitch qualityGate{ "--quality-gate", [](const Options& o) { return !o.qualityGate.empty(); },
+                                    [](Options& o) { o.qualityGate.clear(); } };
+    const OptionSwitch benchmarkJson{ "--benchmark-json", [](const Options& o) { return !o.benchmarkJson.empty(); },
+                                      [](Options& o) { o.benchmarkJson.clear(); } };
+    const OptionSwitch benchmarks{ "the benchmarks",
+                                   [](const Options& o) {
+                                       return o.benchmarkHitFetch > 0 || o.benchmarkSplit > 0 || o.benchmarkSampler > 0 || o.benchmarkDenoiser
+                                              || o.benchmarkOutput > 0 || o.benchmarkSwizzle > 0 || o.benchmarkPersistent > 0
+                                              || o.benchmarkSampleSplit > 0 || o.benchmarkTraversal > 0;
+                                   },
+                                   [](Options& o) {
+                                       o.benchmarkHitFetch = o.benchmarkSplit = o.benchmarkSampler = o.benchmarkOutput = o.benchmarkSwizzle = 0;
+                                       o.benchmarkPersistent = o.benchmarkSampleSplit = o.benchmarkTraversal = 0;
+                                       o.benchmarkDenoiser = false;
+                                   } };
+
+    const auto ignoreWith = [&](const OptionSwitch& mode, std::initializer_list<const OptionSwitch*> ignored) {
+        if (!mode.isSet(options))
+        {
+            return;
+        }
+        std::vector<const char*> names;
+        for (const OptionSwitch* option : ignored)
+        {
+            if (option->isSet(options))
+            {
+                names.push_back(option->name);
+                option->unset(options);
+            }
+        }
+        std::string list;
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            list += (i == 0) ? "" : (i + 1 == names.size()) ? " and " : ", ";
+            list += names[i];
+        }
+        if (!names.empty())
+        {
+            fprintf(stderr, "%s %s ignored with %s\n", list.c_str(), (names.size() == 1) ? "is" : "are", mode.name);
+        }
+    };
+    // A worker only renders its job, into the tile sums. Tiled rendering streams the image to disk as it renders it,
+    // into the ring of tiles, and the CPU side of hybrid rendering only renders the color of the mesh itself, without
+    // instances. None of them produces anything else, or dispatches anything but their own grids of workgroups.
+    ignoreWith(worker, { &tiled, &hybrid, &snapshots, &timeBudget, &checkpoint, &views, &adaptive, &denoise, &aovs, &encode, &outputImage,
+                         &persistent, &benchmarks, &benchmarkJson, &qualityGate });
+    ignoreWith(hybrid, { &tiled, &snapshots, &timeBudget, &checkpoint, &views, &adaptive, &denoise, &aovs, &outputImage, &persistent,
+                         &instances, &benchmarks, &benchmarkJson, &qualityGate });
+    ignoreWith(tiled, { &snapshots, &timeBudget, &checkpoint, &views, &adaptive, &denoise, &aovs, &encode, &outputImage, &persistent,
+                        &benchmarks, &benchmarkJson, &qualityGate });
+    // The end-to-end benchmark renders no image to write, so it skips everything that only changes what is written
+    ignoreWith(benchmarkJson, { &views, &aovs, &encode });
+    // Snapshots are of the whole image, rendered into the vec3 buffer in batches of all tiles. A time budget applies to
+    // the batches of the whole image, which adaptive sampling would shrink to the tiles that haven't converged.
+    ignoreWith(snapshots, { &timeBudget, &checkpoint, &views, &adaptive, &outputImage });
+    ignoreWith(timeBudget, { &checkpoint, &views, &adaptive });
+    // Multi-view rendering renders whole images into the layers of the output image, and nothing else
+    ignoreWith(views, { &checkpoint, &adaptive, &denoise, &aovs, &encode, &qualityGate });
+    // Checkpoints hold the state of the progressive batches of the whole image, with its colors in the vec3 buffer.
+    // The AOVs of the tiles that converged before a restart would be lost, so they and the denoiser are off.
+    ignoreWith(checkpoint, { &denoise, &aovs, &outputImage });
+    // The quality gate compares the images in the vec3 buffer
+    ignoreWith(outputImage, { &qualityGate });
+    // The encoded image replaces out.<format>, so the AOVs go to their own files
+    ignoreWith(encode, { &format });
+}
+
+Options ParseOptions(int argc, const char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        const int  optionStart = i;
+        const bool hasValue = (i + 1 < argc);
+        if (strcmp(argv[i], "--shading-records") == 0)
+        {
+            options.useShadingRecords = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-hit-fetch") == 0 && hasValue)
+        {
+            options.benchmarkHitFetch = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--index32") == 0)
+        {
+            options.forceIndex32 = true;
+        }
+        else if (strcmp(argv[i], "--quantize-vertices") == 0)
+        {
+            options.quantizeVertices = true;
+        }
+        else if (strcmp(argv[i], "--reorder") == 0)
+        {
+            options.reorderMesh = true;
+        }
+        else if (strcmp(argv[i], "--split-budget") == 0 && hasValue)
+        {
+            options.splitBudget = std::max(0.0f, float(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--split-threshold") == 0 && hasValue)
+        {
+            options.splitThreshold = std::max(1.0f, float(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--benchmark-split") == 0 && hasValue)
+        {
+            options.benchmarkSplit = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--blas-build") == 0 && hasValue)
+        {
+            const VkBuildAccelerationStructureFlagsKHR compaction =
+                options.blasBuildFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+            options.blasBuildFlags = compaction
+                | ((strcmp(argv[++i], "build") == 0) ? VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR
+                                                     : VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+        }
+        else if (strcmp(argv[i], "--blas-compact") == 0)
+        {
+            options.blasBuildFlags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+        }
+        else if (strcmp(argv[i], "--benchmark-traversal") == 0 && hasValue)
+        {
+            options.benchmarkTraversal = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--adaptive") == 0)
+        {
+            options.adaptiveSampling = true;
+        }
+        else if (strcmp(argv[i], "--noise-threshold") == 0 && hasValue)
+        {
+            options.noiseThreshold = std::max(0.0f, float(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--max-spp") == 0 && hasValue)
+        {
+            options.maxSamples = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--snapshots") == 0 && hasValue)
+        {
+            options.snapshotSamples = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && hasValue)
+        {
+            options.checkpointPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint-interval") == 0 && hasValue)
+        {
+            options.checkpointInterval = std::max(0.0f, float(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--time-budget") == 0 && hasValue)
+        {
+            options.timeBudgetMs = std::max(0.0f, float(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--sampler") == 0 && hasValue)
+        {
+            const char* name = argv[++i];
+            if (strcmp(name, "pcg") == 0)
+            {
+                options.sampler = SAMPLER_PCG;
+            }
+            else if (strcmp(name, "sobol") == 0)
+            {
+                options.sampler = SAMPLER_SOBOL;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown sampler: %s\n", name);
+            }
+        }
+        else if (strcmp(argv[i], "--benchmark-sampler") == 0 && hasValue)
+        {
+            options.benchmarkSampler = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--denoise") == 0)
+        {
+            options.denoise = true;
+        }
+        else if (strcmp(argv[i], "--denoise-iterations") == 0 && hasValue)
+        {
+            options.denoiseIterations = std::clamp(atoi(argv[++i]), 2, 16);
+        }
+        else if (strcmp(argv[i], "--benchmark-denoiser") == 0)
+        {
+            options.benchmarkDenoiser = true;
+        }
+        else if (strcmp(argv[i], "--aovs") == 0 && hasValue)
+        {
+            options.aovMask = ParseAovMask(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tiled") == 0 && hasValue)
+        {
+            if (sscanf(argv[++i], "%ux%u", &options.tiledWidth, &options.tiledHeight) != 2 || options.tiledWidth == 0 || options.tiledHeight == 0)
+            {
+                fprintf(stderr, "Invalid image size: %s (expected <width>x<height>)\n", argv[i]);
+                options.tiledWidth = options.tiledHeight = 0;
+            }
+        }
+        else if (strcmp(argv[i], "--tile-size") == 0 && hasValue)
+        {
+            // A multiple of the workgroup size, and small enough that a ring of 8 tiles fits in maxStorageBufferRange
+            options.tileSize = std::clamp(uint32_t(atoi(argv[++i])) / workgroup_width * workgroup_width, workgroup_width, 1024u);
+        }
+        else if (strcmp(argv[i], "--tile-ring") == 0 && hasValue)
+        {
+            options.tileRingSlots = std::clamp(atoi(argv[++i]), 1, 8);
+        }
+        else if (strcmp(argv[i], "--worker-job") == 0 && hasValue)
+        {
+            options.isWorker = ParseRenderJob(argv[++i], options.workerJob) && (options.workerJob.rowEnd <= uint32_t(render_height));
+            if (!options.isWorker)
+            {
+                fprintf(stderr, "Invalid worker job: %s\n", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--partial") == 0 && hasValue)
+        {
+            options.partialPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--coordinate") == 0 && hasValue)
+        {
+            options.localWorkers = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--worker-hosts") == 0 && hasValue)
+        {
+            options.workerHostsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--partial-dir") == 0 && hasValue)
+        {
+            options.partialDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--spp") == 0 && hasValue)
+        {
+            options.totalSamples = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--row-bands") == 0 && hasValue)
+        {
+            options.rowBands = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--spp-slices") == 0 && hasValue)
+        {
+            options.sampleSlices = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--merge") == 0 && hasValue)
+        {
+            options.mergeInputs = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && hasValue)
+        {
+            i++;
+            if (strcmp(argv[i], "hdr") == 0 || strcmp(argv[i], "pfm") == 0 || strcmp(argv[i], "exr") == 0)
+            {
+                options.outputFormat = (argv[i][0] == 'h') ? ImageFormat::Hdr : (argv[i][0] == 'p') ? ImageFormat::Pfm : ImageFormat::Exr;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown image format: %s (expected hdr, pfm or exr)\n", argv[i]);
+            }
+        }
+        else if ((strcmp(argv[i], "--encode") == 0 || strcmp(argv[i], "--tonemap") == 0) && hasValue)
+        {
+            const bool         isEncoding = (argv[i][2] == 'e');
+            const char* const* names = isEncoding ? encoding_names : tonemap_names;
+            const uint32_t     count = isEncoding ? uint32_t(std::size(encoding_names)) : uint32_t(std::size(tonemap_names));
+            i++;
+            uint32_t value = 0;
+            while (value < count && strcmp(argv[i], names[value]) != 0)
+            {
+                value++;
+            }
+            if (value == count)
+            {
+                fprintf(stderr, "Unknown %s: %s\n", isEncoding ? "encoding" : "tonemapping curve", argv[i]);
+            }
+            else if (isEncoding)
+            {
+                options.encodeOutput = true;
+                options.encoding = value;
+            }
+            else
+            {
+                options.tonemapCurve = value;
+            }
+        }
+        else if (strcmp(argv[i], "--exposure") == 0 && hasValue)
+        {
+            options.exposure = float(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--output-image") == 0 && hasValue)
+        {
+            i++;
+            if (strcmp(argv[i], "rgba32f") == 0 || strcmp(argv[i], "rgba16f") == 0)
+            {
+                options.outputImageFormat = (argv[i][4] == '3') ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown output image format: %s (expected rgba32f or rgba16f)\n", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--benchmark-output") == 0 && hasValue)
+        {
+            options.benchmarkOutput = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--swizzle") == 0 && hasValue)
+        {
+            const char* name = argv[++i];
+            const auto  found = std::find_if(std::begin(swizzle_names), std::end(swizzle_names),
+                                             [name](const char* swizzleName) { return strcmp(swizzleName, name) == 0; });
+            if (found == std::end(swizzle_names))
+            {
+                fprintf(stderr, "Unknown swizzle: %s (expected row, morton, hilbert or subgroup)\n", name);
+            }
+            else
+            {
+                options.pixelSwizzle = uint32_t(found - std::begin(swizzle_names));
+            }
+        }
+        else if (strcmp(argv[i], "--benchmark-swizzle") == 0 && hasValue)
+        {
+            options.benchmarkSwizzle = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--persistent") == 0)
+        {
+            options.persistentThreads = true;
+        }
+        else if (strcmp(argv[i], "--persistent-workgroups") == 0 && hasValue)
+        {
+            options.persistentWorkgroups = uint32_t(std::max(1, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--benchmark-persistent") == 0 && hasValue)
+        {
+            options.benchmarkPersistent = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--sample-split") == 0 && hasValue)
+        {
+            const char* value = argv[++i];
+            if (strcmp(value, "auto") == 0)
+            {
+                options.sampleSplit = 0;
+            }
+            else
+            {
+                // Round down to a power of 2
+                const int split = std::clamp(atoi(value), 1, MAX_SAMPLE_SPLIT);
+                options.sampleSplit = 1u << uint32_t(std::log2(split));
+            }
+        }
+        else if (strcmp(argv[i], "--benchmark-sample-split") == 0 && hasValue)
+        {
+            options.benchmarkSampleSplit = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--views") == 0 && hasValue)
+        {
+            options.views = argv[++i];
+        }
+        else if (strcmp(argv[i], "--view-size") == 0 && hasValue)
+        {
+            if (sscanf(argv[++i], "%ux%u", &options.viewWidth, &options.viewHeight) != 2 || options.viewWidth == 0 || options.viewHeight == 0)
+            {
+                fprintf(stderr, "Invalid image size: %s (expected <width>x<height>)\n", argv[i]);
+                options.viewWidth = options.viewHeight = 256;
+            }
+        }
+        else if (strcmp(argv[i], "--scene") == 0 && hasValue)
+        {
+            options.scene = argv[++i];
+        }
+        else if (strcmp(argv[i], "--instances") == 0 && hasValue)
+        {
+            options.instances = uint32_t(std::max(1, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--benchmark-json") == 0 && hasValue)
+        {
+            options.benchmarkJson = argv[++i];
+        }
+        else if (strcmp(argv[i], "--benchmark-warmup") == 0 && hasValue)
+        {
+            options.benchmarkWarmup = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--benchmark-repeat") == 0 && hasValue)
+        {
+            options.benchmarkRepeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--benchmark-spp") == 0 && hasValue)
+        {
+            options.benchmarkSpp = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--benchmark-suite") == 0 && hasValue)
+        {
+            options.benchmarkSuite = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quality-gate") == 0 && hasValue)
+        {
+            options.qualityGate = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quality-budgets") == 0 && hasValue)
+        {
+            options.qualityBudgets.clear();
+            for (const char* text = argv[++i]; *text != '\0';)
+            {
+                char*        end = nullptr;
+                const double budgetMs = strtod(text, &end);
+                if (end == text)
+                {
+                    fprintf(stderr, "Invalid list of time budgets: %s\n", argv[i]);
+                    break;
+                }
+                if (budgetMs > 0.0)
+                {
+                    options.qualityBudgets.push_back(float(budgetMs));
+                }
+                text = (*end == ',') ? end + 1 : end;
+            }
+        }
+        else if (strcmp(argv[i], "--quality-reference-spp") == 0 && hasValue)
+        {
+            options.qualityReferenceSpp = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--quality-baseline") == 0 && hasValue)
+        {
+            options.qualityBaseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quality-tolerance") == 0 && hasValue)
+        {
+            options.qualityTolerance = std::max(0.0f, float(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--hybrid") == 0)
+        {
+            options.hybrid = true;
+        }
+        else if (strcmp(argv[i], "--cpu-threads") == 0 && hasValue)
+        {
+            options.cpuThreads = uint32_t(std::max(0, atoi(argv[++i])));
+        }
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+        }
+
+        const auto isOption = [&](const char* name) { return strcmp(argv[optionStart], name) == 0; };
+        if (std::none_of(std::begin(distribution_options), std::end(distribution_options), isOption))
+        {
+            options.workerArguments.insert(options.workerArguments.end(), argv + optionStart, argv + i + 1);
+        }
+    }
+    ResolveOptionConflicts(options);
+    if (options.views == "cubemap" && options.viewWidth != options.viewHeight)
+    {
+        fprintf(stderr, "Cube map faces are square: rendering them at %ux%u\n", options.viewWidth, options.viewWidth);
+        options.viewHeight = options.viewWidth;
+    }
+    return options;
+}
+
+
+
+
+
+// Loads the mesh of the first shape of an OBJ file
+Mesh LoadObjMesh(const std::string& path)
+{
+  tinyobj::ObjReader       reader;  // Used to read an OBJ file
+  reader.ParseFromFile(path);
+  assert(reader.Valid());  // Make sure tinyobj was able to parse this file
+
+  // Get the vertices and indices of the OBJ file
+  Mesh mesh;
+  mesh.vertices = reader.GetAttrib().GetVertices();
+  const std::vector<tinyobj::shape_t>& objShapes = reader.GetShapes();  // All shapes in the file
+  assert(objShapes.size() == 1);                                          // Check that this file has only one shape (the mesh formed by triangles)
+  const tinyobj::shape_t& objShape = objShapes[0];                        // Get the first shape
+  // Get the indices of the vertices of the first mesh of `objShape` in `attrib.vertices`:
+  mesh.indices.reserve(objShape.mesh.indices.size());
+  for (const tinyobj::index_t& index : objShape.mesh.indices)
+  {
+      mesh.indices.push_back(index.vertex_index);
+  }
+  // for (auto x : mesh.indices) printf("%d ", x);
+  // Get the material of each triangle; faces without a material (-1) use material 0:
+  mesh.numMaterials = static_cast<uint32_t>(std::max<size_t>(reader.GetMaterials().size(), 1));
+  mesh.materialIDs.reserve(objShape.mesh.material_ids.size());
+  for (const int materialID : objShape.mesh.material_ids)
+  {
+      mesh.materialIDs.push_back(static_cast<uint32_t>(std::max(materialID, 0)));
+  }
+  // So far, triangle i is triangle i of the file:
+  mesh.originalPrimitiveIDs.resize(mesh.numTriangles());
+  std::iota(mesh.originalPrimitiveIDs.begin(), mesh.originalPrimitiveIDs.end(), 0);
+  return mesh;
+}
+
+
+
+
+
+// Applies the optional preprocessing passes selected in `options` to `mesh`, before it is uploaded.
+void PreprocessMesh(Mesh& mesh, const Options& options)
+{
+  // Early split: subdivide triangles with huge bounding boxes, so that the BLAS can separate them better.
+  if (options.splitBudget > 0.0f)
+  {
+      const uint32_t numTrianglesBefore = mesh.numTriangles();
+      const uint32_t budget = static_cast<uint32_t>(options.splitBudget * float(numTrianglesBefore));
+      SplitLargeTriangles(mesh, options.splitThreshold, budget);
+      printf("Split large triangles: %u -> %u triangles (budget %u)\n", numTrianglesBefore, mesh.numTriangles(), budget);
+  }
+
+  // OBJ files list triangles and vertices in whatever order the exporter or scanner produced, so spatially
+  // neighbouring hits can read far-apart indices and vertices. Sorting them along a Morton curve makes
+  // neighbouring hits read neighbouring memory.
+  if (options.reorderMesh)
+  {
+      const uint32_t bytesPerIndex = (!options.forceIndex32 && CanUse16BitIndices(mesh)) ? 2 : 4;
+      const uint32_t bytesPerVertex = options.quantizeVertices ? 8 : 12;
+      const double hitRateBefore = SimulateHitLookupCacheHitRate(mesh, bytesPerIndex, bytesPerVertex);
+      ReorderForLocality(mesh);
+      const double hitRateAfter = SimulateHitLookupCacheHitRate(mesh, bytesPerIndex, bytesPerVertex);
+      printf("Reordered mesh: simulated cache hit rate of hit lookups %.1f%% -> %.1f%%\n", 100.0 * hitRateBefore, 100.0 * hitRateAfter);
+  }
+}
+
+
+
+
+
+// The GPU side of a mesh: the buffers the shader reads, and the acceleration structures built from them.
+struct GpuScene
+{
+  nvvk::Buffer               vertexBuffer, indexBuffer, primitiveBuffer, quantizedVertexBuffer;
+  nvvk::RaytracingBuilderKHR raytracingBuilder;
+  bool                       use16BitIndices = false;
+  double                     uploadMs = 0.0;  // Wall time of the upload of the buffers
+  double                     buildMs = 0.0;   // Wall time of the BLAS and TLAS builds
+};
+
+// Uploads `mesh` to the GPU, and builds a BLAS for it and a TLAS with `options.instances` instances of that BLAS.
+void CreateGpuScene(GpuScene& scene, nvvk::Context& context, nvvk::ResourceAllocatorDedicated& allocator, VkCommandPool cmdPool,
+                    const Mesh& mesh, const Options& options)
+{
+  // Optional preprocessing: precompute a PrimitiveRecord per triangle, so that each hit reads one record
+  // instead of 3 indices and 3 vertices. When the records aren't used, a single zeroed record is uploaded
+  // so that binding BINDING_PRIMITIVES always points to a valid buffer.
+  const bool                   buildShadingRecords = options.useShadingRecords || (options.benchmarkHitFetch > 0);
+  std::vector<PrimitiveRecord> primitiveRecords    = buildShadingRecords ? BuildPrimitiveRecords(mesh) : std::vector<PrimitiveRecord>(1);
+
+  // Geometry encoding: meshes with at most 65536 vertices get 16-bit indices, which halves the index buffer
+  // for both the BLAS build and the shader.
+  scene.use16BitIndices = !options.forceIndex32 && CanUse16BitIndices(mesh);
+  // Optionally, the shader reads vertex positions quantized to 16 bits per axis, relative to the mesh's
+  // bounding box. The layout of the buffer is {vec3 origin, vec3 scale, uvec2 packed[]}, see QuantizedPositions.
+  // The BLAS is still built from the exact float positions. When quantization is off, a zeroed placeholder
+  // with 1 vertex keeps binding BINDING_QUANTIZED_VERTICES valid.
+  std::vector<uint32_t> quantizedVertexWords(8, 0);
+  if (options.quantizeVertices)
+  {
+      const QuantizedPositions quantized = QuantizePositions(mesh);
+      quantizedVertexWords.resize(6);
+      memcpy(&quantizedVertexWords[0], quantized.origin, sizeof(quantized.origin));
+      memcpy(&quantizedVertexWords[3], quantized.scale, sizeof(quantized.scale));
+      quantizedVertexWords.insert(quantizedVertexWords.end(), quantized.packed.begin(), quantized.packed.end());
+  }
+
+  // Upload the vertex and index buffers to the GPU.
+  {
+      const auto uploadStart = std::chrono::steady_clock::now();
+      // Start a command buffer for uploading the buffers
+      VkCommandBuffer uploadCmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+
+      // We get these buffers' device addresses, and use them as storage buffers and build inputs.
+      const VkBufferUsageFlags usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+          | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+
+      scene.vertexBuffer = allocator.createBuffer(uploadCmdBuffer, mesh.vertices, usage);
+      if (scene.use16BitIndices)
+      {
+          scene.indexBuffer = allocator.createBuffer(uploadCmdBuffer, EncodeIndices16(mesh), usage);
+      }
+      else
+      {
+          scene.indexBuffer = allocator.createBuffer(uploadCmdBuffer, mesh.indices, usage);
+      }
+      // The shading records and quantized vertices are only read by the shader, not by the acceleration structure build:
+      scene.primitiveBuffer = allocator.createBuffer(uploadCmdBuffer, primitiveRecords, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+      scene.quantizedVertexBuffer = allocator.createBuffer(uploadCmdBuffer, quantizedVertexWords, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	  // End the command buffer, submit it, and wait for it to finish
+      EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, uploadCmdBuffer);
+      // Free the memory of the allocator: the allocator also allocates some temporary staging memory to perform these uploads to GPU-local memory
+      allocator.finalizeAndReleaseStaging();
+      scene.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+
+      const size_t indexBytes = mesh.indices.size() * (scene.use16BitIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+      printf("Geometry: %u vertices, %u triangles; %s indices (%zu KiB)", mesh.numVertices(), mesh.numTriangles(),
+             scene.use16BitIndices ? "16-bit" : "32-bit", indexBytes / 1024);
+      if (options.quantizeVertices)
+      {
+          printf("; shading vertices %zu KiB quantized instead of %zu KiB", quantizedVertexWords.size() * sizeof(uint32_t) / 1024,
+                 mesh.vertices.size() * sizeof(float) / 1024);
+      }
+      printf("\n");
+  }
+
+  // Describe the bottom-level acceleration structure (BLAS)
+  std::vector<nvvk::RaytracingBuilderKHR::BlasInput> blases;
+  {
+      nvvk::RaytracingBuilderKHR::BlasInput blas;
+      // Get the device addresses of the vertex and index buffers
+      VkDeviceAddress vertexBufferAddress = GetBufferDeviceAddress(context, scene.vertexBuffer.buffer);
+      VkDeviceAddress indexBufferAddress = GetBufferDeviceAddress(context, scene.indexBuffer.buffer);
+      // Specify where the builder can find the vertices and indices for triangles, and their formats:
+      VkAccelerationStructureGeometryTrianglesDataKHR triangles{
+          .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+          .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+          .vertexData = {.deviceAddress = vertexBufferAddress},
+          .vertexStride = 3 * sizeof(float),
+          .maxVertex = mesh.numVertices() - 1,
+          .indexType = scene.use16BitIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32,
+          .indexData = {.deviceAddress = indexBufferAddress},
+          .transformData = {.deviceAddress = 0}  // No transform
+  };
+  
+   // Create a VkAccelerationStructureGeometryKHR object that says it handles opaque triangles and points to the above:
+   VkAccelerationStructureGeometryKHR geometry{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                                               .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+                                               .geometry = {.triangles = triangles},
+                                               .flags = VK_GEOMETRY_OPAQUE_BIT_KHR };
+   blas.asGeometry.push_back(geometry);
+   // Create offset info that allows us to say how many triangles and vertices to read
+   VkAccelerationStructureBuildRangeInfoKHR offsetInfo{
+       .primitiveCount = mesh.numTriangles(),  // Number of triangles
+       .primitiveOffset = 0,                                             // Offset added when looking up triangles
+       .firstVertex = 0,  // Offset added when looking up vertices in the vertex buffer
+       .transformOffset = 0   // Offset added when looking up transformation matrices, if we used them
+   };
+   blas.asBuildOffsetInfo.push_back(offsetInfo);
+   blases.push_back(blas);
+  }
+  // Create the BLAS
+  const auto buildStart = std::chrono::steady_clock::now();
+  scene.raytracingBuilder.setup(context, &allocator, context.m_queueGCT);
+  scene.raytracingBuilder.buildBlas(blases, options.blasBuildFlags);
+
+  // Create the instances pointing to this BLAS (one, with the identity transform, unless --instances asks for more),
+  // and build them into a TLAS:
+  std::vector<VkAccelerationStructureInstanceKHR> instances;
+  for (const std::array<float, 12>& transform : InstanceGridTransforms(ComputeBounds(mesh), options.instances))
+  {
+      VkAccelerationStructureInstanceKHR instance{};
+      instance.accelerationStructureReference = scene.raytracingBuilder.getBlasDeviceAddress(0);  // The address of the BLAS in `blases` that this instance points to
+      memcpy(instance.transform.matrix, transform.data(), sizeof(instance.transform.matrix));
+      instance.instanceCustomIndex = 0;  // 24 bits accessible to ray shaders via rayQueryGetIntersectionInstanceCustomIndexEXT
+      // Used for a shader offset index, accessible via rayQueryGetIntersectionInstanceShaderBindingTableRecordOffsetEXT
+      instance.instanceShaderBindingTableRecordOffset = 0;
+      instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;  // How to trace this instance
+      instance.mask = 0xFF;
+      instances.push_back(instance);
+  }
+  scene.raytracingBuilder.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+  scene.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+  // A built BLAS doesn't reference its input buffers anymore. So when the shader reads quantized vertices,
+  // nothing uses the float positions from now on, and we can free them to reduce the GPU memory footprint.
+  if (options.quantizeVertices)
+  {
+      allocator.destroy(scene.vertexBuffer);
+      scene.vertexBuffer = nvvk::Buffer();
+  }
+}
+
+void DestroyGpuScene(GpuScene& scene, nvvk::ResourceAllocatorDedicated& allocator)
+{
+  scene.raytracingBuilder.destroy();
+  if (scene.vertexBuffer.buffer != VK_NULL_HANDLE)
+  {
+      allocator.destroy(scene.vertexBuffer);
+  }
+  allocator.destroy(scene.indexBuffer);
+  allocator.destroy(scene.primitiveBuffer);
+  allocator.destroy(scene.quantizedVertexBuffer);
+  scene = GpuScene();
+}
+
+// Points the TLAS and mesh descriptors (bindings 1 to 5) of the descriptor set at `scene`.
+void WriteSceneDescriptors(VkDevice device, const nvvk::DescriptorSetContainer& descriptorSetContainer, const GpuScene& scene)
+{
+  // Make this descriptor in the descriptor set point to the TLAS
+  // Add storage buffer descriptors 2 and 3 for the vertex and index buffers: read mesh data from triangle intersections (triangle vertices)
+  std::array<VkWriteDescriptorSet, 5> writeDescriptorSets;
+  // 1
+  VkAccelerationStructureKHR tlasCopy = scene.raytracingBuilder.getAccelerationStructure();  // So that we can take its address
+  VkWriteDescriptorSetAccelerationStructureKHR descriptorAS{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+                                                            .accelerationStructureCount = 1,
+                                                            .pAccelerationStructures = &tlasCopy };
+  writeDescriptorSets[0] = descriptorSetContainer.makeWrite(0, BINDING_TLAS, &descriptorAS);
+  // 2 (never read when the vertices are quantized; then the float vertices were freed, so it points to the quantized vertices instead)
+  const bool hasFloatVertices = (scene.vertexBuffer.buffer != VK_NULL_HANDLE);
+  VkDescriptorBufferInfo vertexDescriptorBufferInfo{ .buffer = hasFloatVertices ? scene.vertexBuffer.buffer : scene.quantizedVertexBuffer.buffer,
+                                                    .range = VK_WHOLE_SIZE };
+  writeDescriptorSets[1] = descriptorSetContainer.makeWrite(0, BINDING_VERTICES, &vertexDescriptorBufferInfo);
+  // 3
+  VkDescriptorBufferInfo indexDescriptorBufferInfo{ .buffer = scene.indexBuffer.buffer, .range = VK_WHOLE_SIZE };
+  writeDescriptorSets[2] = descriptorSetContainer.makeWrite(0, BINDING_INDICES, &indexDescriptorBufferInfo);
+  // 4
+  VkDescriptorBufferInfo primitiveDescriptorBufferInfo{ .buffer = scene.primitiveBuffer.buffer, .range = VK_WHOLE_SIZE };
+  writeDescriptorSets[3] = descriptorSetContainer.makeWrite(0, BINDING_PRIMITIVES, &primitiveDescriptorBufferInfo);
+  // 5
+  VkDescriptorBufferInfo quantizedVertexDescriptorBufferInfo{ .buffer = scene.quantizedVertexBuffer.buffer, .range = VK_WHOLE_SIZE };
+  writeDescriptorSets[4] = descriptorSetContainer.makeWrite(0, BINDING_QUANTIZED_VERTICES, &quantizedVertexDescriptorBufferInfo);
+  vkUpdateDescriptorSets(device,                                            // The device
+      static_cast<uint32_t>(writeDescriptorSets.size()),                    // Number of VkWriteDescriptorSet objects
+      writeDescriptorSets.data(),                                           // Pointer to VkWriteDescriptorSet objects
+      0, nullptr);                                                          // An array of VkCopyDescriptorSet objects (unused)
+}
+
+// Returns the specialization constants of raytrace.comp.glsl for rendering `scene` with `options`.
+// The benchmarks use these as they are, so adaptive sampling is switched on separately for the final render.
+SpecConstants GetSpecConstants(const GpuScene& scene, const Options& options)
+{
+  SpecConstants specConstants{};
+  specConstants[SPEC_HIT_FETCH_MODE] = options.useShadingRecords ? HIT_FETCH_RECORDS : HIT_FETCH_INDEXED;
+  specConstants[SPEC_INDEX_16BIT] = scene.use16BitIndices ? 1 : 0;
+  specConstants[SPEC_QUANTIZED_VERTICES] = options.quantizeVertices ? 1 : 0;
+  specConstants[SPEC_SAMPLER] = options.sampler;
+  specConstants[SPEC_PIXEL_SWIZZLE] = options.pixelSwizzle;
+  specConstants[SPEC_SAMPLE_SPLIT] = 1;
+  return specConstants;
+}
+
+// Returns the device-local memory this process uses, from VK_EXT_memory_budget, or 0 if the device doesn't support it.
+uint64_t DeviceMemoryUsage(const nvvk::Context& context)
+{
+  if (!context.hasDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+  {
+      return 0;
+  }
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+  VkPhysicalDeviceMemoryProperties2 properties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2, .pNext = &budget };
+  vkGetPhysicalDeviceMemoryProperties2(context.m_physicalDevice, &properties);
+  uint64_t usage = 0;
+  for (uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; i++)
+  {
+      if ((properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0)
+      {
+          usage += budget.heapUsage[i];
+      }
+  }
+  return usage;
+}
+
+// Returns the average GPU time of `repetitions` dispatches of `pipeline`, after one warm-up dispatch.
+double BenchmarkDispatch(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+                         VkDescriptorSet descriptorSet, VkQueryPool queryPool, float timestampPeriod, int repetitions)
+{
+  DispatchAndTime(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod);  // Warm-up
+  double totalMs = 0.0;
+  for (int i = 0; i < repetitions; i++)
+  {
+      totalMs += DispatchAndTime(device, queue, cmdPool, pipeline, pipelineLayout, descriptorSet, queryPool, timestampPeriod);
+  }
+  return totalMs / repetitions;
+}
+
+
+
+
+
+// What the render modes and benchmarks of main() share: the Vulkan objects main() creates once, the descriptor set of
+// raytrace.comp.glsl that points at its buffers and `scene`, and the pipeline of the final render. The functions below
+// that swap something in the descriptor set put the original back before they return.
+struct Renderer
+{
+    nvvk::Context&                      context;
+    nvvk::ResourceAllocatorDedicated&   allocator;
+    VkCommandPool                       cmdPool;
+    VkQueryPool                         queryPool;  // 2 timestamps, around each dispatch
+    float                               timestampPeriod;
+    const nvvk::DescriptorSetContainer& descriptorSetContainer;  // Of raytrace.comp.glsl
+    VkDescriptorSet                     descriptorSet;
+    VkShaderModule                      rayTraceModule;      // Writes an rgba32f output image
+    VkShaderModule                      rayTraceHalfModule;  // Writes an rgba16f output image
+    const GpuScene&                     scene;
+    const OutputImage&                  outputImage;
+    nvvk::Buffer                        buffer;  // The image, 3 floats per pixel, or the ring of tiles with --tiled
+    nvvk::Buffer                        accumulationBuffer;
+    nvvk::Buffer                        activeTilesBuffer;
+    nvvk::Buffer                        rayCountBuffer;
+    TileGrid                            tileGrid;
+    uint32_t                            persistentWorkgroups;
+    SpecConstants                       renderConstants;  // Of renderPipeline
+    VkPipeline                          renderPipeline = VK_NULL_HANDLE;
+    const nvvk::DescriptorSetContainer& denoiseDescriptorSetContainer;
+    VkPipeline                          denoisePipeline;
+
+    VkPipelineLayout pipelineLayout() const { return descriptorSetContainer.getPipeLayout(); }
+
+    // Creates a pipeline of raytrace.comp.glsl with `specConstants`, from the module of the output image's format
+    VkPipeline createPipeline(const SpecConstants& specConstants, VkFormat imageFormat = VK_FORMAT_R32G32B32A32_SFLOAT) const
+    {
+        return CreateComputePipeline(context, (imageFormat == VK_FORMAT_R16G16B16A16_SFLOAT) ? rayTraceHalfModule : rayTraceModule,
+                                     pipelineLayout(), specConstants);
+    }
+
+    // DispatchAndTime, BenchmarkDispatch and RenderTiles with the descriptor set of raytrace.comp.glsl
+    double dispatchAndTime(VkPipeline pipeline, const PushConstants& pushConstants, uint32_t groupCountX, uint32_t groupCountY,
+                           uint32_t groupCountZ = 1) const
+    {
+        return DispatchAndTime(context, context.m_queueGCT, cmdPool, pipeline, pipelineLayout(), descriptorSet, queryPool, timestampPeriod,
+                               pushConstants, groupCountX, groupCountY, groupCountZ);
+    }
+    double benchmarkDispatch(VkPipeline pipeline, int repetitions) const
+    {
+        return BenchmarkDispatch(context, context.m_queueGCT, cmdPool, pipeline, pipelineLayout(), descriptorSet, queryPool, timestampPeriod,
+                                 repetitions);
+    }
+    double renderTiles(VkPipeline pipeline, uint32_t* activeTilesData, const std::vector<uint32_t>& tiles, uint32_t firstSample,
+                       uint32_t sampleCount) const
+    {
+        return RenderTiles(context, context.m_queueGCT, cmdPool, pipeline, pipelineLayout(), descriptorSet, queryPool, timestampPeriod,
+                           activeTilesData, tiles, firstSample, sampleCount);
+    }
+
+    // The workgroups of a batch of renderPipeline over `tileCount` tiles: tileGroupCount x 1 x tileGroupCountZ, i.e.
+    // one per tile and share of its samples, or the persistent workgroups that take those from the work counter
+    uint32_t tileGroupCount(uint32_t tileCount) const
+    {
+        return renderConstants[SPEC_PERSISTENT_THREADS] ? std::min(persistentWorkgroups, tileCount * renderConstants[SPEC_SAMPLE_SPLIT])
+                                                        : tileCount;
+    }
+    uint32_t tileGroupCountZ() const { return renderConstants[SPEC_PERSISTENT_THREADS] ? 1 : renderConstants[SPEC_SAMPLE_SPLIT]; }
+};
+
+// Hit fetch benchmark: compares the index/vertex path of getObjectHitInfo against the precomputed shading records, using
+// the same scene and descriptor set. Each mode gets one warm-up dispatch, then the average of `options.benchmarkHitFetch`
+// dispatches.
+void BenchmarkHitFetch(const Renderer& renderer, const Options& options)
+{
+    const std::array<std::pair<uint32_t, const char*>, 2> modes = { { { HIT_FETCH_INDEXED, "indexed (3 index + 3 vertex loads)" },
+                                                                     { HIT_FETCH_RECORDS, "shading records (1 record load)" } } };
+    for (const auto& [mode, name] : modes)
+    {
+        SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+        benchmarkConstants[SPEC_HIT_FETCH_MODE] = mode;
+        VkPipeline   benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+        const double ms = renderer.benchmarkDispatch(benchmarkPipeline, options.benchmarkHitFetch);
+        printf("Hit fetch %-36s %9.3f ms/dispatch (%d dispatches)\n", name, ms, options.benchmarkHitFetch);
+        vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+    }
+}
+
+// Output layout benchmark: compares writing the color to the scalar vec3 buffer (unaligned 12-byte stores, scanline
+// order) against rgba32f and rgba16f storage images with optimal tiling. Each image format gets its own full-size
+// image, which temporarily replaces the output image in the descriptor set.
+void BenchmarkOutputLayouts(const Renderer& renderer, const Options& options)
+{
+    const std::array<std::pair<VkFormat, const char*>, 3> layouts = { { { VK_FORMAT_UNDEFINED, "vec3 buffer (12 B/pixel)" },
+                                                                       { VK_FORMAT_R32G32B32A32_SFLOAT, "rgba32f image (16 B/pixel)" },
+                                                                       { VK_FORMAT_R16G16B16A16_SFLOAT, "rgba16f image (8 B/pixel)" } } };
+    for (const auto& [format, name] : layouts)
+    {
+        const bool  isImage = (format != VK_FORMAT_UNDEFINED);
+        OutputImage benchmarkImage;
+        if (isImage)
+        {
+            benchmarkImage = CreateOutputImage(renderer.context, renderer.allocator, renderer.cmdPool, renderer.context.m_queueGCT, format,
+                                               uint32_t(render_width), uint32_t(render_height));
+            WriteOutputImageDescriptor(renderer.context, renderer.descriptorSetContainer, benchmarkImage);
+        }
+        SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+        benchmarkConstants[SPEC_OUTPUT_IMAGE] = isImage ? 1 : 0;
+        VkPipeline   benchmarkPipeline = renderer.createPipeline(benchmarkConstants, format);
+        const double ms = renderer.benchmarkDispatch(benchmarkPipeline, options.benchmarkOutput);
+        printf("Output %-30s %9.3f ms/dispatch (%d dispatches)\n", name, ms, options.benchmarkOutput);
+        vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+        if (isImage)
+        {
+            DestroyOutputImage(renderer.context, renderer.allocator, benchmarkImage);
+        }
+    }
+    WriteOutputImageDescriptor(renderer.context, renderer.descriptorSetContainer, renderer.outputImage);
+}
+
+// Swizzle benchmark: compares the pixel swizzles (see common.h): with primary rays only, whose coherence they change
+// most, and with whole paths, where the diffuse bounces after the first hit are incoherent whatever the swizzle.
+void BenchmarkSwizzles(const Renderer& renderer, const Options& options)
+{
+    const auto benchmarkSwizzle = [&](uint32_t swizzle, uint32_t primaryRaysOnly) {
+        SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+        benchmarkConstants[SPEC_PIXEL_SWIZZLE] = swizzle;
+        benchmarkConstants[SPEC_PRIMARY_RAYS_ONLY] = primaryRaysOnly;
+        VkPipeline   benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+        const double ms = renderer.benchmarkDispatch(benchmarkPipeline, options.benchmarkSwizzle);
+        vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+        return ms;
+    };
+    printf("%-10s %22s %22s\n", "swizzle", "primary rays ms/disp.", "paths ms/disp.");
+    for (uint32_t swizzle = 0; swizzle < uint32_t(std::size(swizzle_names)); swizzle++)
+    {
+        const double primaryMs = benchmarkSwizzle(swizzle, 1);
+        const double pathsMs = benchmarkSwizzle(swizzle, 0);
+        printf("%-10s %22.3f %22.3f\n", swizzle_names[swizzle], primaryMs, pathsMs);
+    }
+}
+
+// Persistent threads benchmark: compares the grid of one workgroup per tile against persistent workgroups that take
+// tiles from a counter. Each runs alone, and `options.benchmarkPersistent` times back to back, where the GPU can start
+// the next dispatch while the last workgroups of the previous one still run. The difference is the tail: the time at
+// the end of a dispatch when the GPU is only partly busy with its slowest workgroups. (It reads 0 if the driver
+// serializes the dispatches.)
+void BenchmarkPersistentThreads(const Renderer& renderer, const Options& options)
+{
+    printf("%-38s %12s %18s %20s\n", "dispatch", "alone ms", "back to back ms", "tail ms");
+    for (uint32_t persistent = 0; persistent < 2; persistent++)
+    {
+        SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+        benchmarkConstants[SPEC_PERSISTENT_THREADS] = persistent;
+        VkPipeline     benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+        const uint32_t groupCountX = persistent ? renderer.persistentWorkgroups : (uint32_t(render_width) + workgroup_width - 1) / workgroup_width;
+        const uint32_t groupCountY = persistent ? 1 : (uint32_t(render_height) + workgroup_height - 1) / workgroup_height;
+        const auto     dispatchAlone = [&]() {
+            return renderer.dispatchAndTime(benchmarkPipeline, WholeImagePushConstants(), groupCountX, groupCountY);
+        };
+        dispatchAlone();  // Warm-up
+        double aloneMs = 0.0;
+        for (int i = 0; i < options.benchmarkPersistent; i++)
+        {
+            aloneMs += dispatchAlone() / options.benchmarkPersistent;
+        }
+        const double backToBackMs = DispatchBackToBackAndTime(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool,
+                                                              benchmarkPipeline, renderer.pipelineLayout(), renderer.descriptorSet,
+                                                              renderer.queryPool, renderer.timestampPeriod, WholeImagePushConstants(),
+                                                              groupCountX, groupCountY, uint32_t(options.benchmarkPersistent));
+        char name[64];
+        snprintf(name, sizeof(name), "%s (%u workgroups)", persistent ? "persistent threads" : "one workgroup per tile", groupCountX * groupCountY);
+        printf("%-38s %12.3f %18.3f %11.3f (%4.1f%%)\n", name, aloneMs, backToBackMs, aloneMs - backToBackMs,
+               100.0 * (aloneMs - backToBackMs) / aloneMs);
+        vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+    }
+}
+
+// Sample split benchmark: renders square images of thumbnail sizes (into the start of the image buffer) with each
+// sample split, to show how splitting the samples of each pixel fills the GPU when one invocation per pixel doesn't,
+// and which split ChooseSampleSplit picks for each size.
+void BenchmarkSampleSplits(const Renderer& renderer, const Options& options)
+{
+    const uint32_t concurrentInvocations = DefaultPersistentWorkgroups(renderer.context.m_physicalDevice) * workgroup_width * workgroup_height;
+    std::vector<VkPipeline> splitPipelines;
+    printf("%-10s", "size");
+    for (uint32_t split = 1; split <= MAX_SAMPLE_SPLIT; split *= 2)
+    {
+        SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+        benchmarkConstants[SPEC_SAMPLE_SPLIT] = split;
+        splitPipelines.push_back(renderer.createPipeline(benchmarkConstants));
+        char name[32];
+        snprintf(name, sizeof(name), "split %u ms", split);
+        printf(" %13s", name);
+    }
+    printf(" %6s\n", "auto");
+    for (const uint32_t size : { 32u, 64u, 128u, 256u })
+    {
+        const PushConstants pushConstants{ .imageWidth = size, .imageHeight = size, .tileWidth = size, .tileHeight = size };
+        const uint32_t groupCountX = (size + workgroup_width - 1) / workgroup_width;
+        const uint32_t groupCountY = (size + workgroup_height - 1) / workgroup_height;
+        char name[32];
+        snprintf(name, sizeof(name), "%ux%u", size, size);
+        printf("%-10s", name);
+        for (size_t i = 0; i < splitPipelines.size(); i++)
+        {
+            const auto dispatch = [&]() { return renderer.dispatchAndTime(splitPipelines[i], pushConstants, groupCountX, groupCountY, 1u << i); };
+            dispatch();  // Warm-up
+            double ms = 0.0;
+            for (int repetition = 0; repetition < options.benchmarkSampleSplit; repetition++)
+            {
+                ms += dispatch() / options.benchmarkSampleSplit;
+            }
+            printf(" %13.3f", ms);
+        }
+        printf(" %6u\n", ChooseSampleSplit(uint64_t(size) * size, 64, concurrentInvocations));
+    }
+    for (VkPipeline pipeline : splitPipelines)
+    {
+        vkDestroyPipeline(renderer.context, pipeline, nullptr);
+    }
+}
+
+// Split benchmark: renders `sourceMesh` with a sweep of split budgets, to show how the dispatch time (dominated by BVH
+// traversal) changes as large triangles are split into more, smaller ones. Each budget gets its own GPU scene, which
+// temporarily replaces the scene in the descriptor set.
+void BenchmarkSplitBudgets(const Renderer& renderer, const Options& options, const Mesh& sourceMesh)
+{
+    printf("%12s %10s %10s %14s\n", "split budget", "triangles", "growth", "ms/dispatch");
+    for (const float budget : { 0.0f, 0.1f, 0.25f, 0.5f, 1.0f, 2.0f })
+    {
+        Options sweepOptions = options;
+        sweepOptions.splitBudget = budget;
+        Mesh sweepMesh = sourceMesh;
+        PreprocessMesh(sweepMesh, sweepOptions);
+
+        GpuScene sweepScene;
+        CreateGpuScene(sweepScene, renderer.context, renderer.allocator, renderer.cmdPool, sweepMesh, sweepOptions);
+        WriteSceneDescriptors(renderer.context, renderer.descriptorSetContainer, sweepScene);
+        VkPipeline   sweepPipeline = renderer.createPipeline(GetSpecConstants(sweepScene, sweepOptions));
+        const double ms = renderer.benchmarkDispatch(sweepPipeline, options.benchmarkSplit);
+        printf("%12.2f %10u %9.1f%% %14.3f\n", budget, sweepMesh.numTriangles(),
+               100.0 * (double(sweepMesh.numTriangles()) / sourceMesh.numTriangles() - 1.0), ms);
+        vkDestroyPipeline(renderer.context, sweepPipeline, nullptr);
+        DestroyGpuScene(sweepScene, renderer.allocator);
+    }
+    WriteSceneDescriptors(renderer.context, renderer.descriptorSetContainer, renderer.scene);
+}
+// Traversal benchmark: traces one ray per pixel of `mesh` without shading, sampling or bounces (see
+// SPEC_TRAVERSAL_RAYS), so that the time is that of rayQueryProceedEXT: camera rays, then random rays from the scene
+// bounds from incoherent to coherent ones, for each way of building the BLAS. The number of hits and the sum of their
+// distances are a checksum of the rays, which must be the same for each build. A slowdown here is in traversal; one
+// that only shows in renders is in shading. Each build gets its own GPU scene, which temporarily replaces the scene in
+// the descriptor set; its memory is the growth of the device memory use (0 without VK_EXT_memory_budget).
+void BenchmarkTraversal(const Renderer& renderer, const Options& options, const Mesh& mesh)
+{
+    struct BlasBuild
+    {
+        const char*                          name;
+        VkBuildAccelerationStructureFlagsKHR flags;
+    };
+    const BlasBuild builds[] = {
+        { "fast trace", VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR },
+        { "fast trace, compacted",
+          VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR },
+        { "fast build", VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR },
+    };
+    // The rays: camera rays, and random rays of each coherence
+    const float  coherences[] = { -1.0f, 0.0f, 0.5f, 0.9f, 0.99f };  // -1: camera rays
+    const Aabb   bounds = ComputeBounds(mesh);
+    const size_t numFloats = size_t(render_width) * render_height * 3;
+    printf("Traversal (%u x %u rays):\n%-22s %9s %11s %-16s %12s %10s %10s %16s\n", uint32_t(render_width), uint32_t(render_height), "blas", "build ms",
+           "scene MiB", "rays", "ms/dispatch", "Mrays/s", "hits", "sum of hit t");
+    for (const BlasBuild& build : builds)
+    {
+        Options sweepOptions = options;
+        sweepOptions.blasBuildFlags = build.flags;
+        const uint64_t memoryBefore = DeviceMemoryUsage(renderer.context);
+        GpuScene       sweepScene;
+        CreateGpuScene(sweepScene, renderer.context, renderer.allocator, renderer.cmdPool, mesh, sweepOptions);
+        const uint64_t memoryAfter = DeviceMemoryUsage(renderer.context);
+        const uint64_t sceneBytes = memoryAfter - std::min(memoryBefore, memoryAfter);
+        WriteSceneDescriptors(renderer.context, renderer.descriptorSetContainer, sweepScene);
+
+        for (const float coherence : coherences)
+        {
+            SpecConstants benchmarkConstants = GetSpecConstants(sweepScene, sweepOptions);
+            benchmarkConstants[SPEC_TRAVERSAL_RAYS] = (coherence < 0.0f) ? TRAVERSAL_CAMERA : TRAVERSAL_RANDOM;
+            VkPipeline    benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+            PushConstants pushConstants = WholeImagePushConstants();
+            std::copy(bounds.min, bounds.min + 3, pushConstants.sceneMin);
+            std::copy(bounds.max, bounds.max + 3, pushConstants.sceneMax);
+            pushConstants.rayCoherence = std::max(coherence, 0.0f);
+            const auto dispatch = [&]() {
+                return renderer.dispatchAndTime(benchmarkPipeline, pushConstants, (uint32_t(render_width) + workgroup_width - 1) / workgroup_width,
+                                                (uint32_t(render_height) + workgroup_height - 1) / workgroup_height);
+            };
+            dispatch();  // Warm-up
+            double ms = 0.0;
+            for (int repetition = 0; repetition < options.benchmarkTraversal; repetition++)
+            {
+                ms += dispatch() / options.benchmarkTraversal;
+            }
+
+            const std::vector<float> distances = CopyBufferFloats(renderer.allocator, renderer.buffer, numFloats);
+            uint32_t hits = 0;
+            double   distanceSum = 0.0;
+            for (size_t i = 0; i < distances.size(); i += 3)
+            {
+                hits += (distances[i] < float(AOV_NO_HIT_DEPTH)) ? 1 : 0;
+                distanceSum += (distances[i] < float(AOV_NO_HIT_DEPTH)) ? distances[i] : 0.0;
+            }
+            char rays[32] = "camera";
+            if (coherence >= 0.0f)
+            {
+                snprintf(rays, sizeof(rays), "random, coh. %.2f", coherence);
+            }
+            printf("%-22s %9.1f %11.1f %-16s %12.3f %10.1f %10u %16.4f\n", build.name, sweepScene.buildMs, double(sceneBytes) / (1024.0 * 1024.0),
+                   rays, ms, double(render_width) * render_height / (ms * 1000.0), hits, distanceSum);
+            vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+        }
+        DestroyGpuScene(sweepScene, renderer.allocator);
+    }
+    WriteSceneDescriptors(renderer.context, renderer.descriptorSetContainer, renderer.scene);
+}
+
+// Sampler benchmark: compares how fast the PCG and Sobol samplers converge: renders a reference image with many
+// samples, then 1, 2, 4, ... `options.benchmarkSampler` spp with each sampler, and prints the RMSE against the
+// reference (and writes it to sampler_convergence.csv). The reference uses sample indices no test image uses, so that
+// its noise is independent of theirs.
+void BenchmarkSamplers(const Renderer& renderer, const Options& options)
+{
+    const uint32_t referenceSamples = std::max(1024u, 16u * uint32_t(options.benchmarkSampler));
+    const uint32_t referenceFirstSample = 1u << 24;
+    const size_t   numFloats = size_t(render_width) * render_height * 3;
+    uint32_t*      activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+
+    const auto renderImage = [&](uint32_t sampler, uint32_t firstSample, uint32_t sampleCount) {
+        SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+        benchmarkConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+        benchmarkConstants[SPEC_SAMPLER] = sampler;
+        VkPipeline benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+        renderer.renderTiles(benchmarkPipeline, activeTilesData, AllTiles(renderer.tileGrid), firstSample, sampleCount);
+        vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+        return CopyBufferFloats(renderer.allocator, renderer.buffer, numFloats);
+    };
+
+    const std::vector<float> reference = renderImage(SAMPLER_SOBOL, referenceFirstSample, referenceSamples);
+    FILE* csv = fopen("sampler_convergence.csv", "w");
+    if (csv != nullptr)
+    {
+        fprintf(csv, "spp,rmse_pcg,rmse_sobol\n");
+    }
+    printf("Sampler convergence (RMSE against %u spp):\n%8s %12s %12s %8s\n", referenceSamples, "spp", "pcg", "sobol", "ratio");
+    for (uint32_t spp = 1; spp <= uint32_t(options.benchmarkSampler); spp *= 2)
+    {
+        const double rmsePcg = ComputeRmse(renderImage(SAMPLER_PCG, 0, spp).data(), reference.data(), numFloats);
+        const double rmseSobol = ComputeRmse(renderImage(SAMPLER_SOBOL, 0, spp).data(), reference.data(), numFloats);
+        printf("%8u %12.6f %12.6f %8.2f\n", spp, rmsePcg, rmseSobol, rmsePcg / std::max(rmseSobol, 1e-12));
+        if (csv != nullptr)
+        {
+            fprintf(csv, "%u,%.8f,%.8f\n", spp, rmsePcg, rmseSobol);
+        }
+    }
+    if (csv != nullptr)
+    {
+        fclose(csv);
+    }
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+}
+
+// Denoiser benchmark: compares a denoised 8 spp image against 8 and 64 spp without the denoiser: GPU time, and RMSE
+// against a 1024 spp reference.
+void BenchmarkDenoiser(const Renderer& renderer, const Options& options)
+{
+    const size_t  numFloats = size_t(render_width) * render_height * 3;
+    uint32_t*     activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+    SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+    benchmarkConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+    benchmarkConstants[SPEC_AOV_MASK] = AOV_ALBEDO | AOV_NORMAL;
+    VkPipeline benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+    const auto render = [&](uint32_t firstSample, uint32_t sampleCount) {
+        return renderer.renderTiles(benchmarkPipeline, activeTilesData, AllTiles(renderer.tileGrid), firstSample, sampleCount);
+    };
+
+    render(1u << 24, 1024);
+    const std::vector<float> reference = CopyBufferFloats(renderer.allocator, renderer.buffer, numFloats);
+    const auto rmse = [&]() { return ComputeRmse(CopyBufferFloats(renderer.allocator, renderer.buffer, numFloats).data(), reference.data(), numFloats); };
+
+    const double ms64 = render(0, 64);
+    const double rmse64 = rmse();
+    const double ms8 = render(0, 8);
+    const double rmse8 = rmse();
+    const double msDenoise = DenoiseAndTime(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, renderer.denoisePipeline,
+                                            renderer.denoiseDescriptorSetContainer, uint32_t(options.denoiseIterations), renderer.queryPool,
+                                            renderer.timestampPeriod);
+    const double rmseDenoised = rmse();
+    printf("Denoiser (RMSE against 1024 spp):\n");
+    printf("  %-28s %9.3f ms  RMSE %.6f\n", "8 spp", ms8, rmse8);
+    printf("  %-28s %9.3f ms  RMSE %.6f  (denoiser %.3f ms, %d iterations)\n", "8 spp + denoiser", ms8 + msDenoise, rmseDenoised,
+           msDenoise, options.denoiseIterations);
+    printf("  %-28s %9.3f ms  RMSE %.6f\n", "64 spp", ms64, rmse64);
+
+    vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+}
+
+// End-to-end benchmark: counts the rays of one render of all tiles at `options.benchmarkSpp` samples per pixel, then
+// times `options.benchmarkWarmup` untimed and `options.benchmarkRepeat` timed renders without counting, and writes the
+// times with those of loading `mesh` (`loadMs`) and building the acceleration structures to `options.benchmarkJson`.
+void BenchmarkEndToEnd(const Renderer& renderer, const Options& options, const Mesh& mesh, double loadMs)
+{
+    uint32_t*     activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+    SpecConstants benchmarkConstants = GetSpecConstants(renderer.scene, options);
+    benchmarkConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+    SpecConstants countConstants = benchmarkConstants;
+    countConstants[SPEC_COUNT_RAYS] = 1;
+    VkPipeline                  benchmarkPipeline = renderer.createPipeline(benchmarkConstants);
+    VkPipeline                  countPipeline = renderer.createPipeline(countConstants);
+    const std::vector<uint32_t> tiles = AllTiles(renderer.tileGrid);
+    const auto render = [&](VkPipeline pipeline) { return renderer.renderTiles(pipeline, activeTilesData, tiles, 0, uint32_t(options.benchmarkSpp)); };
+
+    BenchmarkResult result{ .scene = options.scene,
+                            .triangles = mesh.numTriangles(),
+                            .instances = options.instances,
+                            .width = uint32_t(render_width),
+                            .height = uint32_t(render_height),
+                            .spp = uint32_t(options.benchmarkSpp),
+                            .warmup = uint32_t(options.benchmarkWarmup),
+                            .loadMs = loadMs,
+                            .uploadMs = renderer.scene.uploadMs,
+                            .buildMs = renderer.scene.buildMs };
+    uint64_t  peakDeviceBytes = DeviceMemoryUsage(renderer.context);
+    uint32_t* rayCount = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.rayCountBuffer));  // Low word, high word
+    rayCount[0] = rayCount[1] = 0;
+    render(countPipeline);
+    result.rays = (uint64_t(rayCount[1]) << 32) | rayCount[0];
+    renderer.allocator.unmap(renderer.rayCountBuffer);
+    for (int i = 0; i < options.benchmarkWarmup; i++)
+    {
+        render(benchmarkPipeline);
+    }
+    for (int i = 0; i < options.benchmarkRepeat; i++)
+    {
+        result.renderMs.push_back(render(benchmarkPipeline));
+        peakDeviceBytes = std::max(peakDeviceBytes, DeviceMemoryUsage(renderer.context));
+    }
+    result.peakDeviceBytes = peakDeviceBytes;
+    result.peakHostBytes = PeakHostMemoryBytes();
+
+    // The median, as in the JSON
+    const double medianMs = MedianRenderMs(result);
+    printf("Benchmark: load %.1f ms, upload %.1f ms, AS build %.1f ms, render %.3f ms (median of %d, %.1f Mrays/s)\n", result.loadMs,
+           result.uploadMs, result.buildMs, medianMs, options.benchmarkRepeat, double(result.rays) / (medianMs * 1000.0));
+    if (!WriteBenchmarkJson(options.benchmarkJson, result))
+    {
+        fprintf(stderr, "Could not write %s\n", options.benchmarkJson.c_str());
+    }
+
+    vkDestroyPipeline(renderer.context, countPipeline, nullptr);
+    vkDestroyPipeline(renderer.context, benchmarkPipeline, nullptr);
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+}
+
+// Quality gate: renders the scene within each of `options.qualityBudgets` (wall time, including the denoiser with
+// --denoise) as --time-budget would, and compares each image against a reference of `options.qualityReferenceSpp`
+// samples per pixel with RMSE, relMSE and FLIP (see RenderQualityBudgets). Equal time rather than equal samples, so
+// that a change that makes samples cheaper counts as much as one that makes them better. The reference is cached in
+// the working directory, keyed by the scene and the settings it is rendered with, and uses sample indices no budget
+// render uses. Writes the errors to `options.qualityGate`, and returns false if `options.qualityBaseline` can't be
+// read or has smaller errors, beyond the tolerance.
+bool RunQualityGate(const Renderer& renderer, const Options& options, const Mesh& mesh)
+{
+    const size_t   numFloats = size_t(render_width) * render_height * 3;
+    const uint32_t referenceFirstSample = 1u << 24;
+    uint32_t*      activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+
+    // The reference pipeline below uses the constants of the benchmarks, so it has no sample split
+    const SceneSettings referenceSettings{ .width = uint32_t(render_width),
+                                           .height = uint32_t(render_height),
+                                           .sampler = SAMPLER_SOBOL,
+                                           .instances = options.instances,
+                                           .quantizedVertices = options.quantizeVertices,
+                                           .shadingRecords = options.useShadingRecords,
+                                           .sampleSplit = 1 };
+    char referencePath[64];
+    snprintf(referencePath, sizeof(referencePath), "reference_%016llx_%u.pfm",
+             static_cast<unsigned long long>(HashScene(mesh, referenceSettings)), uint32_t(options.qualityReferenceSpp));
+    std::vector<float> reference;
+    uint32_t           referenceWidth = 0, referenceHeight = 0, referenceChannels = 0;
+    if (ReadPfm(referencePath, reference, referenceWidth, referenceHeight, referenceChannels) && referenceWidth == uint32_t(render_width)
+        && referenceHeight == uint32_t(render_height) && referenceChannels == 3)
+    {
+        printf("Quality gate: reference %s\n", referencePath);
+    }
+    else
+    {
+        SpecConstants referenceConstants = GetSpecConstants(renderer.scene, options);
+        referenceConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+        referenceConstants[SPEC_SAMPLER] = SAMPLER_SOBOL;
+        VkPipeline   referencePipeline = renderer.createPipeline(referenceConstants);
+        const double referenceMs = renderer.renderTiles(referencePipeline, activeTilesData, AllTiles(renderer.tileGrid), referenceFirstSample,
+                                                        uint32_t(options.qualityReferenceSpp));
+        vkDestroyPipeline(renderer.context, referencePipeline, nullptr);
+        reference = CopyBufferFloats(renderer.allocator, renderer.buffer, numFloats);
+        printf("Quality gate: rendered reference %s (%d spp, %.1f ms)\n", referencePath, options.qualityReferenceSpp, referenceMs);
+        if (!WritePfm(referencePath, reference.data(), uint32_t(render_width), uint32_t(render_height), 3))
+        {
+            fprintf(stderr, "Could not write %s\n", referencePath);
+        }
+    }
+
+    // The budget renders use the pipeline the image would be rendered with, with adaptive sampling for the batches, and
+    // stop before the reference's samples
+    SpecConstants gateConstants = renderer.renderConstants;
+    gateConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+    gateConstants[SPEC_OUTPUT_IMAGE] = 0;
+    VkPipeline                  gatePipeline = renderer.createPipeline(gateConstants);
+    const std::vector<uint32_t> tiles = AllTiles(renderer.tileGrid);
+    std::function<void()>       denoise;
+    if (options.denoise)
+    {
+        denoise = [&]() {
+            DenoiseAndTime(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, renderer.denoisePipeline,
+                           renderer.denoiseDescriptorSetContainer, uint32_t(options.denoiseIterations), renderer.queryPool,
+                           renderer.timestampPeriod);
+        };
+    }
+    printf("Quality gate (errors against %d spp):\n", options.qualityReferenceSpp);
+    const std::vector<QualityResult> results =
+        RenderQualityBudgets(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, gatePipeline, renderer.pipelineLayout(),
+                             renderer.descriptorSet, renderer.queryPool, renderer.timestampPeriod, activeTilesData, tiles,
+                             renderer.tileGroupCount(uint32_t(tiles.size())), renderer.tileGroupCountZ(), options.qualityBudgets,
+                             referenceFirstSample, renderer.allocator, renderer.buffer, reference, uint32_t(render_width),
+                             uint32_t(render_height), denoise);
+    vkDestroyPipeline(renderer.context, gatePipeline, nullptr);
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+
+    if (!WriteQualityCsv(options.qualityGate, results))
+    {
+        fprintf(stderr, "Could not write %s\n", options.qualityGate.c_str());
+    }
+    if (options.qualityBaseline.empty())
+    {
+        return true;
+    }
+    std::vector<QualityResult> baseline;
+    if (!ReadQualityCsv(options.qualityBaseline, baseline))
+    {
+        fprintf(stderr, "Could not read the quality baseline %s\n", options.qualityBaseline.c_str());
+        return false;
+    }
+    return CheckQualityGate(results, baseline, options.qualityTolerance);
+}
+
+// Worker mode: renders the rows and samples of the coordinator's job, and writes their sums to the partial render file.
+// Returns false if writing failed.
+bool RunWorkerJob(const Renderer& renderer, const Options& options)
+{
+    const RenderJob& job = options.workerJob;
+    SpecConstants    workerConstants = GetSpecConstants(renderer.scene, options);
+    workerConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+    VkPipeline   workerPipeline = renderer.createPipeline(workerConstants);
+    uint32_t*    activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+    const double workerMs = renderer.renderTiles(workerPipeline, activeTilesData, TilesInRows(renderer.tileGrid, job.rowBegin, job.rowEnd),
+                                                 job.firstSample, job.sampleCount);
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+    vkDestroyPipeline(renderer.context, workerPipeline, nullptr);
+
+    PartialRender partial{ .width = uint32_t(render_width), .height = uint32_t(render_height), .job = job };
+    const float*  accumulation = reinterpret_cast<const float*>(renderer.allocator.map(renderer.accumulationBuffer));
+    partial.sums.assign(accumulation + size_t(job.rowBegin) * render_width * 4, accumulation + size_t(job.rowEnd) * render_width * 4);
+    renderer.allocator.unmap(renderer.accumulationBuffer);
+    printf("Worker job %s: %.3f ms\n", FormatRenderJob(job).c_str(), workerMs);
+    if (!WritePartial(options.partialPath, partial))
+    {
+        fprintf(stderr, "Could not write %s\n", options.partialPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Hybrid mode: renders `mesh` with the GPU and the CPU (see RenderHybrid), and puts the merged image where the GPU
+// would have written it.
+void RunHybrid(const Renderer& renderer, const Options& options, const Mesh& mesh)
+{
+    SpecConstants hybridConstants = GetSpecConstants(renderer.scene, options);
+    hybridConstants[SPEC_ADAPTIVE_SAMPLING] = 1;
+    VkPipeline     hybridPipeline = renderer.createPipeline(hybridConstants);
+    const CpuScene cpuScene = BuildCpuScene(mesh, options.sampler, options.quantizeVertices);
+    uint32_t*      activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+    const float*   accumulation = reinterpret_cast<const float*>(renderer.allocator.map(renderer.accumulationBuffer));
+    const auto     hybridStart = std::chrono::steady_clock::now();
+    const std::vector<float> image = RenderHybrid(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, hybridPipeline,
+                                                  renderer.pipelineLayout(), renderer.descriptorSet, renderer.queryPool, renderer.timestampPeriod,
+                                                  activeTilesData, accumulation, cpuScene, renderer.tileGrid, uint32_t(options.totalSamples),
+                                                  options.cpuThreads);
+    printf("Hybrid render: %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hybridStart).count());
+    renderer.allocator.unmap(renderer.accumulationBuffer);
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+    vkDestroyPipeline(renderer.context, hybridPipeline, nullptr);
+    memcpy(renderer.allocator.map(renderer.buffer), image.data(), image.size() * sizeof(float));
+    renderer.allocator.unmap(renderer.buffer);
+}
+
+// Tiled mode: renders the image tile by tile into the ring of tiles in the image buffer, and writes each tile to
+// out.hdr as it finishes (see RenderTiled). Returns false if writing failed.
+bool RunTiled(const Renderer& renderer, const Options& options)
+{
+    const auto   tiledStart = std::chrono::steady_clock::now();
+    const float* ringData = reinterpret_cast<float*>(renderer.allocator.map(renderer.buffer));
+    const bool   written = RenderTiled(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, renderer.renderPipeline,
+                                       renderer.pipelineLayout(), renderer.descriptorSet, ringData, options.tiledWidth, options.tiledHeight,
+                                       options.tileSize, options.tileRingSlots, renderer.renderConstants[SPEC_SAMPLE_SPLIT], "out.hdr");
+    renderer.allocator.unmap(renderer.buffer);
+    if (!written)
+    {
+        fprintf(stderr, "Could not write out.hdr\n");
+        return false;
+    }
+    printf("Tiled render (%ux%u, %ux%u tiles, %u in flight): %.1f ms\n", options.tiledWidth, options.tiledHeight, options.tileSize,
+           options.tileSize, options.tileRingSlots,
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tiledStart).count());
+    return true;
+}
+
+// Multi-view mode: renders all views in one dispatch, each into its layer of the output image, then reads the layers
+// back into `viewImages`, one image after the other.
+void RunMultiView(const Renderer& renderer, const Options& options, std::vector<float>& viewImages)
+{
+    const uint32_t      viewCount = renderer.outputImage.layers;
+    const PushConstants pushConstants{ .imageWidth = options.viewWidth,
+                                       .imageHeight = options.viewHeight,
+                                       .tileWidth = options.viewWidth,
+                                       .tileHeight = options.viewHeight,
+                                       .viewCount = viewCount };
+    const double dispatchMs = options.persistentThreads
+                                  ? renderer.dispatchAndTime(renderer.renderPipeline, pushConstants, renderer.persistentWorkgroups, 1)
+                                  : renderer.dispatchAndTime(renderer.renderPipeline, pushConstants,
+                                                             (options.viewWidth + workgroup_width - 1) / workgroup_width,
+                                                             (options.viewHeight + workgroup_height - 1) / workgroup_height,
+                                                             viewCount * renderer.renderConstants[SPEC_SAMPLE_SPLIT]);
+    viewImages.resize(size_t(options.viewWidth) * options.viewHeight * viewCount * 3);
+    const double copyMs = ReadBackOutputImage(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, renderer.allocator,
+                                              renderer.outputImage, renderer.queryPool, renderer.timestampPeriod, viewImages.data());
+    printf("Dispatch: %.3f ms for %u views of %ux%u (%.3f ms per view); readback %.3f ms\n", dispatchMs, viewCount, options.viewWidth,
+           options.viewHeight, dispatchMs / viewCount, copyMs);
+}
+
+// Convergence snapshots: renders all tiles up to `options.snapshotSamples` spp, and hands the image at each power of 2
+// spp to `imageWriter` as soon as it is copied, with the GPU time it took (also written to snapshots.csv), while the
+// GPU renders on (see RenderSnapshots). Returns false if snapshots.csv couldn't be written.
+bool RunSnapshots(const Renderer& renderer, const Options& options, ImageWriter& imageWriter)
+{
+    const std::vector<uint32_t> tiles = AllTiles(renderer.tileGrid);
+    memcpy(renderer.allocator.map(renderer.activeTilesBuffer), tiles.data(), tiles.size() * sizeof(uint32_t));
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+    const VkDeviceSize imageBytes = render_width * render_height * 3 * sizeof(float);
+    uint32_t           checkpoints = 1;
+    for (uint32_t spp = 1; spp < uint32_t(options.snapshotSamples); spp *= 2)
+    {
+        checkpoints++;
+    }
+    nvvk::Buffer snapshotBuffer = renderer.allocator.createBuffer(checkpoints * imageBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                                                                      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    const float* snapshots = reinterpret_cast<const float*>(renderer.allocator.map(snapshotBuffer));
+    FILE*        csv = fopen("snapshots.csv", "w");
+    if (csv != nullptr)
+    {
+        fprintf(csv, "spp,gpu_ms\n");
+    }
+    printf("%8s %12s\n", "spp", "GPU ms");
+    RenderSnapshots(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, renderer.renderPipeline, renderer.pipelineLayout(),
+                    renderer.descriptorSet, renderer.timestampPeriod, uint32_t(tiles.size()), renderer.tileGroupCount(uint32_t(tiles.size())),
+                    renderer.tileGroupCountZ(), renderer.buffer.buffer, imageBytes, snapshotBuffer.buffer, uint32_t(options.snapshotSamples),
+                    [&](uint32_t checkpoint, uint32_t spp, double gpuMs) {
+                        const float* data = snapshots + checkpoint * (imageBytes / sizeof(float));
+                        imageWriter.write(Image{ "out_spp" + std::to_string(spp) + "." + ImageFormatExtension(options.outputFormat),
+                                                 options.outputFormat, uint32_t(render_width), uint32_t(render_height),
+                                                 { ImageLayer{ "", 3, std::vector<float>(data, data + imageBytes / sizeof(float)) } } });
+                        printf("%8u %12.3f\n", spp, gpuMs);
+                        if (csv != nullptr)
+                        {
+                            fprintf(csv, "%u,%.3f\n", spp, gpuMs);
+                        }
+                    });
+    renderer.allocator.unmap(snapshotBuffer);
+    renderer.allocator.destroy(snapshotBuffer);
+    if (csv == nullptr || fclose(csv) != 0)
+    {
+        fprintf(stderr, "Could not write snapshots.csv\n");
+        return false;
+    }
+    return true;
+}
+
+// Time-budgeted rendering of all tiles (see RenderWithinBudget).
+void RunTimeBudget(const Renderer& renderer, const Options& options)
+{
+    const std::vector<uint32_t> tiles = AllTiles(renderer.tileGrid);
+    memcpy(renderer.allocator.map(renderer.activeTilesBuffer), tiles.data(), tiles.size() * sizeof(uint32_t));
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+    const BudgetRender render = RenderWithinBudget(renderer.context, renderer.context.m_queueGCT, renderer.cmdPool, renderer.renderPipeline,
+                                                   renderer.pipelineLayout(), renderer.descriptorSet, renderer.queryPool, renderer.timestampPeriod,
+                                                   uint32_t(tiles.size()), renderer.tileGroupCount(uint32_t(tiles.size())),
+                                                   renderer.tileGroupCountZ(), options.timeBudgetMs, uint32_t(options.maxSamples));
+    printf("Time budget: %u spp in %u batches, %.1f of %.1f ms (%.1f ms on the GPU)\n", render.sampleCount, render.numBatches, render.wallMs,
+           options.timeBudgetMs, render.gpuMs);
+}
+
+// Runs the compute shader with enough workgroups to cover the entire buffer, or with the persistent workgroups that
+// take the tiles from the work counter, and waits for it to finish.
+void RunSingleDispatch(const Renderer& renderer, const Options& options)
+{
+    if (options.persistentThreads)
+    {
+        const double dispatchMs = renderer.dispatchAndTime(renderer.renderPipeline, WholeImagePushConstants(), renderer.persistentWorkgroups, 1);
+        printf("Dispatch: %.3f ms (%u persistent workgroups)\n", dispatchMs, renderer.persistentWorkgroups);
+    }
+    else
+    {
+        const double dispatchMs = renderer.dispatchAndTime(renderer.renderPipeline, WholeImagePushConstants(),
+                                                           (uint32_t(render_width) + workgroup_width - 1) / workgroup_width,
+                                                           (uint32_t(render_height) + workgroup_height - 1) / workgroup_height,
+                                                           renderer.renderConstants[SPEC_SAMPLE_SPLIT]);
+        printf("Dispatch: %.3f ms\n", dispatchMs);
+    }
+}
+
+// Progressive rendering of `mesh` in batches: each dispatch adds a batch of samples to the tiles that haven't converged.
+// With --adaptive, the CPU drops the tiles whose pixels are all below the noise threshold after each batch, until none
+// are left or the tiles that are left have `options.maxSamples` samples; otherwise, all tiles stay active.
+// With --checkpoint, the render continues from the checkpoint file if there is one of the same scene, and saves its
+// state to it every `options.checkpointInterval` seconds and at the end: the CPU copies the mapped sums and image
+// between two batches, and another thread writes the copy while the GPU renders the next ones. Returns false if the
+// last checkpoint couldn't be written.
+bool RunProgressive(const Renderer& renderer, const Options& options, const Mesh& mesh)
+{
+    const TileGrid&       tileGrid = renderer.tileGrid;
+    std::vector<uint32_t> activeTiles = AllTiles(tileGrid);
+    float*    accumulation = reinterpret_cast<float*>(renderer.allocator.map(renderer.accumulationBuffer));
+    uint32_t* activeTilesData = reinterpret_cast<uint32_t*>(renderer.allocator.map(renderer.activeTilesBuffer));
+    float*    imageData = reinterpret_cast<float*>(renderer.allocator.map(renderer.buffer));
+    const size_t   sumFloats = render_width * render_height * 4;
+    const size_t   imageFloats = render_width * render_height * 3;
+    const uint32_t batchSamples = options.adaptiveSampling ? adaptive_batch_samples : max_batch_samples;
+    double    totalMs = 0.0;
+    uint64_t  tileSamples = 0;  // Sum of the samples per pixel of all tiles
+    uint32_t  numBatches = 0;
+    uint32_t  sampleCount = 0;
+
+    const bool        checkpointing = !options.checkpointPath.empty();
+    const uint64_t    sceneHash = HashScene(mesh, SceneSettings{ .width = uint32_t(render_width),
+                                                                 .height = uint32_t(render_height),
+                                                                 .sampler = options.sampler,
+                                                                 .adaptive = options.adaptiveSampling,
+                                                                 .noiseThreshold = options.noiseThreshold,
+                                                                 .instances = options.instances,
+                                                                 .quantizedVertices = options.quantizeVertices,
+                                                                 .shadingRecords = options.useShadingRecords,
+                                                                 .sampleSplit = renderer.renderConstants[SPEC_SAMPLE_SPLIT] });
+    RenderCheckpoint  resumed;
+    std::future<bool> checkpointWrite;
+    auto              lastCheckpoint = std::chrono::steady_clock::now();
+    if (checkpointing && ReadCheckpoint(options.checkpointPath, resumed))
+    {
+        const bool valid = (resumed.sceneHash == sceneHash) && (resumed.sums.size() == sumFloats) && (resumed.image.size() == imageFloats)
+                           && std::all_of(resumed.activeTiles.begin(), resumed.activeTiles.end(),
+                                          [&](uint32_t tile) { return tile < tileGrid.numTiles(); });
+        if (valid)
+        {
+            activeTiles = std::move(resumed.activeTiles);
+            memcpy(accumulation, resumed.sums.data(), sumFloats * sizeof(float));
+            memcpy(imageData, resumed.image.data(), imageFloats * sizeof(float));
+            sampleCount = resumed.sampleCount;
+            numBatches = resumed.numBatches;
+            tileSamples = resumed.tileSamples;
+            printf("Resuming from %s at %u spp (%zu of %u tiles active)\n", options.checkpointPath.c_str(), sampleCount,
+                   activeTiles.size(), tileGrid.numTiles());
+        }
+        else
+        {
+            fprintf(stderr, "%s is a checkpoint of another render; starting over\n", options.checkpointPath.c_str());
+        }
+    }
+    while (!activeTiles.empty() && sampleCount < uint32_t(options.maxSamples))
+    {
+        memcpy(activeTilesData, activeTiles.data(), activeTiles.size() * sizeof(uint32_t));
+        PushConstants pushConstants = WholeImagePushConstants();
+        pushConstants.firstSample = sampleCount;
+        pushConstants.sampleCount = std::min(batchSamples, uint32_t(options.maxSamples) - sampleCount);
+        pushConstants.accumulatedSamples = sampleCount;
+        pushConstants.activeTileCount = uint32_t(activeTiles.size());
+        totalMs += renderer.dispatchAndTime(renderer.renderPipeline, pushConstants, renderer.tileGroupCount(uint32_t(activeTiles.size())), 1,
+                                            renderer.tileGroupCountZ());
+        sampleCount += pushConstants.sampleCount;
+        tileSamples += uint64_t(activeTiles.size()) * pushConstants.sampleCount;
+        numBatches++;
+        if (options.adaptiveSampling)
+        {
+            RemoveConvergedTiles(activeTiles, tileGrid, accumulation, sampleCount, options.noiseThreshold);
+        }
+
+        const bool finished = activeTiles.empty() || sampleCount >= uint32_t(options.maxSamples);
+        if (checkpointing
+            && (finished
+                || std::chrono::duration<float>(std::chrono::steady_clock::now() - lastCheckpoint).count() >= options.checkpointInterval))
+        {
+            // Only one write at a time, so that an older checkpoint never replaces a newer one
+            if (checkpointWrite.valid() && !checkpointWrite.get())
+            {
+                fprintf(stderr, "Could not write checkpoint %s\n", options.checkpointPath.c_str());
+            }
+            RenderCheckpoint checkpoint{ .sceneHash = sceneHash,
+                                         .sampleCount = sampleCount,
+                                         .numBatches = numBatches,
+                                         .tileSamples = tileSamples,
+                                         .activeTiles = activeTiles,
+                                         .sums = std::vector<float>(accumulation, accumulation + sumFloats),
+                                         .image = std::vector<float>(imageData, imageData + imageFloats) };
+            checkpointWrite = std::async(std::launch::async, [path = options.checkpointPath, checkpoint = std::move(checkpoint)]() {
+                return WriteCheckpoint(path, checkpoint);
+            });
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
+    }
+    bool written = true;
+    if (checkpointWrite.valid() && !checkpointWrite.get())
+    {
+        fprintf(stderr, "Could not write checkpoint %s\n", options.checkpointPath.c_str());
+        written = false;
+    }
+    renderer.allocator.unmap(renderer.buffer);
+    renderer.allocator.unmap(renderer.activeTilesBuffer);
+    renderer.allocator.unmap(renderer.accumulationBuffer);
+    printf("Dispatch: %.3f ms in %u %sbatches; %.1f spp on average, %u spp max; %zu of %u tiles unconverged\n", totalMs,
+           numBatches, options.adaptiveSampling ? "adaptive " : "", double(tileSamples) / tileGrid.numTiles(), sampleCount, activeTiles.size(), tileGrid.numTiles());
+    return written;
+}
+
+
+
+
+
+// Coordinator and merge modes: renders the frame with worker processes running this executable (or takes the
+// partial renders of --merge), and merges the partial renders into out.hdr. Returns the exit code of the program.
+int RunDistributed(const char* executable, const Options& options)
+{
+    std::vector<std::string> paths;
+    if (options.mergeInputs.empty())
+    {
+        CoordinatorSettings settings;
+        settings.workerPrefixes.assign(options.localWorkers, std::string());
+        if (!options.workerHostsPath.empty())
+        {
+            std::ifstream hosts(options.workerHostsPath);
+            if (!hosts)
+            {
+                fprintf(stderr, "Could not read %s\n", options.workerHostsPath.c_str());
+                return 1;
+            }
+            for (std::string line; std::getline(hosts, line);)
+            {
+                line.erase(line.find_last_not_of(" \t\r") + 1);
+                if (!line.empty() && line[0] != '#')
+                {
+                    settings.workerPrefixes.push_back(line);
+                }
+            }
+        }
+        if (settings.workerPrefixes.empty())
+        {
+            fprintf(stderr, "No workers to render with\n");
+            return 1;
+        }
+        settings.executable = executable;
+        settings.arguments = options.workerArguments;
+        settings.partialDir = options.partialDir;
+        const uint32_t rowBands = (options.rowBands > 0) ? uint32_t(options.rowBands) : uint32_t(settings.workerPrefixes.size());
+        settings.jobs = PartitionFrame(uint32_t(render_height), uint32_t(options.totalSamples), rowBands, uint32_t(options.sampleSlices));
+        printf("Coordinator: %zu jobs on %zu workers\n", settings.jobs.size(), settings.workerPrefixes.size());
+        paths = RunCoordinator(settings);
+        if (paths.empty())
+        {
+            fprintf(stderr, "Distributed render failed\n");
+            return 1;
+        }
+    }
+    else
+    {
+        std::string remaining = options.mergeInputs;
+        while (!remaining.empty())
+        {
+            const size_t comma = remaining.find(',');
+            paths.push_back(remaining.substr(0, comma));
+            remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+        }
+    }
+
+    uint32_t           width = 0, height = 0, uncoveredPixels = 0;
+    std::vector<float> rgb;
+    if (!MergePartials(paths, width, height, rgb, uncoveredPixels))
+    {
+        fprintf(stderr, "Could not merge the partial renders\n");
+        return 1;
+    }
+    if (uncoveredPixels > 0)
+    {
+        fprintf(stderr, "%u pixels aren't covered by any partial render\n", uncoveredPixels);
+    }
+    const std::string outputPath = std::string("out.") + ImageFormatExtension(options.outputFormat);
+    printf("Merged %zu partial renders into %s\n", paths.size(), outputPath.c_str());
+    ImageWriter writer;
+    writer.write(Image{ outputPath, options.outputFormat, width, height, { ImageLayer{ "", 3, std::move(rgb) } } });
+    return writer.wait() ? 0 : 1;
+}
+
+
+
+
+
 int main(int argc, const char** argv)
 {
+  Options options = ParseOptions(argc, argv);
+  // A coordinator only starts workers and merges their partial renders, so it doesn't need Vulkan itself
+  if (options.localWorkers > 0 || !options.workerHostsPath.empty() || !options.mergeInputs.empty())
+  {
+    return RunDistributed(argv[0], options);
+  }
+  // The benchmark suite runs this executable once per scene, and only collects the results
+  if (!options.benchmarkSuite.empty())
+  {
+    BenchmarkSuiteSettings settings;
+    settings.executable = argv[0];
+    settings.arguments = options.workerArguments;
+    settings.outputPath = options.benchmarkSuite;
+    return RunBenchmarkSuite(settings) ? 0 : 1;
+  }
+  // End-to-end render time: from here until the image has been written
+  const auto startTime = std::chrono::steady_clock::now();
+
   // Context
   // Create the Vulkan context, consisting of an instance, device, physical device, and queues.
   nvvk::ContextCreateInfo deviceInfo;  // Settings
@@ -97,6 +2913,8 @@ int main(int argc, const char** argv)
   deviceInfo.addDeviceExtension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, false, &asFeatures);
   VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR};
   deviceInfo.addDeviceExtension(VK_KHR_RAY_QUERY_EXTENSION_NAME, false, &rayQueryFeatures);
+  // Optional: lets --benchmark-json report the device memory in use
+  deviceInfo.addDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, true);
 
   nvvk::Context context;     // Encapsulates device state in a single object
   context.init(deviceInfo);  // Initialize the context
@@ -118,7 +2936,10 @@ int main(int argc, const char** argv)
 
   // Buffer
   // Create a buffer
-  VkDeviceSize       bufferSizeBytes = render_width * render_height * 3 * sizeof(float);
+  // With tiled rendering, this is the ring of tiles instead of the whole image.
+  const bool         tiledRendering  = (options.tiledWidth > 0);
+  VkDeviceSize       bufferSizeBytes = tiledRendering ? VkDeviceSize(options.tileRingSlots) * options.tileSize * options.tileSize * 3 * sizeof(float)
+                                                      : render_width * render_height * 3 * sizeof(float);
   VkBufferCreateInfo bufferCreateInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
                                       .size  = bufferSizeBytes,
                                       .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT};
@@ -135,27 +2956,90 @@ int main(int argc, const char** argv)
 
 
 
-  // Load the mesh of the first shape from an OBJ file
+  // Load the mesh of the first shape from an OBJ file (by default, the Cornell box), or generate it (see --scene)
+  const auto               loadStart = std::chrono::steady_clock::now();
   const std::string        exePath(argv[0], std::string(argv[0]).find_last_of("/\\") + 1);
   std::vector<std::string> searchPaths = { exePath + PROJECT_RELDIRECTORY, exePath + PROJECT_RELDIRECTORY "..",
                                           exePath + PROJECT_RELDIRECTORY "../..", exePath + PROJECT_NAME };
-  tinyobj::ObjReader       reader;  // Used to read an OBJ file
-  reader.ParseFromFile(nvh::findFile("scenes/CornellBox-Original-Merged.obj", searchPaths));
-  assert(reader.Valid());  // Make sure tinyobj was able to parse this file
+  Mesh sourceMesh;
+  const bool isMeshCache = (options.scene.size() > 5) && (options.scene.compare(options.scene.size() - 5, 5, ".mesh") == 0);
+  if (isMeshCache)
+  {
+      // A scene of the scene generator: use the instance count it was generated with, unless --instances says otherwise
+      std::string            description;
+      SceneGeneratorSettings settings;
+      if (!ReadMeshCache(options.scene, sourceMesh, description))
+      {
+          fprintf(stderr, "Could not read the mesh cache %s\n", options.scene.c_str());
+          return 1;
+      }
+      printf("Mesh cache %s: %s\n", options.scene.c_str(), description.c_str());
+      if (ParseSceneGeneratorSettings(description, settings) && options.instances == 1 && !options.hybrid)
+      {
+          options.instances = settings.instances;
+      }
+  }
+  else if (!MakeProceduralMesh(options.scene, sourceMesh))
+  {
+      sourceMesh = LoadObjMesh(options.scene.empty() ? nvh::findFile("scenes/CornellBox-Original-Merged.obj", searchPaths) : options.scene);
+  }
+  // Only --benchmark-split preprocesses the source mesh again, for each split budget. Other runs move it into `mesh`,
+  // so that a large scene isn't kept in host memory twice.
+  Mesh mesh = (options.benchmarkSplit > 0) ? sourceMesh : std::move(sourceMesh);
+  PreprocessMesh(mesh, options);
+  const double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
 
-  // Get the vertices and indices of the OBJ file
-  const std::vector<tinyobj::real_t>   objVertices = reader.GetAttrib().GetVertices();
-  const std::vector<tinyobj::shape_t>& objShapes = reader.GetShapes();  // All shapes in the file
-  assert(objShapes.size() == 1);                                          // Check that this file has only one shape (the mesh formed by triangles)
-  const tinyobj::shape_t& objShape = objShapes[0];                        // Get the first shape
-  // Get the indices of the vertices of the first mesh of `objShape` in `attrib.vertices`:
-  std::vector<uint32_t> objIndices;
-  objIndices.reserve(objShape.mesh.indices.size());
-  for (const tinyobj::index_t& index : objShape.mesh.indices)
+
+
+
+
+  // Adaptive sampling buffers
+  // The running sums of each pixel's samples, which the CPU reads between batches to find converged tiles,
+  // and the list of tiles the next batch samples, which the CPU writes. Both are mapped for the whole run.
+  // The sampler benchmark renders whole tiles the same way. Otherwise, 1-element placeholders keep their bindings valid.
+  const TileGrid tileGrid{ uint32_t(render_width), uint32_t(render_height) };
+  const bool usesTiles = options.adaptiveSampling || (options.benchmarkSampler > 0) || options.benchmarkDenoiser || options.isWorker
+                         || options.hybrid || (options.timeBudgetMs > 0.0f) || (options.snapshotSamples > 0)
+                         || !options.checkpointPath.empty() || !options.benchmarkJson.empty() || !options.qualityGate.empty();
+  const VkDeviceSize accumulationSizeBytes = usesTiles ? render_width * render_height * 4 * sizeof(float) : 4 * sizeof(float);
+  const VkDeviceSize activeTilesSizeBytes = usesTiles ? tileGrid.numTiles() * sizeof(uint32_t) : sizeof(uint32_t);
+  nvvk::Buffer accumulationBuffer = allocator.createBuffer(accumulationSizeBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                                                               | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  nvvk::Buffer activeTilesBuffer = allocator.createBuffer(activeTilesSizeBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+
+
+
+
+  // AOV and denoiser buffers
+  // One buffer per AOV; the denoiser uses the albedo and normal AOVs as guides. Only the AOVs that the CPU reads to
+  // write the AOV files are host-visible. Then the 2 scratch buffers the A-trous iterations ping-pong between. AOVs
+  // that aren't written get 1-pixel placeholders to keep their bindings valid.
+  const bool usesDenoiser = options.denoise || options.benchmarkDenoiser;
+  const uint32_t aovMask = options.aovMask | (usesDenoiser ? (AOV_ALBEDO | AOV_NORMAL) : 0);
+  std::array<nvvk::Buffer, aov_infos.size()> aovBuffers;
+  for (size_t i = 0; i < aov_infos.size(); i++)
+  {
+      const VkDeviceSize numPixels = (aovMask & aov_infos[i].bit) ? render_width * render_height : 1;
+      const VkMemoryPropertyFlags memoryFlags = (options.aovMask & aov_infos[i].bit)
+                                                    ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                                                          | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                                    : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+      aovBuffers[i] = allocator.createBuffer(numPixels * aov_infos[i].bytesPerPixel, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, memoryFlags);
+  }
+  nvvk::Buffer denoiseScratchBuffers[2];
+  for (nvvk::Buffer& scratchBuffer : denoiseScratchBuffers)
   {
-      objIndices.push_back(index.vertex_index);
+      scratchBuffer = allocator.createBuffer(usesDenoiser ? bufferSizeBytes : 3 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   }
-  // for (auto x : objIndices) printf("%d ", x);
+  // The output of tonemap.comp.glsl, which the CPU reads instead of the float image with --encode
+  const VkDeviceSize encodedSizeBytes = options.encodeOutput ? render_width * render_height * EncodingBytesPerPixel(options.encoding) : 4;
+  nvvk::Buffer encodedBuffer = allocator.createBuffer(encodedSizeBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                                                          | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
 
 
@@ -172,80 +3056,97 @@ int main(int argc, const char** argv)
 
   
   
-  // Upload the vertex and index buffers to the GPU.
-  nvvk::Buffer vertexBuffer, indexBuffer;
+  // Sampler tables
+  // Upload the Sobol direction numbers once; the shader reads them with SAMPLER_SOBOL.
+  nvvk::Buffer sobolDirectionBuffer;
   {
-      // Start a command buffer for uploading the buffers
       VkCommandBuffer uploadCmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+      sobolDirectionBuffer = allocator.createBuffer(uploadCmdBuffer, BuildSobolDirections(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+      EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, uploadCmdBuffer);
+      allocator.finalizeAndReleaseStaging();
+  }
 
-      // We get these buffers' device addresses, and use them as storage buffers and build inputs.
-      const VkBufferUsageFlags usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-          | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
 
-      vertexBuffer = allocator.createBuffer(uploadCmdBuffer, objVertices, usage);
-      indexBuffer = allocator.createBuffer(uploadCmdBuffer, objIndices, usage);
 
-	  // End the command buffer, submit it, and wait for it to finish
+
+
+  // Cameras
+  // The cameras of --views, or the default camera. Each view renders into its own layer of the output image, up to
+  // the device's limit on the layers of an image.
+  const bool          multiView = !options.views.empty();
+  std::vector<Camera> cameras = { DefaultCamera() };
+  if (multiView && !MakeViewCameras(options.views, cameras))
+  {
+      return 1;
+  }
+  {
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(context.m_physicalDevice, &properties);
+      if (cameras.size() > properties.limits.maxImageArrayLayers)
+      {
+          fprintf(stderr, "Rendering only the first %u of %zu views (maxImageArrayLayers)\n", properties.limits.maxImageArrayLayers, cameras.size());
+          cameras.resize(properties.limits.maxImageArrayLayers);
+      }
+  }
+  const uint32_t viewCount = uint32_t(cameras.size());
+  nvvk::Buffer   cameraBuffer;
+  {
+      VkCommandBuffer uploadCmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+      cameraBuffer = allocator.createBuffer(uploadCmdBuffer, cameras, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
       EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, uploadCmdBuffer);
-      // Free the memory of the allocator: the allocator also allocates some temporary staging memory to perform these uploads to GPU-local memory
       allocator.finalizeAndReleaseStaging();
   }
 
-  // Describe the bottom-level acceleration structure (BLAS)
-  std::vector<nvvk::RaytracingBuilderKHR::BlasInput> blases;
-  {
-      nvvk::RaytracingBuilderKHR::BlasInput blas;
-      // Get the device addresses of the vertex and index buffers
-      VkDeviceAddress vertexBufferAddress = GetBufferDeviceAddress(context, vertexBuffer.buffer);
-      VkDeviceAddress indexBufferAddress = GetBufferDeviceAddress(context, indexBuffer.buffer);
-      // Specify where the builder can find the vertices and indices for triangles, and their formats:
-      VkAccelerationStructureGeometryTrianglesDataKHR triangles{
-          .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
-          .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
-          .vertexData = {.deviceAddress = vertexBufferAddress},
-          .vertexStride = 3 * sizeof(float),
-          .maxVertex = static_cast<uint32_t>(objVertices.size() / 3 - 1),
-          .indexType = VK_INDEX_TYPE_UINT32,
-          .indexData = {.deviceAddress = indexBufferAddress},
-          .transformData = {.deviceAddress = 0}  // No transform
-  };
-  
-   // Create a VkAccelerationStructureGeometryKHR object that says it handles opaque triangles and points to the above:
-   VkAccelerationStructureGeometryKHR geometry{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
-                                               .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
-                                               .geometry = {.triangles = triangles},
-                                               .flags = VK_GEOMETRY_OPAQUE_BIT_KHR };
-   blas.asGeometry.push_back(geometry);
-   // Create offset info that allows us to say how many triangles and vertices to read
-   VkAccelerationStructureBuildRangeInfoKHR offsetInfo{
-       .primitiveCount = static_cast<uint32_t>(objIndices.size() / 3),  // Number of triangles
-       .primitiveOffset = 0,                                             // Offset added when looking up triangles
-       .firstVertex = 0,  // Offset added when looking up vertices in the vertex buffer
-       .transformOffset = 0   // Offset added when looking up transformation matrices, if we used them
-   };
-   blas.asBuildOffsetInfo.push_back(offsetInfo);
-   blases.push_back(blas);
-  }
-  // Create the BLAS
-  nvvk::RaytracingBuilderKHR raytracingBuilder;
-  raytracingBuilder.setup(context, &allocator, context.m_queueGCT);
-  raytracingBuilder.buildBlas(blases, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
 
-  // Create an instance pointing to this BLAS, and build it into a TLAS:
-  std::vector<VkAccelerationStructureInstanceKHR> instances;
+
+
+
+  // Output image
+  // The storage image the shader writes the color to with --output-image (rgba16f by default with --views), or a
+  // 1-pixel placeholder that keeps its binding valid. Only the final render uses it; the benchmarks write to `buffer`
+  // like before. `usesOutputImage` means that it holds the single image, which is read back into `buffer`.
+  const bool     usesOutputImage = (options.outputImageFormat != VK_FORMAT_UNDEFINED) && !multiView;
+  const VkFormat viewFormat = (options.outputImageFormat != VK_FORMAT_UNDEFINED) ? options.outputImageFormat : VK_FORMAT_R16G16B16A16_SFLOAT;
+  OutputImage    outputImage = multiView ? CreateOutputImage(context, allocator, cmdPool, context.m_queueGCT, viewFormat, options.viewWidth,
+                                                             options.viewHeight, viewCount)
+                                         : CreateOutputImage(context, allocator, cmdPool, context.m_queueGCT,
+                                                             usesOutputImage ? options.outputImageFormat : VK_FORMAT_R32G32B32A32_SFLOAT,
+                                                             usesOutputImage ? uint32_t(render_width) : 1,
+                                                             usesOutputImage ? uint32_t(render_height) : 1);
+
+
+
+
+
+  // Work counters
+  // The counters persistent-threads workgroups take tiles from. They start at 0, and each dispatch leaves them at 0.
+  nvvk::Buffer workCounterBuffer = allocator.createBuffer(WORK_COUNTER_COUNT * 2 * sizeof(uint32_t),
+                                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   {
-      VkAccelerationStructureInstanceKHR instance{};
-      instance.accelerationStructureReference = raytracingBuilder.getBlasDeviceAddress(0);  // The address of the BLAS in `blases` that this instance points to
-      // Set the instance transform to the identity matrix:
-      instance.transform.matrix[0][0] = instance.transform.matrix[1][1] = instance.transform.matrix[2][2] = 1.0f;
-      instance.instanceCustomIndex = 0;  // 24 bits accessible to ray shaders via rayQueryGetIntersectionInstanceCustomIndexEXT
-      // Used for a shader offset index, accessible via rayQueryGetIntersectionInstanceShaderBindingTableRecordOffsetEXT
-      instance.instanceShaderBindingTableRecordOffset = 0;
-      instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;  // How to trace this instance
-      instance.mask = 0xFF;
-      instances.push_back(instance);
+      VkCommandBuffer clearCmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+      vkCmdFillBuffer(clearCmdBuffer, workCounterBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+      EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, clearCmdBuffer);
   }
-  raytracingBuilder.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+  const uint32_t persistentWorkgroups = (options.persistentWorkgroups > 0) ? options.persistentWorkgroups
+                                                                           : DefaultPersistentWorkgroups(context.m_physicalDevice);
+
+
+
+
+
+  // Ray count
+  // The counter that renders with SPEC_COUNT_RAYS add their rays to. The CPU clears and reads it.
+  nvvk::Buffer rayCountBuffer = allocator.createBuffer(2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+
+
+
+
+  // Upload the mesh to the GPU, and build the acceleration structures
+  GpuScene scene;
+  CreateGpuScene(scene, context, allocator, cmdPool, mesh, options);
 
 
 
@@ -253,136 +3154,414 @@ int main(int argc, const char** argv)
 
   // Descriptor Set
   
-  // Here's the list of bindings for the descriptor set layout, from raytrace.comp.glsl:
+  // Here's the list of bindings for the descriptor set layout, from raytrace.comp.glsl (see common.h):
   // 0 - a storage buffer (the buffer `buffer`)
   // 1 - an acceleration structure (the TLAS)
+  // 2 - a storage buffer (the vertex buffer)
+  // 3 - a storage buffer (the index buffer)
+  // 4 - a storage buffer (the precomputed shading records)
+  // 5 - a storage buffer (the quantized vertex positions)
+  // 6 - a storage buffer (the adaptive sampling sums)
+  // 7 - a storage buffer (the adaptive sampling tile list)
+  // 8 - a storage buffer (the Sobol direction numbers)
+  // 9 to 13 - storage buffers (the AOVs)
+  // 14 - a storage image (the output image)
+  // 15 - a storage buffer (the persistent threads work counters)
+  // 16 - a storage buffer (the cameras)
+  // 17 - a storage buffer (the ray count)
   // To trace rays from a shader, we need to add the acceleration structure to the descriptor set.
   nvvk::DescriptorSetContainer descriptorSetContainer(context);
-  descriptorSetContainer.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-  descriptorSetContainer.addBinding(1, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-  descriptorSetContainer.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-  descriptorSetContainer.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_IMAGE_DATA, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_TLAS, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_VERTICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_INDICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_PRIMITIVES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_QUANTIZED_VERTICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_ACCUMULATION, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_ACTIVE_TILES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_SOBOL_DIRECTIONS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  for (const AovInfo& aov : aov_infos)
+  {
+      descriptorSetContainer.addBinding(aov.binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  }
+  descriptorSetContainer.addBinding(BINDING_OUTPUT_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_WORK_COUNTERS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_CAMERAS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  descriptorSetContainer.addBinding(BINDING_RAY_COUNT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
   // Create a layout from the list of bindings
   descriptorSetContainer.initLayout();
   // Create a descriptor pool from the list of bindings with space for 1 set, and allocate that set
   descriptorSetContainer.initPool(1);
-  // Create a simple pipeline layout from the descriptor set layout:
-  descriptorSetContainer.initPipeLayout();
+  // Create a pipeline layout from the descriptor set layout, with the push constants of raytrace.comp.glsl:
+  VkPushConstantRange pushConstantRange{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(PushConstants) };
+  descriptorSetContainer.initPipeLayout(1, &pushConstantRange);
 
   // Write values into the descriptor set.
-  
-  // Make this descriptor in the descriptor set point to the TLAS
-  // Add storage buffer descriptors 2 and 3 for the vertex and index buffers: read mesh data from triangle intersections (triangle vertices)
-  std::array<VkWriteDescriptorSet, 4> writeDescriptorSets;
   // 0
   VkDescriptorBufferInfo descriptorBufferInfo{ .buffer = buffer.buffer,    // The VkBuffer object
                                               .range = bufferSizeBytes };  // The length of memory to bind; offset is 0.
-  writeDescriptorSets[0] = descriptorSetContainer.makeWrite(0 /*set index*/, 0 /*binding*/, &descriptorBufferInfo);
-  // 1
-  VkAccelerationStructureKHR tlasCopy = raytracingBuilder.getAccelerationStructure();  // So that we can take its address
-  VkWriteDescriptorSetAccelerationStructureKHR descriptorAS{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
-                                                            .accelerationStructureCount = 1,
-                                                            .pAccelerationStructures = &tlasCopy };
-  writeDescriptorSets[1] = descriptorSetContainer.makeWrite(0, 1, &descriptorAS);
-  // 2
-  VkDescriptorBufferInfo vertexDescriptorBufferInfo{ .buffer = vertexBuffer.buffer, .range = VK_WHOLE_SIZE };
-  writeDescriptorSets[2] = descriptorSetContainer.makeWrite(0, 2, &vertexDescriptorBufferInfo);
-  // 3
-  VkDescriptorBufferInfo indexDescriptorBufferInfo{ .buffer = indexBuffer.buffer, .range = VK_WHOLE_SIZE };
-  writeDescriptorSets[3] = descriptorSetContainer.makeWrite(0, 3, &indexDescriptorBufferInfo);
-  vkUpdateDescriptorSets(context,                                           // The context
-      static_cast<uint32_t>(writeDescriptorSets.size()),                    // Number of VkWriteDescriptorSet objects
-      writeDescriptorSets.data(),                                           // Pointer to VkWriteDescriptorSet objects
-      0, nullptr);                                                          // An array of VkCopyDescriptorSet objects (unused)
+  // 6 to 13
+  VkDescriptorBufferInfo accumulationDescriptorBufferInfo{ .buffer = accumulationBuffer.buffer, .range = VK_WHOLE_SIZE };
+  VkDescriptorBufferInfo activeTilesDescriptorBufferInfo{ .buffer = activeTilesBuffer.buffer, .range = VK_WHOLE_SIZE };
+  VkDescriptorBufferInfo sobolDirectionDescriptorBufferInfo{ .buffer = sobolDirectionBuffer.buffer, .range = VK_WHOLE_SIZE };
+  VkDescriptorBufferInfo workCounterDescriptorBufferInfo{ .buffer = workCounterBuffer.buffer, .range = VK_WHOLE_SIZE };
+  VkDescriptorBufferInfo cameraDescriptorBufferInfo{ .buffer = cameraBuffer.buffer, .range = VK_WHOLE_SIZE };
+  VkDescriptorBufferInfo rayCountDescriptorBufferInfo{ .buffer = rayCountBuffer.buffer, .range = VK_WHOLE_SIZE };
+  std::array<VkDescriptorBufferInfo, aov_infos.size()> aovDescriptorBufferInfos;
+  std::vector<VkWriteDescriptorSet> imageWriteDescriptorSets = {
+      descriptorSetContainer.makeWrite(0 /*set index*/, BINDING_IMAGE_DATA /*binding*/, &descriptorBufferInfo),
+      descriptorSetContainer.makeWrite(0, BINDING_ACCUMULATION, &accumulationDescriptorBufferInfo),
+      descriptorSetContainer.makeWrite(0, BINDING_ACTIVE_TILES, &activeTilesDescriptorBufferInfo),
+      descriptorSetContainer.makeWrite(0, BINDING_SOBOL_DIRECTIONS, &sobolDirectionDescriptorBufferInfo),
+      descriptorSetContainer.makeWrite(0, BINDING_WORK_COUNTERS, &workCounterDescriptorBufferInfo),
+      descriptorSetContainer.makeWrite(0, BINDING_CAMERAS, &cameraDescriptorBufferInfo),
+      descriptorSetContainer.makeWrite(0, BINDING_RAY_COUNT, &rayCountDescriptorBufferInfo) };
+  for (size_t i = 0; i < aov_infos.size(); i++)
+  {
+      aovDescriptorBufferInfos[i] = { .buffer = aovBuffers[i].buffer, .range = VK_WHOLE_SIZE };
+      imageWriteDescriptorSets.push_back(descriptorSetContainer.makeWrite(0, aov_infos[i].binding, &aovDescriptorBufferInfos[i]));
+  }
+  vkUpdateDescriptorSets(context, static_cast<uint32_t>(imageWriteDescriptorSets.size()), imageWriteDescriptorSets.data(), 0, nullptr);
+  const VkDescriptorBufferInfo& albedoDescriptorBufferInfo = aovDescriptorBufferInfos[0];
+  const VkDescriptorBufferInfo& normalDescriptorBufferInfo = aovDescriptorBufferInfos[1];
+  // 14
+  WriteOutputImageDescriptor(context, descriptorSetContainer, outputImage);
+  // 1 to 5
+  WriteSceneDescriptors(context, descriptorSetContainer, scene);
+  VkDescriptorSet descriptorSet = descriptorSetContainer.getSet(0);
 
 
 
 
   
   // Shader loading and pipeline creation
+  // The output image has a format qualifier, so there is a module per format: the pipelines that write an rgba16f image
+  // use rayTraceHalfModule, and all others (whose placeholder image is rgba32f) rayTraceModule.
   VkShaderModule rayTraceModule =
       nvvk::createShaderModule(context, nvh::loadFile("shaders/raytrace.comp.glsl.spv", true, searchPaths));
+  VkShaderModule rayTraceHalfModule =
+      nvvk::createShaderModule(context, nvh::loadFile("shaders/raytrace_rgba16f.comp.glsl.spv", true, searchPaths));
+
+  // The specialization constants of the final render select the code paths of the shader (see common.h)
+  SpecConstants renderSpecConstants = GetSpecConstants(scene, options);
+  renderSpecConstants[SPEC_ADAPTIVE_SAMPLING] =
+      (options.adaptiveSampling || options.timeBudgetMs > 0.0f || options.snapshotSamples > 0 || !options.checkpointPath.empty()) ? 1 : 0;
+  renderSpecConstants[SPEC_AOV_MASK] = options.aovMask | (options.denoise ? (AOV_ALBEDO | AOV_NORMAL) : 0);
+  renderSpecConstants[SPEC_OUTPUT_IMAGE] = (usesOutputImage || multiView) ? 1 : 0;
+  renderSpecConstants[SPEC_PERSISTENT_THREADS] = options.persistentThreads ? 1 : 0;
+  // Sample-parallel rendering: when a dispatch has too few pixels to fill the GPU (small --tiled images or tiles),
+  // several invocations share each pixel. Workers and hybrid rendering always render many tiles per dispatch.
+  const uint32_t concurrentInvocations = DefaultPersistentWorkgroups(context.m_physicalDevice) * workgroup_width * workgroup_height;
+  const uint64_t dispatchPixels = tiledRendering ? uint64_t(std::min(options.tileSize, options.tiledWidth)) * std::min(options.tileSize, options.tiledHeight)
+                                  : multiView    ? uint64_t(options.viewWidth) * options.viewHeight * viewCount
+                                                 : render_width * render_height;
+  const uint32_t sampleSplit = (options.isWorker || options.hybrid) ? 1
+                               : (options.sampleSplit > 0) ? options.sampleSplit
+                                 : ChooseSampleSplit(dispatchPixels, options.adaptiveSampling ? adaptive_batch_samples : max_batch_samples,
+                                                     concurrentInvocations);
+  renderSpecConstants[SPEC_SAMPLE_SPLIT] = sampleSplit;
+  if (sampleSplit > 1)
+  {
+      printf("Sample-parallel rendering: %u invocations per pixel\n", sampleSplit);
+  }
+
+
 
-  // Describes the entrypoint and the stage to use for this shader module in the pipeline
-  VkPipelineShaderStageCreateInfo shaderStageCreateInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                                                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-                                                        .module = rayTraceModule,
-                                                        .pName = "main" };
 
-  // Create the compute pipeline
-  VkComputePipelineCreateInfo pipelineCreateInfo{ .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-                                                 .stage = shaderStageCreateInfo,
-                                                 .layout = descriptorSetContainer.getPipeLayout() };
-  // Don't modify flags, basePipelineHandle, or basePipelineIndex
-  VkPipeline computePipeline;
-  NVVK_CHECK(vkCreateComputePipelines(context,                 // Device
-      VK_NULL_HANDLE,          // Pipeline cache (uses default)
-      1, &pipelineCreateInfo,  // Compute pipeline create info
-      nullptr,                 // Allocator (uses default)
-      &computePipeline));      // Output
 
+  // Denoiser
+  // The descriptor sets of denoise.comp.glsl (see DenoiseSet); all of them read the same guides.
+  nvvk::DescriptorSetContainer denoiseDescriptorSetContainer(context);
+  denoiseDescriptorSetContainer.addBinding(DENOISE_BINDING_INPUT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  denoiseDescriptorSetContainer.addBinding(DENOISE_BINDING_OUTPUT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  denoiseDescriptorSetContainer.addBinding(DENOISE_BINDING_ALBEDO, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  denoiseDescriptorSetContainer.addBinding(DENOISE_BINDING_NORMAL, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  denoiseDescriptorSetContainer.initLayout();
+  denoiseDescriptorSetContainer.initPool(DENOISE_SET_COUNT);
+  VkPushConstantRange denoisePushConstantRange{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(DenoisePushConstants) };
+  denoiseDescriptorSetContainer.initPipeLayout(1, &denoisePushConstantRange);
+  {
+      const VkBuffer image = buffer.buffer, a = denoiseScratchBuffers[0].buffer, b = denoiseScratchBuffers[1].buffer;
+      const std::array<std::pair<VkBuffer, VkBuffer>, DENOISE_SET_COUNT> inputsAndOutputs = { { { image, a }, { a, b }, { b, a }, { a, image }, { b, image } } };
+      for (uint32_t set = 0; set < DENOISE_SET_COUNT; set++)
+      {
+          VkDescriptorBufferInfo inputInfo{ .buffer = inputsAndOutputs[set].first, .range = VK_WHOLE_SIZE };
+          VkDescriptorBufferInfo outputInfo{ .buffer = inputsAndOutputs[set].second, .range = VK_WHOLE_SIZE };
+          const std::array<VkWriteDescriptorSet, 4> denoiseWriteDescriptorSets = {
+              denoiseDescriptorSetContainer.makeWrite(set, DENOISE_BINDING_INPUT, &inputInfo),
+              denoiseDescriptorSetContainer.makeWrite(set, DENOISE_BINDING_OUTPUT, &outputInfo),
+              denoiseDescriptorSetContainer.makeWrite(set, DENOISE_BINDING_ALBEDO, &albedoDescriptorBufferInfo),
+              denoiseDescriptorSetContainer.makeWrite(set, DENOISE_BINDING_NORMAL, &normalDescriptorBufferInfo) };
+          vkUpdateDescriptorSets(context, static_cast<uint32_t>(denoiseWriteDescriptorSets.size()), denoiseWriteDescriptorSets.data(), 0, nullptr);
+      }
+  }
+  VkShaderModule denoiseModule = nvvk::createShaderModule(context, nvh::loadFile("shaders/denoise.comp.glsl.spv", true, searchPaths));
+  VkPipeline denoisePipeline = CreateComputePipeline(context, denoiseModule, denoiseDescriptorSetContainer.getPipeLayout());
+
+  // Tonemapping and encoding
+  nvvk::DescriptorSetContainer tonemapDescriptorSetContainer(context);
+  tonemapDescriptorSetContainer.addBinding(TONEMAP_BINDING_INPUT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  tonemapDescriptorSetContainer.addBinding(TONEMAP_BINDING_OUTPUT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  tonemapDescriptorSetContainer.initLayout();
+  tonemapDescriptorSetContainer.initPool(1);
+  VkPushConstantRange tonemapPushConstantRange{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(TonemapPushConstants) };
+  tonemapDescriptorSetContainer.initPipeLayout(1, &tonemapPushConstantRange);
+  {
+      VkDescriptorBufferInfo inputInfo{ .buffer = buffer.buffer, .range = VK_WHOLE_SIZE };
+      VkDescriptorBufferInfo outputInfo{ .buffer = encodedBuffer.buffer, .range = VK_WHOLE_SIZE };
+      const std::array<VkWriteDescriptorSet, 2> tonemapWriteDescriptorSets = {
+          tonemapDescriptorSetContainer.makeWrite(0, TONEMAP_BINDING_INPUT, &inputInfo),
+          tonemapDescriptorSetContainer.makeWrite(0, TONEMAP_BINDING_OUTPUT, &outputInfo) };
+      vkUpdateDescriptorSets(context, static_cast<uint32_t>(tonemapWriteDescriptorSets.size()), tonemapWriteDescriptorSets.data(), 0, nullptr);
+  }
+  VkShaderModule tonemapModule = nvvk::createShaderModule(context, nvh::loadFile("shaders/tonemap.comp.glsl.spv", true, searchPaths));
+  VkPipeline tonemapPipeline = CreateComputePipeline(context, tonemapModule, tonemapDescriptorSetContainer.getPipeLayout());
 
 
 
 
-  // Command Buffer
-  // Allocate a command buffer
-  // Create and start recording a command buffer
-  VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
 
+  // Timestamp queries
+  // A query pool with 2 timestamps, written before and after each dispatch, so that we can measure GPU time
+  VkQueryPoolCreateInfo queryPoolInfo{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                      .queryCount = 2 };
+  VkQueryPool queryPool;
+  NVVK_CHECK(vkCreateQueryPool(context, &queryPoolInfo, nullptr, &queryPool));
+  VkPhysicalDeviceProperties physicalDeviceProperties;
+  vkGetPhysicalDeviceProperties(context.m_physicalDevice, &physicalDeviceProperties);
+  const float timestampPeriod = physicalDeviceProperties.limits.timestampPeriod;
 
 
 
 
-  // Binding
-  // Bind the compute shader pipeline
-  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
 
-  // Bind the descriptor set
-  VkDescriptorSet descriptorSet = descriptorSetContainer.getSet(0);
-  vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, descriptorSetContainer.getPipeLayout(), 0, 1,
-      &descriptorSet, 0, nullptr);
-  
+  // Renderer
+  // What the render modes and benchmarks below share, and the pipeline of the final render
+  Renderer renderer{ .context = context,
+                     .allocator = allocator,
+                     .cmdPool = cmdPool,
+                     .queryPool = queryPool,
+                     .timestampPeriod = timestampPeriod,
+                     .descriptorSetContainer = descriptorSetContainer,
+                     .descriptorSet = descriptorSet,
+                     .rayTraceModule = rayTraceModule,
+                     .rayTraceHalfModule = rayTraceHalfModule,
+                     .scene = scene,
+                     .outputImage = outputImage,
+                     .buffer = buffer,
+                     .accumulationBuffer = accumulationBuffer,
+                     .activeTilesBuffer = activeTilesBuffer,
+                     .rayCountBuffer = rayCountBuffer,
+                     .tileGrid = tileGrid,
+                     .persistentWorkgroups = persistentWorkgroups,
+                     .renderConstants = renderSpecConstants,
+                     .denoiseDescriptorSetContainer = denoiseDescriptorSetContainer,
+                     .denoisePipeline = denoisePipeline };
+  renderer.renderPipeline = renderer.createPipeline(renderSpecConstants, outputImage.format);
 
 
 
-  // Dispatch
-  // Run the compute shader with enough workgroups to cover the entire buffer:
-  vkCmdDispatch(cmdBuffer, (uint32_t(render_width) + workgroup_width - 1) / workgroup_width,
-      (uint32_t(render_height) + workgroup_height - 1) / workgroup_height, 1);
 
 
+  // Benchmarks
+  // Each prints its results; the end-to-end benchmark also writes them to `options.benchmarkJson`, and the program then
+  // renders and writes no image (see Dispatch).
+  if (options.benchmarkHitFetch > 0)
+  {
+      BenchmarkHitFetch(renderer, options);
+  }
+  if (options.benchmarkOutput > 0)
+  {
+      BenchmarkOutputLayouts(renderer, options);
+  }
+  if (options.benchmarkSwizzle > 0)
+  {
+      BenchmarkSwizzles(renderer, options);
+  }
+  if (options.benchmarkPersistent > 0)
+  {
+      BenchmarkPersistentThreads(renderer, options);
+  }
+  if (options.benchmarkSampleSplit > 0)
+  {
+      BenchmarkSampleSplits(renderer, options);
+  }
+  if (options.benchmarkSplit > 0)
+  {
+      BenchmarkSplitBudgets(renderer, options, sourceMesh);
+  }
+  if (options.benchmarkTraversal > 0)
+  {
+      BenchmarkTraversal(renderer, options, mesh);
+  }
+  if (options.benchmarkSampler > 0)
+  {
+      BenchmarkSamplers(renderer, options);
+  }
+  if (options.benchmarkDenoiser)
+  {
+      BenchmarkDenoiser(renderer, options);
+  }
+  if (!options.benchmarkJson.empty())
+  {
+      BenchmarkEndToEnd(renderer, options, mesh, loadMs);
+  }
+  const bool qualityGateFailed = !options.qualityGate.empty() && !RunQualityGate(renderer, options, mesh);
 
 
 
-  // Memory Barrier
-  // Add a command that says "Make it so that memory writes by the compute shader
-  // are available to read from the CPU." (In other words, "Flush the GPU caches
-  // so the CPU can read the data.") To do this, we use a memory barrier.
-  // This is one of the most complex parts of Vulkan, so don't worry if this is
-  // confusing! We'll talk about pipeline barriers more in the extras.
-  VkMemoryBarrier memoryBarrier{.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-                                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,  // Make shader writes
-                                .dstAccessMask = VK_ACCESS_HOST_READ_BIT};    // Readable by the CPU
-  vkCmdPipelineBarrier(cmdBuffer,                                             // The command buffer
-                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,                  // From the compute shader
-                       VK_PIPELINE_STAGE_HOST_BIT,                            // To the CPU
-                       0,                                                     // No special flags
-                       1, &memoryBarrier,                                     // An array of memory barriers
-                       0, nullptr, 0, nullptr);                               // No other barriers
 
 
+  // Dispatch
+  int                exitCode = qualityGateFailed ? 1 : 0;
+  const bool         renderImage = options.benchmarkJson.empty();
+  std::vector<float> viewImages;  // With --views, the images of all views, one after the other
+  ImageWriter        imageWriter;
+  if (!renderImage)
+  {
+      // --benchmark-json has already rendered what it measures; nothing is rendered or written
+  }
+  else if (options.isWorker)
+  {
+      if (!RunWorkerJob(renderer, options))
+      {
+          exitCode = 1;
+      }
+  }
+  else if (options.hybrid)
+  {
+      RunHybrid(renderer, options, mesh);
+  }
+  else if (tiledRendering)
+  {
+      if (!RunTiled(renderer, options))
+      {
+          exitCode = 1;
+      }
+  }
+  else if (multiView)
+  {
+      RunMultiView(renderer, options, viewImages);
+  }
+  else if (options.snapshotSamples > 0)
+  {
+      if (!RunSnapshots(renderer, options, imageWriter))
+      {
+          exitCode = 1;
+      }
+  }
+  else if (options.timeBudgetMs > 0.0f)
+  {
+      RunTimeBudget(renderer, options);
+  }
+  else if (!options.adaptiveSampling && options.checkpointPath.empty())
+  {
+      RunSingleDispatch(renderer, options);
+  }
+  else if (!RunProgressive(renderer, options, mesh))
+  {
+      exitCode = 1;
+  }
 
+  // With --output-image, the color is in the storage image; copy it to `buffer`, where the rest of the program reads it
+  if (usesOutputImage && renderImage)
+  {
+      float* rgb = reinterpret_cast<float*>(allocator.map(buffer));
+      const double copyMs = ReadBackOutputImage(context, context.m_queueGCT, cmdPool, allocator, outputImage, queryPool, timestampPeriod, rgb);
+      allocator.unmap(buffer);
+      printf("Output image readback: %.3f ms image to buffer copy\n", copyMs);
+  }
 
+  // Write the AOVs, from the same dispatch as the image. With EXR output, they are layers of the image file.
+  std::vector<ImageLayer> exrLayers;
+  if (options.aovMask != 0)
+  {
+      // Only the AOVs in options.aovMask are host-visible
+      std::array<const void*, aov_infos.size()> aovData{};
+      for (size_t i = 0; i < aov_infos.size(); i++)
+      {
+          if (options.aovMask & aov_infos[i].bit)
+          {
+              aovData[i] = allocator.map(aovBuffers[i]);
+          }
+      }
+      WriteAovs(options.aovMask, aovData, mesh.originalPrimitiveIDs, imageWriter,
+                (options.outputFormat == ImageFormat::Exr) ? &exrLayers : nullptr);
+      for (size_t i = 0; i < aov_infos.size(); i++)
+      {
+          if (options.aovMask & aov_infos[i].bit)
+          {
+              allocator.unmap(aovBuffers[i]);
+          }
+      }
+  }
 
-  // Finishing operations
-  // End and submit the command buffer, then wait for it to finish:
-  EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, cmdBuffer);
+  if (options.denoise && renderImage)
+  {
+      const double denoiseMs = DenoiseAndTime(context, context.m_queueGCT, cmdPool, denoisePipeline, denoiseDescriptorSetContainer,
+                                              uint32_t(options.denoiseIterations), queryPool, timestampPeriod);
+      printf("Denoiser: %.3f ms (%d iterations)\n", denoiseMs, options.denoiseIterations);
+  }
 
-  // Get the image data back from the GPU
-  void* data = allocator.map(buffer);
-  stbi_write_hdr("out.hdr", render_width, render_height, 3, reinterpret_cast<float*>(data));
-  allocator.unmap(buffer);
+  // With --encode, read back the encoded image instead of the float one: 4 or 8 bytes per pixel instead of 12
+  if (options.encodeOutput)
+  {
+      const TonemapPushConstants tonemapPushConstants{ .width = uint32_t(render_width),
+                                                       .height = uint32_t(render_height),
+                                                       .exposure = std::exp2(options.exposure),
+                                                       .curve = options.tonemapCurve,
+                                                       .encoding = options.encoding };
+      const double tonemapMs = TonemapAndTime(context, context.m_queueGCT, cmdPool, tonemapPipeline, tonemapDescriptorSetContainer,
+                                              tonemapPushConstants, queryPool, timestampPeriod);
+
+      const auto     readbackStart = std::chrono::steady_clock::now();
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(allocator.map(encodedBuffer));
+      std::vector<uint8_t> encoded(data, data + encodedSizeBytes);
+      allocator.unmap(encodedBuffer);
+      const double readbackMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readbackStart).count();
+      printf("Encoding (%s): %.3f ms on the GPU, read back %.1f MB in %.2f ms instead of %.1f MB of floats\n",
+             encoding_names[options.encoding], tonemapMs, double(encodedSizeBytes) / 1e6, readbackMs, double(bufferSizeBytes) / 1e6);
+
+      const std::string path = (options.encoding == ENCODING_RGBA8) ? std::string("out.png")
+                                                                      : std::string("out_") + encoding_names[options.encoding] + ".raw";
+      const bool ok = (options.encoding == ENCODING_RGBA8)
+                          ? (stbi_write_png(path.c_str(), render_width, render_height, 4, encoded.data(), render_width * 4) != 0)
+                          : WriteRaw(path.c_str(), encoded.data(), encoded.size());
+      if (!ok)
+      {
+          fprintf(stderr, "Could not write %s\n", path.c_str());
+          exitCode = 1;
+      }
+  }
+  // Otherwise, get the image data back from the GPU (tiled rendering already wrote it, and a worker only renders part
+  // of it), and hand it to the writer threads; the buffer is free again as soon as it has been copied.
+  else if (multiView)
+  {
+      const size_t viewFloats = size_t(options.viewWidth) * options.viewHeight * 3;
+      for (uint32_t view = 0; view < viewCount; view++)
+      {
+          const float* data = viewImages.data() + view * viewFloats;
+          imageWriter.write(Image{ "out_view" + std::to_string(view) + "." + ImageFormatExtension(options.outputFormat), options.outputFormat,
+                                   options.viewWidth, options.viewHeight, { ImageLayer{ "", 3, std::vector<float>(data, data + viewFloats) } } });
+      }
+  }
+  else if (!tiledRendering && !options.isWorker && renderImage)
+  {
+      const float* data = reinterpret_cast<const float*>(allocator.map(buffer));
+      Image image{ std::string("out.") + ImageFormatExtension(options.outputFormat), options.outputFormat, uint32_t(render_width),
+                   uint32_t(render_height), {} };
+      image.layers.push_back(ImageLayer{ "", 3, std::vector<float>(data, data + render_width * render_height * 3) });
+      allocator.unmap(buffer);
+      std::move(exrLayers.begin(), exrLayers.end(), std::back_inserter(image.layers));
+      imageWriter.write(std::move(image));
+  }
+  if (!imageWriter.wait())
+  {
+      exitCode = 1;
+  }
+  printf("End-to-end render time: %.1f ms\n",
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
 
 
 
@@ -390,14 +3569,37 @@ int main(int argc, const char** argv)
 
 
   // Cleanup
-  vkDestroyPipeline(context, computePipeline, nullptr);
+  vkDestroyQueryPool(context, queryPool, nullptr);
+  vkDestroyPipeline(context, renderer.renderPipeline, nullptr);
   vkDestroyShaderModule(context, rayTraceModule, nullptr);
+  vkDestroyShaderModule(context, rayTraceHalfModule, nullptr);
+  vkDestroyPipeline(context, tonemapPipeline, nullptr);
+  vkDestroyShaderModule(context, tonemapModule, nullptr);
+  tonemapDescriptorSetContainer.deinit();
+  vkDestroyPipeline(context, denoisePipeline, nullptr);
+  vkDestroyShaderModule(context, denoiseModule, nullptr);
+  denoiseDescriptorSetContainer.deinit();
   descriptorSetContainer.deinit();
-  raytracingBuilder.destroy();
-  allocator.destroy(vertexBuffer);
-  allocator.destroy(indexBuffer);
+  DestroyGpuScene(scene, allocator);
+  DestroyOutputImage(context, allocator, outputImage);
   vkDestroyCommandPool(context, cmdPool, nullptr);
+  allocator.destroy(activeTilesBuffer);
+  allocator.destroy(sobolDirectionBuffer);
+  allocator.destroy(accumulationBuffer);
+  allocator.destroy(encodedBuffer);
+  allocator.destroy(workCounterBuffer);
+  allocator.destroy(cameraBuffer);
+  allocator.destroy(rayCountBuffer);
+  for (nvvk::Buffer& scratchBuffer : denoiseScratchBuffers)
+  {
+      allocator.destroy(scratchBuffer);
+  }
+  for (nvvk::Buffer& aovBuffer : aovBuffers)
+  {
+      allocator.destroy(aovBuffer);
+  }
   allocator.destroy(buffer);
   allocator.deinit();
   context.deinit();
+  return exitCode;
 }
@@ -0,0 +1,548 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+// First word of a mesh cache file ("VKMC" in little-endian), and the version of its layout.
+static const uint32_t mesh_cache_magic   = 0x434D4B56u;
+static const uint32_t mesh_cache_version = 2;
+
+// Rounds a float in [-1, 1] to a signed 16-bit normalized integer, like GLSL's packSnorm2x16.
+static uint32_t PackSnorm16(float v)
+{
+  const float clamped = std::clamp(v, -1.0f, 1.0f);
+  const auto  value   = static_cast<int16_t>(std::lround(clamped * 32767.0f));
+  return static_cast<uint16_t>(value);
+}
+
+Aabb ComputeBounds(const Mesh& mesh)
+{
+  Aabb bounds{{INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY}};
+  for(size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    bounds.min[i % 3] = std::min(bounds.min[i % 3], mesh.vertices[i]);
+    bounds.max[i % 3] = std::max(bounds.max[i % 3], mesh.vertices[i]);
+  }
+  return bounds;
+}
+
+uint32_t EncodeOctNormal(float x, float y, float z)
+{
+  // Project onto the octahedron |x| + |y| + |z| = 1:
+  const float invL1Norm = 1.0f / (std::abs(x) + std::abs(y) + std::abs(z));
+  float       u         = x * invL1Norm;
+  float       v         = y * invL1Norm;
+  // Fold the lower hemisphere over the diagonals:
+  if(z < 0.0f)
+  {
+    const float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+    const float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+    u                   = foldedU;
+    v                   = foldedV;
+  }
+  return PackSnorm16(u) | (PackSnorm16(v) << 16);
+}
+
+std::vector<PrimitiveRecord> BuildPrimitiveRecords(const Mesh& mesh)
+{
+  std::vector<PrimitiveRecord> records(mesh.numTriangles());
+  for(uint32_t primitiveID = 0; primitiveID < mesh.numTriangles(); primitiveID++)
+  {
+    const float* v0 = &mesh.vertices[3 * mesh.indices[3 * primitiveID + 0]];
+    const float* v1 = &mesh.vertices[3 * mesh.indices[3 * primitiveID + 1]];
+    const float* v2 = &mesh.vertices[3 * mesh.indices[3 * primitiveID + 2]];
+
+    PrimitiveRecord& record = records[primitiveID];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      record.v0[axis]    = v0[axis];
+      record.edge1[axis] = v1[axis] - v0[axis];
+      record.edge2[axis] = v2[axis] - v0[axis];
+    }
+
+    // Same right-handed geometric normal as getObjectHitInfo: cross(v1 - v0, v2 - v0).
+    const float* e1 = record.edge1;
+    const float* e2 = record.edge2;
+    const float  nx = e1[1] * e2[2] - e1[2] * e2[1];
+    const float  ny = e1[2] * e2[0] - e1[0] * e2[2];
+    const float  nz = e1[0] * e2[1] - e1[1] * e2[0];
+    // Degenerate triangles get an arbitrary normal instead of a NaN.
+    record.normalOct  = (nx == 0.0f && ny == 0.0f && nz == 0.0f) ? EncodeOctNormal(0.0f, 0.0f, 1.0f) : EncodeOctNormal(nx, ny, nz);
+    record.materialID = mesh.materialIDs[primitiveID];
+    record.originalPrimitiveID = mesh.originalPrimitiveIDs[primitiveID];
+  }
+  return records;
+}
+
+bool CanUse16BitIndices(const Mesh& mesh)
+{
+  return mesh.numVertices() <= 65536;
+}
+
+std::vector<uint16_t> EncodeIndices16(const Mesh& mesh)
+{
+  std::vector<uint16_t> indices16(mesh.indices.begin(), mesh.indices.end());
+  if(indices16.size() % 2 != 0)
+  {
+    indices16.push_back(0);
+  }
+  return indices16;
+}
+
+QuantizedPositions QuantizePositions(const Mesh& mesh)
+{
+  const Aabb         bounds = ComputeBounds(mesh);
+  QuantizedPositions result;
+  float              invScale[3];
+  for(int axis = 0; axis < 3; axis++)
+  {
+    const float extent  = bounds.max[axis] - bounds.min[axis];
+    result.origin[axis] = bounds.min[axis];
+    result.scale[axis]  = extent / 65535.0f;
+    invScale[axis]      = (extent > 0.0f) ? 65535.0f / extent : 0.0f;
+  }
+
+  result.packed.resize(2 * size_t(mesh.numVertices()));
+  for(uint32_t vertex = 0; vertex < mesh.numVertices(); vertex++)
+  {
+    uint32_t q[3];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      const float t = (mesh.vertices[3 * vertex + axis] - result.origin[axis]) * invScale[axis];
+      q[axis]       = static_cast<uint32_t>(std::lround(std::clamp(t, 0.0f, 65535.0f)));
+    }
+    result.packed[2 * vertex + 0] = q[0] | (q[1] << 16);
+    result.packed[2 * vertex + 1] = q[2];
+  }
+  return result;
+}
+
+// Spreads the lower 10 bits of v so that there are 2 zero bits between each of them.
+static uint32_t ExpandBits10(uint32_t v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// Returns the 30-bit Morton code of each triangle's centroid, quantized to 10 bits per axis within the mesh's bounds.
+static std::vector<uint32_t> ComputeCentroidMortonCodes(const Mesh& mesh)
+{
+  const Aabb bounds = ComputeBounds(mesh);
+  float      invExtent[3];
+  for(int axis = 0; axis < 3; axis++)
+  {
+    const float extent = bounds.max[axis] - bounds.min[axis];
+    invExtent[axis]    = (extent > 0.0f) ? 1.0f / extent : 0.0f;
+  }
+
+  std::vector<uint32_t> codes(mesh.numTriangles());
+  for(uint32_t triangle = 0; triangle < mesh.numTriangles(); triangle++)
+  {
+    uint32_t q[3];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      float centroid = 0.0f;
+      for(int corner = 0; corner < 3; corner++)
+      {
+        centroid += mesh.vertices[3 * mesh.indices[3 * triangle + corner] + axis];
+      }
+      const float t = (centroid / 3.0f - bounds.min[axis]) * invExtent[axis];
+      q[axis]       = static_cast<uint32_t>(std::clamp(t * 1024.0f, 0.0f, 1023.0f));
+    }
+    codes[triangle] = (ExpandBits10(q[0]) << 2) | (ExpandBits10(q[1]) << 1) | ExpandBits10(q[2]);
+  }
+  return codes;
+}
+
+// Returns the triangles of `mesh` sorted by the Morton codes of their centroids.
+static std::vector<uint32_t> SortTrianglesByMortonCode(const Mesh& mesh)
+{
+  const std::vector<uint32_t> codes = ComputeCentroidMortonCodes(mesh);
+  std::vector<uint32_t>       order(mesh.numTriangles());
+  std::iota(order.begin(), order.end(), 0);
+  // Stable, so that ties keep their file order and the result is deterministic.
+  std::stable_sort(order.begin(), order.end(), [&codes](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+  return order;
+}
+
+void ReorderForLocality(Mesh& mesh)
+{
+  const std::vector<uint32_t> order = SortTrianglesByMortonCode(mesh);
+
+  // Renumber the vertices in order of first use by the sorted triangles. Vertices that no triangle uses go last.
+  const uint32_t        unassigned = ~0u;
+  std::vector<uint32_t> newVertexIndex(mesh.numVertices(), unassigned);
+  std::vector<uint32_t> oldVertexOrder;
+  oldVertexOrder.reserve(mesh.numVertices());
+  std::vector<uint32_t> indices(mesh.indices.size());
+  std::vector<uint32_t> materialIDs(mesh.numTriangles());
+  std::vector<uint32_t> originalPrimitiveIDs(mesh.numTriangles());
+  for(uint32_t newTriangle = 0; newTriangle < mesh.numTriangles(); newTriangle++)
+  {
+    const uint32_t oldTriangle = order[newTriangle];
+    for(int corner = 0; corner < 3; corner++)
+    {
+      const uint32_t oldVertex = mesh.indices[3 * oldTriangle + corner];
+      if(newVertexIndex[oldVertex] == unassigned)
+      {
+        newVertexIndex[oldVertex] = static_cast<uint32_t>(oldVertexOrder.size());
+        oldVertexOrder.push_back(oldVertex);
+      }
+      indices[3 * newTriangle + corner] = newVertexIndex[oldVertex];
+    }
+    materialIDs[newTriangle]          = mesh.materialIDs[oldTriangle];
+    originalPrimitiveIDs[newTriangle] = mesh.originalPrimitiveIDs[oldTriangle];
+  }
+  for(uint32_t oldVertex = 0; oldVertex < mesh.numVertices(); oldVertex++)
+  {
+    if(newVertexIndex[oldVertex] == unassigned)
+    {
+      newVertexIndex[oldVertex] = static_cast<uint32_t>(oldVertexOrder.size());
+      oldVertexOrder.push_back(oldVertex);
+    }
+  }
+
+  std::vector<float> vertices(mesh.vertices.size());
+  for(uint32_t newVertex = 0; newVertex < mesh.numVertices(); newVertex++)
+  {
+    for(int axis = 0; axis < 3; axis++)
+    {
+      vertices[3 * newVertex + axis] = mesh.vertices[3 * oldVertexOrder[newVertex] + axis];
+    }
+  }
+
+  mesh.vertices             = std::move(vertices);
+  mesh.indices              = std::move(indices);
+  mesh.materialIDs          = std::move(materialIDs);
+  mesh.originalPrimitiveIDs = std::move(originalPrimitiveIDs);
+}
+
+double SimulateHitLookupCacheHitRate(const Mesh& mesh, uint32_t bytesPerIndex, uint32_t bytesPerVertex, uint32_t cacheBytes, uint32_t lineBytes, uint32_t ways)
+{
+  const uint32_t numSets = std::max(1u, cacheBytes / (lineBytes * ways));
+  // For each set, the tags of its lines and when they were last used (0 = empty).
+  std::vector<uint64_t> tags(size_t(numSets) * ways, 0);
+  std::vector<uint64_t> lastUse(size_t(numSets) * ways, 0);
+  uint64_t              clock    = 0;
+  uint64_t              accesses = 0;
+  uint64_t              hits     = 0;
+
+  // Looks up the cache line containing `address`, and loads it on a miss, replacing the least recently used line.
+  auto access = [&](uint64_t address) {
+    const uint64_t line = address / lineBytes;
+    const size_t   set  = size_t(line % numSets) * ways;
+    size_t         lru  = set;
+    clock++;
+    accesses++;
+    for(size_t way = set; way < set + ways; way++)
+    {
+      if(lastUse[way] != 0 && tags[way] == line)
+      {
+        lastUse[way] = clock;
+        hits++;
+        return;
+      }
+      if(lastUse[way] < lastUse[lru])
+      {
+        lru = way;
+      }
+    }
+    tags[lru]    = line;
+    lastUse[lru] = clock;
+  };
+
+  // The index and vertex buffers are separate allocations; place the vertex buffer after the index buffer.
+  const uint64_t vertexBufferOffset = (uint64_t(mesh.indices.size()) * bytesPerIndex + lineBytes - 1) / lineBytes * lineBytes;
+  for(const uint32_t triangle : SortTrianglesByMortonCode(mesh))
+  {
+    for(int corner = 0; corner < 3; corner++)
+    {
+      access(uint64_t(3 * triangle + corner) * bytesPerIndex);
+    }
+    for(int corner = 0; corner < 3; corner++)
+    {
+      access(vertexBufferOffset + uint64_t(mesh.indices[3 * triangle + corner]) * bytesPerVertex);
+    }
+  }
+  return (accesses > 0) ? double(hits) / double(accesses) : 1.0;
+}
+
+// Hash of a vertex position, by the bits of its coordinates
+struct PositionHash
+{
+  size_t operator()(const std::array<float, 3>& position) const
+  {
+    uint32_t bits[3];
+    memcpy(bits, position.data(), sizeof(bits));
+    return size_t((uint64_t(bits[0]) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(bits[1]) * 0xC2B2AE3D27D4EB4Full) ^ bits[2]);
+  }
+};
+
+// Returns the surface area of the bounding box of triangle `triangle` of `mesh`.
+static float TriangleBoundsArea(const Mesh& mesh, uint32_t triangle)
+{
+  float extent[3];
+  for(int axis = 0; axis < 3; axis++)
+  {
+    const float a = mesh.vertices[3 * mesh.indices[3 * triangle + 0] + axis];
+    const float b = mesh.vertices[3 * mesh.indices[3 * triangle + 1] + axis];
+    const float c = mesh.vertices[3 * mesh.indices[3 * triangle + 2] + axis];
+    extent[axis]  = std::max({a, b, c}) - std::min({a, b, c});
+  }
+  return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+// Key of the edge between the vertices with canonical IDs a and b, in either order
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+  return (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+}
+
+uint32_t SplitLargeTriangles(Mesh& mesh, float areaThreshold, uint32_t extraTriangleBudget)
+{
+  if(mesh.numTriangles() == 0 || extraTriangleBudget == 0)
+  {
+    return 0;
+  }
+
+  double totalArea = 0.0;
+  for(uint32_t triangle = 0; triangle < mesh.numTriangles(); triangle++)
+  {
+    totalArea += TriangleBoundsArea(mesh, triangle);
+  }
+  const float minSplitArea = areaThreshold * float(totalArea / mesh.numTriangles());
+
+  // Vertices at the same position are one vertex for finding neighbours: the canonical ID of a vertex is the
+  // index of the first vertex at its position, so that triangles that share an edge only by position (e.g. at
+  // the seams of an OBJ file) are split at the same midpoint too.
+  std::vector<uint32_t> canonical(mesh.numVertices());
+  {
+    std::unordered_map<std::array<float, 3>, uint32_t, PositionHash> firstAtPosition;
+    for(uint32_t vertex = 0; vertex < mesh.numVertices(); vertex++)
+    {
+      const std::array<float, 3> position = {mesh.vertices[3 * vertex], mesh.vertices[3 * vertex + 1], mesh.vertices[3 * vertex + 2]};
+      canonical[vertex] = firstAtPosition.emplace(position, vertex).first->second;
+    }
+  }
+  // The triangles of each edge
+  std::unordered_map<uint64_t, std::vector<uint32_t>> edgeTriangles;
+  const auto addEdge = [&](uint32_t a, uint32_t b, uint32_t triangle) {
+    edgeTriangles[EdgeKey(canonical[a], canonical[b])].push_back(triangle);
+  };
+  const auto replaceEdgeTriangle = [&](uint32_t a, uint32_t b, uint32_t from, uint32_t to) {
+    std::vector<uint32_t>& triangles = edgeTriangles[EdgeKey(canonical[a], canonical[b])];
+    std::replace(triangles.begin(), triangles.end(), from, to);
+  };
+  for(uint32_t triangle = 0; triangle < mesh.numTriangles(); triangle++)
+  {
+    for(int corner = 0; corner < 3; corner++)
+    {
+      addEdge(mesh.indices[3 * triangle + corner], mesh.indices[3 * triangle + (corner + 1) % 3], triangle);
+    }
+  }
+
+  // Max-heap of (bounds area, triangle) of the triangles that are above the threshold. Splitting a neighbour
+  // changes a triangle without removing its entry, so entries whose area isn't the triangle's anymore are skipped.
+  std::priority_queue<std::pair<float, uint32_t>> queue;
+  for(uint32_t triangle = 0; triangle < mesh.numTriangles(); triangle++)
+  {
+    const float area = TriangleBoundsArea(mesh, triangle);
+    if(area > minSplitArea)
+    {
+      queue.push({area, triangle});
+    }
+  }
+
+  uint32_t added = 0;
+  while(!queue.empty())
+  {
+    const auto [queuedArea, triangle] = queue.top();
+    queue.pop();
+    if(TriangleBoundsArea(mesh, triangle) != queuedArea)
+    {
+      continue;
+    }
+
+    // Find the longest edge (corner, corner + 1):
+    uint32_t corners[3] = {mesh.indices[3 * triangle + 0], mesh.indices[3 * triangle + 1], mesh.indices[3 * triangle + 2]};
+    int      longest    = 0;
+    float    longestLengthSquared = -1.0f;
+    for(int corner = 0; corner < 3; corner++)
+    {
+      const float* a             = &mesh.vertices[3 * corners[corner]];
+      const float* b             = &mesh.vertices[3 * corners[(corner + 1) % 3]];
+      const float  lengthSquared = (b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) + (b[2] - a[2]) * (b[2] - a[2]);
+      if(lengthSquared > longestLengthSquared)
+      {
+        longest              = corner;
+        longestLengthSquared = lengthSquared;
+      }
+    }
+
+    // Every triangle on the edge is split at its midpoint m, so that no T-junction (and no crack) appears: each
+    // triangle (x, y, z) whose edge (x, y) it is becomes (x, m, z) and (m, y, z), which keeps the winding order.
+    const uint64_t              edge      = EdgeKey(canonical[corners[longest]], canonical[corners[(longest + 1) % 3]]);
+    const std::vector<uint32_t> neighbours = edgeTriangles[edge];
+    if(added + neighbours.size() > extraTriangleBudget)
+    {
+      break;
+    }
+    const uint32_t m = mesh.numVertices();
+    for(int axis = 0; axis < 3; axis++)
+    {
+      mesh.vertices.push_back(0.5f * (mesh.vertices[3 * corners[longest] + axis] + mesh.vertices[3 * corners[(longest + 1) % 3] + axis]));
+    }
+    canonical.push_back(m);
+    edgeTriangles.erase(edge);
+
+    for(const uint32_t neighbour : neighbours)
+    {
+      // Rotate the neighbour's corners so that the edge is (x, y)
+      uint32_t* index = &mesh.indices[3 * neighbour];
+      int       first = 0;
+      while(EdgeKey(canonical[index[first]], canonical[index[(first + 1) % 3]]) != edge)
+      {
+        first++;
+      }
+      const uint32_t x = index[first];
+      const uint32_t y = index[(first + 1) % 3];
+      const uint32_t z = index[(first + 2) % 3];
+
+      const uint32_t newTriangle = mesh.numTriangles();
+      index[0]                   = x;
+      index[1]                   = m;
+      index[2]                   = z;
+      mesh.indices.insert(mesh.indices.end(), {m, y, z});
+      mesh.materialIDs.push_back(mesh.materialIDs[neighbour]);
+      mesh.originalPrimitiveIDs.push_back(mesh.originalPrimitiveIDs[neighbour]);
+      added++;
+
+      // (z, x) stays with `neighbour`, (y, z) moves to the new triangle, and the halves of (x, y) and (m, z) are new
+      replaceEdgeTriangle(y, z, neighbour, newTriangle);
+      addEdge(x, m, neighbour);
+      addEdge(m, z, neighbour);
+      addEdge(m, y, newTriangle);
+      addEdge(m, z, newTriangle);
+
+      for(const uint32_t half : {neighbour, newTriangle})
+      {
+        const float area = TriangleBoundsArea(mesh, half);
+        if(area > minSplitArea)
+        {
+          queue.push({area, half});
+        }
+      }
+    }
+  }
+  return added;
+}
+
+bool WriteMeshCache(const std::string& path, const Mesh& mesh, const std::string& description)
+{
+  FILE* file = fopen(path.c_str(), "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  const uint32_t header[6] = {mesh_cache_magic,      mesh_cache_version,  uint32_t(description.size()),
+                              mesh.numVertices(),    mesh.numTriangles(), mesh.numMaterials};
+  bool           ok = (fwrite(header, sizeof(uint32_t), 6, file) == 6);
+  ok = ok && (fwrite(description.data(), 1, description.size(), file) == description.size());
+  ok = ok && (fwrite(mesh.vertices.data(), sizeof(float), mesh.vertices.size(), file) == mesh.vertices.size());
+  ok = ok && (fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size());
+  ok = ok && (fwrite(mesh.materialIDs.data(), sizeof(uint32_t), mesh.materialIDs.size(), file) == mesh.materialIDs.size());
+  ok = ok
+       && (fwrite(mesh.originalPrimitiveIDs.data(), sizeof(uint32_t), mesh.originalPrimitiveIDs.size(), file)
+           == mesh.originalPrimitiveIDs.size());
+  return (fclose(file) == 0) && ok;
+}
+
+// Reads `count` elements of a mesh cache into `v`, after checking that the `remainingBytes` of the file hold them,
+// so that a corrupt count can't allocate more than the file.
+template <typename Container>
+static bool ReadCacheArray(FILE* file, Container& v, uint64_t count, uint64_t& remainingBytes)
+{
+  using T = typename Container::value_type;
+  if(count > remainingBytes / sizeof(T))
+  {
+    return false;
+  }
+  remainingBytes -= count * sizeof(T);
+  v.resize(size_t(count));
+  return fread(v.data(), sizeof(T), v.size(), file) == v.size();
+}
+
+bool ReadMeshCache(const std::string& path, Mesh& mesh, std::string& description)
+{
+  std::error_code error;
+  const uint64_t  fileSize   = std::filesystem::file_size(path, error);
+  const uint64_t  headerSize = 6 * sizeof(uint32_t);
+  if(error || fileSize < headerSize)
+  {
+    return false;
+  }
+  FILE* file = fopen(path.c_str(), "rb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  uint64_t remainingBytes = fileSize - headerSize;
+  uint32_t header[6];
+  bool     ok = (fread(header, sizeof(uint32_t), 6, file) == 6) && (header[0] == mesh_cache_magic)
+            && (header[1] == mesh_cache_version) && (header[5] > 0);
+  const uint64_t numTriangles = header[4];
+  ok = ok && ReadCacheArray(file, description, header[2], remainingBytes)
+       && ReadCacheArray(file, mesh.vertices, uint64_t(header[3]) * 3, remainingBytes)
+       && ReadCacheArray(file, mesh.indices, numTriangles * 3, remainingBytes)
+       && ReadCacheArray(file, mesh.materialIDs, numTriangles, remainingBytes)
+       && ReadCacheArray(file, mesh.originalPrimitiveIDs, numTriangles, remainingBytes);
+  fclose(file);
+  if(!ok)
+  {
+    return false;
+  }
+  // The shader reads vertices and materials by these, so they must be in range:
+  mesh.numMaterials = header[5];
+  const uint32_t numVertices = mesh.numVertices();
+  return std::all_of(mesh.indices.begin(), mesh.indices.end(), [numVertices](uint32_t i) { return i < numVertices; })
+         && std::all_of(mesh.materialIDs.begin(), mesh.materialIDs.end(), [&mesh](uint32_t m) { return m < mesh.numMaterials; });
+}
+
+bool WriteObjMesh(const std::string& path, const Mesh& mesh, const std::string& comment)
+{
+  FILE* file = fopen(path.c_str(), "w");
+  if(file == nullptr)
+  {
+    return false;
+  }
+  size_t lineStart = 0;
+  while(lineStart < comment.size())
+  {
+    const size_t lineEnd = std::min(comment.find('\n', lineStart), comment.size());
+    fprintf(file, "# %s\n", comment.substr(lineStart, lineEnd - lineStart).c_str());
+    lineStart = lineEnd + 1;
+  }
+  fprintf(file, "o mesh\n");
+  for(size_t i = 0; i < mesh.vertices.size(); i += 3)
+  {
+    fprintf(file, "v %.7g %.7g %.7g\n", mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+  }
+  // OBJ indices start at 1
+  for(size_t i = 0; i < mesh.indices.size(); i += 3)
+  {
+    fprintf(file, "f %u %u %u\n", mesh.indices[i] + 1, mesh.indices[i + 1] + 1, mesh.indices[i + 2] + 1);
+  }
+  const bool ok = (ferror(file) == 0);
+  return (fclose(file) == 0) && ok;
+}
@@ -0,0 +1,113 @@
+// CPU-side triangle mesh and the preprocessing passes that run on it before it is uploaded to the GPU.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// A triangle mesh, as it is uploaded to the GPU.
+struct Mesh
+{
+  std::vector<float>    vertices;     // 3 floats (x, y, z) per vertex
+  std::vector<uint32_t> indices;      // 3 vertex indices per triangle
+  std::vector<uint32_t> materialIDs;  // 1 material index per triangle, less than numMaterials
+  // For each triangle, the index of the triangle in the source file it came from. Preprocessing passes
+  // that reorder or split triangles keep this up to date, so that shading can refer to the source triangle.
+  std::vector<uint32_t> originalPrimitiveIDs;
+  uint32_t              numMaterials = 1;  // Size of the material table of the source file (at least 1)
+
+  uint32_t numVertices() const { return static_cast<uint32_t>(vertices.size() / 3); }
+  uint32_t numTriangles() const { return static_cast<uint32_t>(indices.size() / 3); }
+};
+
+// An axis-aligned bounding box.
+struct Aabb
+{
+  float min[3];
+  float max[3];
+};
+
+// Returns the bounding box of all vertices of `mesh`.
+Aabb ComputeBounds(const Mesh& mesh);
+
+// Everything getObjectHitInfo needs to know about a triangle, packed so that the shader can read it
+// with one fetch of PRIMITIVE_RECORD_VEC4S aligned vec4s instead of 3 index loads and 3 dependent
+// vertex loads. The layout matches the vec4s read by raytrace.comp.glsl:
+//   vec4 0: v0.xyz,    normalOct  (oct-encoded geometric normal, 2 x snorm16)
+//   vec4 1: edge1.xyz, materialID
+//   vec4 2: edge2.xyz, originalPrimitiveID
+struct PrimitiveRecord
+{
+  float    v0[3];
+  uint32_t normalOct;
+  float    edge1[3];  // v1 - v0
+  uint32_t materialID;
+  float    edge2[3];  // v2 - v0
+  uint32_t originalPrimitiveID;
+};
+static_assert(sizeof(PrimitiveRecord) == PRIMITIVE_RECORD_VEC4S * 4 * sizeof(float), "PrimitiveRecord must match the shader");
+
+// Encodes a unit vector using the octahedral mapping, and packs it into 2 snorm16 values, like GLSL's
+// packSnorm2x16 (x in the low 16 bits).
+uint32_t EncodeOctNormal(float x, float y, float z);
+
+// Builds one PrimitiveRecord per triangle of `mesh`, in the same order as the triangles, so that the
+// records can be looked up with rayQueryGetIntersectionPrimitiveIndexEXT.
+std::vector<PrimitiveRecord> BuildPrimitiveRecords(const Mesh& mesh);
+
+// Returns true if all vertex indices of `mesh` fit into VK_INDEX_TYPE_UINT16.
+bool CanUse16BitIndices(const Mesh& mesh);
+
+// Converts the indices of `mesh` to 16 bits. The result is padded with a 0 to an even number of indices,
+// so that the shader can read it as an array of uints holding 2 indices each (the first in the low bits).
+std::vector<uint16_t> EncodeIndices16(const Mesh& mesh);
+
+// Vertex positions stored as 16-bit fixed point relative to the mesh's bounding box, for the shading
+// side only (acceleration structures are still built from the exact float positions).
+// Vertex i is decoded as origin + scale * (x, y, z), where x and y are the low and high 16 bits of
+// packed[2*i], and z is packed[2*i+1].
+struct QuantizedPositions
+{
+  float                 origin[3];
+  float                 scale[3];
+  std::vector<uint32_t> packed;  // 2 words per vertex
+};
+
+QuantizedPositions QuantizePositions(const Mesh& mesh);
+
+// Reorders `mesh` for memory locality of hit lookups: sorts the triangles along a Z-order (Morton) curve
+// through their centroids, so that triangles that are close in space are close in the index buffer, then
+// renumbers the vertices in the order the sorted triangles first use them. Material IDs and original
+// primitive IDs are permuted along with the triangles.
+void ReorderForLocality(Mesh& mesh);
+
+// Estimates how well the hit lookups of getObjectHitInfo (3 indices, then 3 vertices) hit in a cache,
+// by replaying them for all triangles in spatial (Morton) order - a stand-in for coherent rays hitting
+// neighbouring triangles - through a set-associative LRU cache model. Returns the hit rate in [0, 1].
+// This is a proxy for the GPU's L2 hit rate, which core Vulkan doesn't expose.
+double SimulateHitLookupCacheHitRate(const Mesh& mesh, uint32_t bytesPerIndex, uint32_t bytesPerVertex,
+                                     uint32_t cacheBytes = 64 * 1024, uint32_t lineBytes = 128, uint32_t ways = 8);
+
+// Early split: large triangles have large bounding boxes that overlap much of the scene, which makes BVH
+// traversal slow. This splits each triangle whose bounding box surface area is more than `areaThreshold`
+// times the average at the midpoint of its longest edge, largest triangles first, until no triangle is
+// above the threshold or the next split would add more than `extraTriangleBudget` triangles in total. The
+// other triangles on that edge (found by vertex position) are split at the same new vertex, so that the mesh
+// stays free of T-junctions, which would show as cracks. New triangles keep the material and original
+// primitive ID of the triangle they were split from. Returns the number of added triangles.
+uint32_t SplitLargeTriangles(Mesh& mesh, float areaThreshold, uint32_t extraTriangleBudget);
+
+// The mesh cache: a binary file of `mesh`'s arrays as they are in memory, which loads much faster than an OBJ file
+// of millions of triangles. `description` is stored with it, e.g. the settings of the generator that made the mesh.
+// Returns false if the file can't be written.
+bool WriteMeshCache(const std::string& path, const Mesh& mesh, const std::string& description);
+
+// Reads a file written by WriteMeshCache. Returns false if the file can't be read, isn't a mesh cache, is truncated,
+// or has vertex indices or material IDs out of range.
+bool ReadMeshCache(const std::string& path, Mesh& mesh, std::string& description);
+
+// Writes the vertices and triangles of `mesh` as an OBJ file with one shape, as LoadObjMesh in main.cpp reads it.
+// Each line of `comment` becomes a comment line at the start of the file. Returns false if the file can't be written.
+bool WriteObjMesh(const std::string& path, const Mesh& mesh, const std::string& comment);
@@ -0,0 +1,382 @@
+#include "procedural.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+
+static const float pi = 3.14159265358979f;
+
+// Uniform float in [0, 1). std::mt19937's output is the same on all platforms, unlike std::uniform_real_distribution's.
+static float NextFloat(std::mt19937& rng)
+{
+  return float(rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t AddVertex(Mesh& mesh, float x, float y, float z)
+{
+  mesh.vertices.insert(mesh.vertices.end(), {x, y, z});
+  return mesh.numVertices() - 1;
+}
+
+static void AddTriangle(Mesh& mesh, uint32_t a, uint32_t b, uint32_t c)
+{
+  mesh.indices.insert(mesh.indices.end(), {a, b, c});
+}
+
+// Adds the quad a, b, c, d (vertex indices, in order around it) as 2 triangles. The shader's normal is
+// cross(b - a, c - a), and must point out of the surface, since bounces leave along it.
+static void AddQuad(Mesh& mesh, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+  AddTriangle(mesh, a, b, c);
+  AddTriangle(mesh, a, c, d);
+}
+
+// Adds a UV sphere with `rings` bands of latitude and `segments` of longitude: 2 * segments * (rings - 1) triangles.
+static void AddUvSphere(Mesh& mesh, const float center[3], float radius, uint32_t rings, uint32_t segments)
+{
+  const uint32_t northPole = AddVertex(mesh, center[0], center[1] + radius, center[2]);
+  for(uint32_t ring = 1; ring < rings; ring++)
+  {
+    const float theta = pi * float(ring) / float(rings);
+    for(uint32_t segment = 0; segment < segments; segment++)
+    {
+      const float phi = 2.0f * pi * float(segment) / float(segments);
+      AddVertex(mesh, center[0] + radius * std::sin(theta) * std::cos(phi), center[1] + radius * std::cos(theta),
+                center[2] + radius * std::sin(theta) * std::sin(phi));
+    }
+  }
+  const uint32_t southPole  = AddVertex(mesh, center[0], center[1] - radius, center[2]);
+  const auto     ringVertex = [&](uint32_t ring, uint32_t segment) {
+    return northPole + 1 + (ring - 1) * segments + segment % segments;
+  };
+  for(uint32_t segment = 0; segment < segments; segment++)
+  {
+    AddTriangle(mesh, northPole, ringVertex(1, segment + 1), ringVertex(1, segment));
+    for(uint32_t ring = 1; ring + 1 < rings; ring++)
+    {
+      AddQuad(mesh, ringVertex(ring, segment), ringVertex(ring, segment + 1), ringVertex(ring + 1, segment + 1),
+              ringVertex(ring + 1, segment));
+    }
+    AddTriangle(mesh, ringVertex(rings - 1, segment), ringVertex(rings - 1, segment + 1), southPole);
+  }
+}
+
+// Adds the 12 triangles of the box [min, max].
+static void AddBox(Mesh& mesh, const float min[3], const float max[3])
+{
+  uint32_t corners[8];  // Corner i is at max in the axes of its bits: x is bit 0, y bit 1, z bit 2
+  for(uint32_t i = 0; i < 8; i++)
+  {
+    corners[i] = AddVertex(mesh, (i & 1) ? max[0] : min[0], (i & 2) ? max[1] : min[1], (i & 4) ? max[2] : min[2]);
+  }
+  AddQuad(mesh, corners[2], corners[6], corners[7], corners[3]);  // +y
+  AddQuad(mesh, corners[0], corners[1], corners[5], corners[4]);  // -y
+  AddQuad(mesh, corners[1], corners[3], corners[7], corners[5]);  // +x
+  AddQuad(mesh, corners[0], corners[4], corners[6], corners[2]);  // -x
+  AddQuad(mesh, corners[4], corners[5], corners[7], corners[6]);  // +z
+  AddQuad(mesh, corners[0], corners[2], corners[3], corners[1]);  // -z
+}
+
+// All triangles of a generated mesh use material 0, and are their own original primitives.
+static void FinishMesh(Mesh& mesh)
+{
+  mesh.materialIDs.assign(mesh.numTriangles(), 0);
+  mesh.originalPrimitiveIDs.resize(mesh.numTriangles());
+  std::iota(mesh.originalPrimitiveIDs.begin(), mesh.originalPrimitiveIDs.end(), 0);
+}
+
+Mesh MakeSphereField(uint32_t targetTriangles)
+{
+  Mesh mesh;
+  const uint32_t ground[4] = {AddVertex(mesh, -1.0f, 0.0f, -1.0f), AddVertex(mesh, -1.0f, 0.0f, 1.0f),
+                              AddVertex(mesh, 1.0f, 0.0f, 1.0f), AddVertex(mesh, 1.0f, 0.0f, -1.0f)};
+  AddQuad(mesh, ground[0], ground[1], ground[2], ground[3]);
+
+  // 2 * segments * (rings - 1) triangles per sphere, with twice as many segments as rings:
+  const uint32_t gridSize = 4;
+  const uint32_t perSphere = targetTriangles / (gridSize * gridSize * gridSize);
+  const uint32_t rings     = std::max(3u, uint32_t(std::lround(0.5 + std::sqrt(0.25 + perSphere / 4.0))));
+  for(uint32_t i = 0; i < gridSize * gridSize * gridSize; i++)
+  {
+    const float center[3] = {-0.75f + 0.5f * float(i % gridSize), 0.25f + 0.5f * float(i / gridSize % gridSize),
+                             -0.75f + 0.5f * float(i / (gridSize * gridSize))};
+    AddUvSphere(mesh, center, 0.2f, rings, 2 * rings);
+  }
+  FinishMesh(mesh);
+  return mesh;
+}
+
+// Height of the outdoor scene's terrain at (x, z).
+static float TerrainHeight(float x, float z)
+{
+  return 0.4f * std::sin(0.15f * x) * std::cos(0.11f * z) + 0.15f * std::sin(0.4f * x + 0.3f * z) - 0.6f;
+}
+
+Mesh MakeOutdoorScene(uint32_t targetTriangles)
+{
+  Mesh mesh;
+  // Half of the triangles are terrain, over x in [-40, 40] and z in [-120, 4] (the camera is at z = 6)
+  const float    minX = -40.0f, maxX = 40.0f, minZ = -120.0f, maxZ = 4.0f;
+  const uint32_t cells = std::max(1u, uint32_t(std::sqrt(targetTriangles / 4.0)));
+  const uint32_t first = mesh.numVertices();
+  for(uint32_t row = 0; row <= cells; row++)
+  {
+    for(uint32_t column = 0; column <= cells; column++)
+    {
+      const float x = minX + (maxX - minX) * float(column) / float(cells);
+      const float z = minZ + (maxZ - minZ) * float(row) / float(cells);
+      AddVertex(mesh, x, TerrainHeight(x, z), z);
+    }
+  }
+  for(uint32_t row = 0; row < cells; row++)
+  {
+    for(uint32_t column = 0; column < cells; column++)
+    {
+      const uint32_t corner = first + row * (cells + 1) + column;
+      AddQuad(mesh, corner, corner + cells + 1, corner + cells + 2, corner + 1);
+    }
+  }
+
+  // The other half are boxes standing on it, from pebbles to small buildings
+  std::mt19937   rng(1);
+  const uint32_t boxes = targetTriangles / 2 / 12;
+  for(uint32_t i = 0; i < boxes; i++)
+  {
+    const float x     = minX + (maxX - minX) * NextFloat(rng);
+    const float z     = minZ + (maxZ - 2.0f - minZ) * NextFloat(rng);
+    const float size  = 0.05f + 0.5f * NextFloat(rng) * NextFloat(rng);
+    const float base  = TerrainHeight(x, z) - 0.05f;
+    const float min[3] = {x - size, base, z - size};
+    const float max[3] = {x + size, base + size * (1.0f + 3.0f * NextFloat(rng)), z + size};
+    AddBox(mesh, min, max);
+  }
+  FinishMesh(mesh);
+  return mesh;
+}
+
+// Standard normal random number, with the Box-Muller transform
+static float NextNormal(std::mt19937& rng)
+{
+  const float radius = std::sqrt(-2.0f * std::log(1.0f - NextFloat(rng)));
+  return radius * std::cos(2.0f * pi * NextFloat(rng));
+}
+
+// Names of SceneLayout and SizeDistribution values, in their order
+static const char* const layout_names[] = {"uniform", "clustered", "thin"};
+static const char* const size_names[]   = {"uniform", "lognormal", "powerlaw"};
+
+Mesh GenerateScene(const SceneGeneratorSettings& settings)
+{
+  // A regular tetrahedron centered on the origin, with its faces wound outwards. Its edges are sqrt(8) long;
+  // scaling by unitEdge gives edge length 1.
+  static const float    tetrahedron_vertices[4][3] = {{1.0f, 1.0f, 1.0f}, {1.0f, -1.0f, -1.0f}, {-1.0f, 1.0f, -1.0f}, {-1.0f, -1.0f, 1.0f}};
+  static const uint32_t tetrahedron_faces[4][3]    = {{0, 1, 2}, {0, 3, 1}, {0, 2, 3}, {1, 3, 2}};
+  const float           unitEdge                   = 1.0f / std::sqrt(8.0f);
+
+  // Where the objects go: the bounds of the uniform and thin layouts, and the centers of the clusters
+  const float clusterSigma = 0.1f;
+  float       layoutMin[3] = {-1.0f, 0.0f, -1.0f};
+  float       layoutMax[3] = {1.0f, 2.0f, 1.0f};
+  float       volume       = 8.0f;  // Of the space the objects fill
+  if(settings.layout == SceneLayout::Clustered)
+  {
+    volume = 16.0f * std::pow(4.0f * clusterSigma, 3.0f);
+  }
+  else if(settings.layout == SceneLayout::Thin)
+  {
+    const float thinMin[3] = {-0.1f, 0.9f, -99.0f};
+    const float thinMax[3] = {0.1f, 1.1f, 1.0f};
+    std::copy(thinMin, thinMin + 3, layoutMin);
+    std::copy(thinMax, thinMax + 3, layoutMax);
+    volume = 0.2f * 0.2f * 100.0f;
+  }
+  std::mt19937 rng(settings.seed);
+  float        clusters[16][3];
+  for(auto& center : clusters)
+  {
+    for(int axis = 0; axis < 3; axis++)
+    {
+      center[axis] = layoutMin[axis] + 0.2f + (layoutMax[axis] - layoutMin[axis] - 0.4f) * NextFloat(rng);
+    }
+  }
+
+  const uint32_t objects = std::max(settings.triangles / 4, 1u);
+  const float    median  = (settings.size > 0.0f) ? settings.size : 0.5f * std::cbrt(volume / float(objects));
+  Mesh           mesh;
+  mesh.vertices.reserve(size_t(objects) * 4 * 3);
+  mesh.indices.reserve(size_t(objects) * 4 * 3);
+  for(uint32_t object = 0; object < objects; object++)
+  {
+    float center[3];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      center[axis] = (settings.layout == SceneLayout::Clustered) ?
+                         clusters[object % 16][axis] + clusterSigma * NextNormal(rng) :
+                         layoutMin[axis] + (layoutMax[axis] - layoutMin[axis]) * NextFloat(rng);
+    }
+
+    float scale = median;
+    if(settings.sizes == SizeDistribution::LogNormal)
+    {
+      scale *= std::exp(NextNormal(rng));
+    }
+    else if(settings.sizes == SizeDistribution::PowerLaw)
+    {
+      // The Pareto distribution's median is 2^(1/1.5) times its minimum
+      scale *= std::min(std::pow(2.0f * (1.0f - NextFloat(rng)), -1.0f / 1.5f), 100.0f);
+    }
+    scale *= unitEdge;
+
+    // A uniformly distributed rotation, from a random unit quaternion (Shoemake)
+    const float u  = NextFloat(rng);
+    const float a1 = 2.0f * pi * NextFloat(rng);
+    const float a2 = 2.0f * pi * NextFloat(rng);
+    const float qx = std::sqrt(1.0f - u) * std::sin(a1), qy = std::sqrt(1.0f - u) * std::cos(a1);
+    const float qz = std::sqrt(u) * std::sin(a2), qw = std::sqrt(u) * std::cos(a2);
+    const float rotation[3][3] = {{1.0f - 2.0f * (qy * qy + qz * qz), 2.0f * (qx * qy - qz * qw), 2.0f * (qx * qz + qy * qw)},
+                                  {2.0f * (qx * qy + qz * qw), 1.0f - 2.0f * (qx * qx + qz * qz), 2.0f * (qy * qz - qx * qw)},
+                                  {2.0f * (qx * qz - qy * qw), 2.0f * (qy * qz + qx * qw), 1.0f - 2.0f * (qx * qx + qy * qy)}};
+
+    const uint32_t first = mesh.numVertices();
+    for(const auto& v : tetrahedron_vertices)
+    {
+      float p[3];
+      for(int axis = 0; axis < 3; axis++)
+      {
+        p[axis] = center[axis] + scale * (rotation[axis][0] * v[0] + rotation[axis][1] * v[1] + rotation[axis][2] * v[2]);
+      }
+      AddVertex(mesh, p[0], p[1], p[2]);
+    }
+    for(const auto& face : tetrahedron_faces)
+    {
+      AddTriangle(mesh, first + face[0], first + face[1], first + face[2]);
+    }
+  }
+  FinishMesh(mesh);
+  return mesh;
+}
+
+std::string FormatSceneGeneratorSettings(const SceneGeneratorSettings& settings)
+{
+  char text[256];
+  snprintf(text, sizeof(text), "triangles=%u instances=%u layout=%s sizes=%s size=%g seed=%u", settings.triangles,
+           settings.instances, layout_names[int(settings.layout)], size_names[int(settings.sizes)], settings.size, settings.seed);
+  return text;
+}
+
+bool ParseSceneGeneratorSetting(const std::string& item, SceneGeneratorSettings& settings)
+{
+  const size_t equals = item.find('=');
+  if(equals == std::string::npos)
+  {
+    return false;
+  }
+  const std::string key   = item.substr(0, equals);
+  const std::string value = item.substr(equals + 1);
+  char*             end   = nullptr;
+  if(key == "triangles")
+  {
+    double triangles = strtod(value.c_str(), &end);
+    triangles *= (*end == 'k') ? 1e3 : (*end == 'M') ? 1e6 : 1.0;
+    end += (*end == 'k' || *end == 'M') ? 1 : 0;
+    settings.triangles = uint32_t(std::clamp(triangles, 4.0, double(1u << 30)));
+  }
+  else if(key == "instances")
+  {
+    settings.instances = uint32_t(std::max(1l, strtol(value.c_str(), &end, 10)));
+  }
+  else if(key == "layout" || key == "sizes")
+  {
+    const char* const* names = (key == "layout") ? layout_names : size_names;
+    const auto         found = std::find(names, names + 3, value);
+    if(found == names + 3)
+    {
+      return false;
+    }
+    if(key == "layout")
+    {
+      settings.layout = SceneLayout(found - names);
+    }
+    else
+    {
+      settings.sizes = SizeDistribution(found - names);
+    }
+    return true;
+  }
+  else if(key == "size")
+  {
+    settings.size = std::max(0.0f, strtof(value.c_str(), &end));
+  }
+  else if(key == "seed")
+  {
+    settings.seed = uint32_t(strtoul(value.c_str(), &end, 10));
+  }
+  else
+  {
+    return false;
+  }
+  return !value.empty() && (*end == '\0');
+}
+
+bool ParseSceneGeneratorSettings(const std::string& text, SceneGeneratorSettings& settings)
+{
+  size_t itemStart = 0;
+  while(itemStart < text.size())
+  {
+    const size_t itemEnd = std::min(text.find(' ', itemStart), text.size());
+    if(itemEnd > itemStart && !ParseSceneGeneratorSetting(text.substr(itemStart, itemEnd - itemStart), settings))
+    {
+      return false;
+    }
+    itemStart = itemEnd + 1;
+  }
+  return true;
+}
+
+bool MakeProceduralMesh(const std::string& spec, Mesh& mesh)
+{
+  const size_t colon = spec.find(':');
+  if(colon == std::string::npos)
+  {
+    return false;
+  }
+  const std::string kind      = spec.substr(0, colon);
+  const uint32_t    triangles = uint32_t(std::max(1l, strtol(spec.c_str() + colon + 1, nullptr, 10)));
+  if(kind == "spheres")
+  {
+    mesh = MakeSphereField(triangles);
+  }
+  else if(kind == "outdoor")
+  {
+    mesh = MakeOutdoorScene(triangles);
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+std::vector<std::array<float, 12>> InstanceGridTransforms(const Aabb& bounds, uint32_t count)
+{
+  const uint32_t columns = uint32_t(std::ceil(std::sqrt(double(std::max(count, 1u)))));
+  const uint32_t rows    = (count + columns - 1) / columns;
+  const float    scale   = (count > 1) ? 1.0f / float(std::max(columns, rows)) : 1.0f;
+  const float    cellX   = (bounds.max[0] - bounds.min[0]) / float(columns);
+  const float    cellY   = (bounds.max[1] - bounds.min[1]) / float(rows);
+  const float    centerZ = 0.5f * (bounds.min[2] + bounds.max[2]);
+
+  std::vector<std::array<float, 12>> transforms(std::max(count, 1u));
+  for(uint32_t i = 0; i < transforms.size(); i++)
+  {
+    // p' = scale * p + t, moving the scaled bounds' min corner to the min corner of the instance's cell
+    const float translateX = (count > 1) ? bounds.min[0] + cellX * float(i % columns) - scale * bounds.min[0] : 0.0f;
+    const float translateY = (count > 1) ? bounds.min[1] + cellY * float(i / columns) - scale * bounds.min[1] : 0.0f;
+    const float translateZ = centerZ * (1.0f - scale);
+    transforms[i] = {scale, 0.0f, 0.0f, translateX, 0.0f, scale, 0.0f, translateY, 0.0f, 0.0f, scale, translateZ};
+  }
+  return transforms;
+}
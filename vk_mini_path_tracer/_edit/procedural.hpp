@@ -0,0 +1,71 @@
+// Procedural scenes of a controllable size for benchmarks, and the instance layout of --instances. The scenes are
+// generated around the default camera's view (see camera.hpp), so they render without a camera of their own.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+
+// A 4 x 4 x 4 grid of UV spheres in the Cornell box's bounds ([-1, 1] x [0, 2] x [-1, 1]) on a ground quad,
+// tessellated to about `targetTriangles` triangles in total: many small triangles in a small volume.
+Mesh MakeSphereField(uint32_t targetTriangles);
+
+// An open scene: rolling terrain from in front of the camera to the horizon, with boxes scattered on it, about
+// `targetTriangles` triangles in total. Most rays that bounce off it escape to the sky.
+Mesh MakeOutdoorScene(uint32_t targetTriangles);
+
+// Where GenerateScene puts its objects.
+enum class SceneLayout
+{
+  Uniform,    // Uniformly in the Cornell box's bounds
+  Clustered,  // In 16 Gaussian clusters at random points of those bounds, so that the BVH is very uneven
+  Thin,       // In a rod 0.2 x 0.2 wide and 100 long, receding from the camera along -z
+};
+
+// How the sizes of GenerateScene's objects vary around their median.
+enum class SizeDistribution
+{
+  Uniform,    // All objects have the median size
+  LogNormal,  // exp(N(0, 1)) times the median
+  PowerLaw,   // Pareto with exponent 1.5, up to 100 times the median: few large objects among many small ones
+};
+
+// Settings of GenerateScene. They are recorded in the files of the scene generator (see
+// FormatSceneGeneratorSettings), so that a benchmark on a generated scene can be reproduced.
+struct SceneGeneratorSettings
+{
+  uint32_t         triangles = 100000;  // Rounded down to a multiple of 4
+  uint32_t         instances = 1;       // Instances of the mesh in the TLAS, as for --instances; not in the mesh
+  SceneLayout      layout    = SceneLayout::Uniform;
+  SizeDistribution sizes     = SizeDistribution::Uniform;
+  float            size      = 0.0f;  // Median edge length; 0 chooses half the mean distance between objects
+  uint32_t         seed      = 1;
+};
+
+// A scene for scaling tests of BLAS builds and traversal: `settings.triangles / 4` randomly rotated regular
+// tetrahedra (closed objects of 4 triangles and 4 vertices, so that bounces leave them), placed and sized as
+// `settings` says, on no ground. The same settings always generate the same mesh.
+Mesh GenerateScene(const SceneGeneratorSettings& settings);
+
+// Formats `settings` as "triangles=N instances=N layout=L sizes=S size=F seed=N", with the names of the
+// layouts and size distributions in lower case.
+std::string FormatSceneGeneratorSettings(const SceneGeneratorSettings& settings);
+
+// Parses one "key=value" of FormatSceneGeneratorSettings into `settings`; triangles can have a k or M suffix.
+// Returns false if `item` isn't one.
+bool ParseSceneGeneratorSetting(const std::string& item, SceneGeneratorSettings& settings);
+
+// Parses the whole output of FormatSceneGeneratorSettings. Returns false if an item isn't valid.
+bool ParseSceneGeneratorSettings(const std::string& text, SceneGeneratorSettings& settings);
+
+// Makes the mesh of a --scene value that names a procedural scene: "spheres:<triangles>" or
+// "outdoor:<triangles>". Returns false if `spec` isn't one of them.
+bool MakeProceduralMesh(const std::string& spec, Mesh& mesh);
+
+// Transforms (3 x 4, row-major, as in VkTransformMatrixKHR) of `count` instances of a mesh with bounds `bounds`:
+// a grid of ceil(sqrt(count)) columns in the xy plane of the bounds, each instance scaled down uniformly so that
+// the grid fits in the bounds. A single instance gets the identity.
+std::vector<std::array<float, 12>> InstanceGridTransforms(const Aabb& bounds, uint32_t count);
@@ -0,0 +1,167 @@
+#include "sampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "common.h"
+
+uint32_t TileGrid::tilesX() const
+{
+  return (width + WORKGROUP_WIDTH - 1) / WORKGROUP_WIDTH;
+}
+
+uint32_t TileGrid::tilesY() const
+{
+  return (height + WORKGROUP_HEIGHT - 1) / WORKGROUP_HEIGHT;
+}
+
+std::vector<uint32_t> AllTiles(const TileGrid& grid)
+{
+  return TilesInRows(grid, 0, grid.height);
+}
+
+std::vector<uint32_t> TilesInRows(const TileGrid& grid, uint32_t firstRow, uint32_t endRow)
+{
+  std::vector<uint32_t> tiles;
+  const uint32_t        endTileRow = std::min((endRow + WORKGROUP_HEIGHT - 1) / WORKGROUP_HEIGHT, grid.tilesY());
+  for(uint32_t y = firstRow / WORKGROUP_HEIGHT; y < endTileRow; y++)
+  {
+    for(uint32_t x = 0; x < grid.tilesX(); x++)
+    {
+      tiles.push_back(x | (y << 16));
+    }
+  }
+  return tiles;
+}
+
+TileQueue::TileQueue(std::vector<uint32_t> tiles, uint32_t numRenderers)
+    : m_tiles(std::move(tiles))
+    , m_numRenderers(std::max(numRenderers, 1u))
+{
+}
+
+bool TileQueue::take(uint32_t wanted, std::vector<uint32_t>& chunk)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const size_t                remaining = m_tiles.size() - m_next;
+  const size_t                count     = std::min<size_t>({wanted, remaining, std::max<size_t>(1, remaining / (2 * m_numRenderers))});
+  chunk.assign(m_tiles.begin() + m_next, m_tiles.begin() + m_next + count);
+  m_next += count;
+  return count > 0;
+}
+
+void Throughput::add(uint32_t tiles, double seconds)
+{
+  const double measured = tiles / std::max(seconds, 1e-6);
+  tilesPerSecond        = (tilesPerSecond == 0.0) ? measured : 0.5 * (tilesPerSecond + measured);
+}
+
+uint32_t Throughput::chunkSize(double targetSeconds, uint32_t initialChunk) const
+{
+  if(tilesPerSecond == 0.0)
+  {
+    return initialChunk;
+  }
+  return uint32_t(std::clamp(tilesPerSecond * targetSeconds, 1.0, 65536.0));
+}
+
+void SampleBudget::add(uint32_t samples, double gpuMs, double wallMs)
+{
+  const double measured = gpuMs / std::max(samples, 1u);
+  const double overhead = std::max(wallMs - gpuMs, 0.0);
+  msPerSample           = (lastBatch == 0) ? measured : std::max(measured, 0.5 * (msPerSample + measured));
+  overheadMs            = (lastBatch == 0) ? overhead : std::max(overhead, 0.5 * (overheadMs + overhead));
+  lastBatch             = samples;
+}
+
+uint32_t SampleBudget::nextBatch(double elapsedMs, uint32_t maxBatch) const
+{
+  if(lastBatch == 0)
+  {
+    return 1;
+  }
+  const double fitting = (budgetMs - elapsedMs - overheadMs) / (1.1 * std::max(msPerSample, 1e-6));
+  return uint32_t(std::clamp(std::floor(fitting), 0.0, double(std::min(maxBatch, 4 * lastBatch))));
+}
+
+float EstimateRelativeError(const float sums[4], uint32_t sampleCount, float minLuminance)
+{
+  if(sampleCount < 2)
+  {
+    return INFINITY;
+  }
+  const float n    = float(sampleCount);
+  const float mean = (0.2126f * sums[0] + 0.7152f * sums[1] + 0.0722f * sums[2]) / n;
+  // Unbiased sample variance of the luminance, then the variance of its mean:
+  const float variance      = std::max(sums[3] / n - mean * mean, 0.0f) * n / (n - 1.0f);
+  const float standardError = std::sqrt(variance / n);
+  return standardError / std::max(mean, minLuminance);
+}
+
+uint32_t RemoveConvergedTiles(std::vector<uint32_t>& activeTiles, const TileGrid& grid, const float* accumulation,
+                              uint32_t sampleCount, float threshold)
+{
+  const auto isConverged = [&](uint32_t tile) {
+    const uint32_t x0 = (tile & 0xFFFF) * WORKGROUP_WIDTH;
+    const uint32_t y0 = (tile >> 16) * WORKGROUP_HEIGHT;
+    const uint32_t x1 = std::min(x0 + WORKGROUP_WIDTH, grid.width);
+    const uint32_t y1 = std::min(y0 + WORKGROUP_HEIGHT, grid.height);
+    for(uint32_t y = y0; y < y1; y++)
+    {
+      for(uint32_t x = x0; x < x1; x++)
+      {
+        if(EstimateRelativeError(&accumulation[4 * (size_t(y) * grid.width + x)], sampleCount) > threshold)
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  const size_t numTilesBefore = activeTiles.size();
+  activeTiles.erase(std::remove_if(activeTiles.begin(), activeTiles.end(), isConverged), activeTiles.end());
+  return static_cast<uint32_t>(numTilesBefore - activeTiles.size());
+}
+
+std::vector<uint32_t> BuildSobolDirections()
+{
+  // Primitive polynomials and initial direction numbers from Joe and Kuo's new-joe-kuo-6.21201 table.
+  // Dimension 0 is the van der Corput sequence, which needs none.
+  struct Polynomial
+  {
+    uint32_t degree;
+    uint32_t coefficients;  // Inner coefficients a
+    uint32_t m[3];          // Initial direction numbers
+  };
+  static const Polynomial polynomials[SOBOL_DIMENSIONS - 1] = {{1, 0, {1}}, {2, 1, {1, 3}}, {3, 1, {1, 3, 1}}};
+
+  std::vector<uint32_t> directions(SOBOL_DIMENSIONS * 32);
+  for(uint32_t bit = 0; bit < 32; bit++)
+  {
+    directions[bit] = 1u << (31 - bit);
+  }
+  for(uint32_t dim = 1; dim < SOBOL_DIMENSIONS; dim++)
+  {
+    const Polynomial& p = polynomials[dim - 1];
+    uint32_t*         v = &directions[32 * dim];
+    for(uint32_t bit = 0; bit < 32; bit++)
+    {
+      if(bit < p.degree)
+      {
+        v[bit] = p.m[bit] << (31 - bit);
+        continue;
+      }
+      v[bit] = v[bit - p.degree] ^ (v[bit - p.degree] >> p.degree);
+      for(uint32_t k = 1; k < p.degree; k++)
+      {
+        if((p.coefficients >> (p.degree - 1 - k)) & 1)
+        {
+          v[bit] ^= v[bit - k];
+        }
+      }
+    }
+  }
+  return directions;
+}
@@ -0,0 +1,89 @@
+// CPU side of tile-based rendering: deciding which tiles of the image still need samples, and handing tiles out.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// An image split into tiles of WORKGROUP_WIDTH x WORKGROUP_HEIGHT pixels, one workgroup of raytrace.comp.glsl each.
+// Tiles are identified the way the shader reads them from BINDING_ACTIVE_TILES: x | (y << 16).
+struct TileGrid
+{
+  uint32_t width  = 0;  // Image size in pixels
+  uint32_t height = 0;
+
+  uint32_t tilesX() const;
+  uint32_t tilesY() const;
+  uint32_t numTiles() const { return tilesX() * tilesY(); }
+};
+
+// Returns all tiles of `grid`, in scanline order.
+std::vector<uint32_t> AllTiles(const TileGrid& grid);
+
+// Returns the tiles of `grid` that contain pixel rows [firstRow, endRow), in scanline order.
+std::vector<uint32_t> TilesInRows(const TileGrid& grid, uint32_t firstRow, uint32_t endRow);
+
+// Hands out tiles to several renderers at once (the GPU and CPU threads with hybrid rendering), in chunks of
+// tiles whose size each renderer picks from its own throughput (see Throughput::chunkSize). Thread-safe.
+class TileQueue
+{
+public:
+  TileQueue(std::vector<uint32_t> tiles, uint32_t numRenderers);
+  // Moves up to `wanted` tiles from the queue into `chunk`, and returns false if the queue is empty. Near the end
+  // of the queue, chunks are capped to a share of the remaining tiles, so that one renderer doesn't get stuck with
+  // a large chunk while the others are idle.
+  bool take(uint32_t wanted, std::vector<uint32_t>& chunk);
+
+private:
+  std::mutex            m_mutex;
+  std::vector<uint32_t> m_tiles;
+  size_t                m_next = 0;  // Index of the next tile to hand out
+  uint32_t              m_numRenderers;
+};
+
+// The throughput of a renderer in tiles per second, as a moving average of its chunks, which gives the size of
+// its next chunk.
+struct Throughput
+{
+  double tilesPerSecond = 0.0;  // 0 until the first chunk has been measured
+
+  void add(uint32_t tiles, double seconds);
+  // Returns the number of tiles the renderer takes `targetSeconds` to render, or `initialChunk` before any measurement.
+  uint32_t chunkSize(double targetSeconds, uint32_t initialChunk) const;
+};
+
+// Time-budgeted rendering: the cost of the batches of samples so far, which predicts how many samples per pixel the
+// next batch can take and still end before the deadline.
+struct SampleBudget
+{
+  double   budgetMs    = 0.0;  // Time from the start of the first batch to the deadline
+  double   msPerSample = 0.0;  // GPU time of one sample per pixel (0 until the first batch has been measured)
+  double   overheadMs  = 0.0;  // Time of a batch besides its samples: recording, submitting, waiting
+  uint32_t lastBatch   = 0;
+
+  // Adds a batch of `samples` samples per pixel that took `gpuMs` on the GPU and `wallMs` in all. Both estimates
+  // follow increases at once and decreases slowly, so that one fast batch doesn't make the next one too large.
+  void add(uint32_t samples, double gpuMs, double wallMs);
+  // Returns the samples per pixel of the next batch after `elapsedMs` of the budget: 1 before any measurement, then
+  // as many as are predicted to fit with a 10% margin, up to `maxBatch` and 4 times the last batch (so that a
+  // misprediction can't overshoot by much). Returns 0 if not even one sample fits.
+  uint32_t nextBatch(double elapsedMs, uint32_t maxBatch) const;
+};
+
+// Returns the noise of the pixel whose BINDING_ACCUMULATION entry is `sums` (sum of colors, sum of squared
+// luminances) after `sampleCount` samples: the standard error of its mean luminance, relative to that mean.
+// Pixels darker than `minLuminance` use `minLuminance` as the denominator, as their relative error doesn't
+// say much about visible noise.
+float EstimateRelativeError(const float sums[4], uint32_t sampleCount, float minLuminance = 0.05f);
+
+// Removes the tiles from `activeTiles` whose pixels all have a relative error (see EstimateRelativeError)
+// of at most `threshold`. `accumulation` holds 4 floats per pixel, as in BINDING_ACCUMULATION, and every
+// active tile has taken `sampleCount` samples per pixel. Returns the number of removed tiles.
+uint32_t RemoveConvergedTiles(std::vector<uint32_t>& activeTiles, const TileGrid& grid, const float* accumulation,
+                              uint32_t sampleCount, float threshold);
+
+// Direction numbers of the first SOBOL_DIMENSIONS dimensions of the Sobol sequence (Joe & Kuo), 32 per
+// dimension, in the layout of BINDING_SOBOL_DIRECTIONS. raytrace.comp.glsl pads these to all dimensions of
+// a path by scrambling each group of SOBOL_DIMENSIONS dimensions with its own seeds.
+std::vector<uint32_t> BuildSobolDirections();
@@ -0,0 +1,83 @@
+// Copyright 2020 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#version 460
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "../common.h"
+
+// One iteration of the edge-avoiding A-trous wavelet filter of Dammertz et al., "Edge-Avoiding A-Trous
+// Wavelet Transform for fast Global Illumination Filtering" (HPG 2010). Each iteration blurs with a 5x5
+// B3 spline kernel whose taps are `stepWidth` pixels apart, and main.cpp doubles `stepWidth` between
+// iterations, so that a few iterations cover a large footprint. Taps across edges of the color, the
+// first-hit normal or the first-hit albedo get small weights, which keeps the edges sharp.
+
+layout(local_size_x = WORKGROUP_WIDTH, local_size_y = WORKGROUP_HEIGHT, local_size_z = 1) in;
+
+layout(push_constant) uniform PushConstantBlock
+{
+  DenoisePushConstants pushConstants;
+};
+
+layout(binding = DENOISE_BINDING_INPUT, set = 0, scalar) readonly buffer InputColor
+{
+  vec3 inputColor[];
+};
+layout(binding = DENOISE_BINDING_OUTPUT, set = 0, scalar) writeonly buffer OutputColor
+{
+  vec3 outputColor[];
+};
+layout(binding = DENOISE_BINDING_ALBEDO, set = 0, scalar) readonly buffer Albedo
+{
+  vec3 albedo[];
+};
+layout(binding = DENOISE_BINDING_NORMAL, set = 0, scalar) readonly buffer Normal
+{
+  vec3 normal[];
+};
+
+void main()
+{
+  const ivec2 resolution = ivec2(pushConstants.width, pushConstants.height);
+  const ivec2 pixel      = ivec2(gl_GlobalInvocationID.xy);
+  if((pixel.x >= resolution.x) || (pixel.y >= resolution.y))
+  {
+    return;
+  }
+
+  const int  centerIndex  = resolution.x * pixel.y + pixel.x;
+  const vec3 centerColor  = inputColor[centerIndex];
+  const vec3 centerNormal = normal[centerIndex];
+  const vec3 centerAlbedo = albedo[centerIndex];
+
+  // 1D weights of the B3 spline kernel; the 2D weights are their products.
+  const float kernel[3] = float[3](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+  vec3  summedColor  = vec3(0.0);
+  float summedWeight = 0.0;
+  for(int dy = -2; dy <= 2; dy++)
+  {
+    for(int dx = -2; dx <= 2; dx++)
+    {
+      // Clamp taps to the image, so that pixels near the border still get a full kernel
+      const ivec2 tap   = clamp(pixel + ivec2(dx, dy) * int(pushConstants.stepWidth), ivec2(0), resolution - 1);
+      const int   index = resolution.x * tap.y + tap.x;
+
+      const vec3 color       = inputColor[index];
+      const vec3 colorDelta  = color - centerColor;
+      const vec3 normalDelta = normal[index] - centerNormal;
+      const vec3 albedoDelta = albedo[index] - centerAlbedo;
+
+      const float edgeWeight = exp(-dot(colorDelta, colorDelta) / pushConstants.colorPhi      //
+                                   - dot(normalDelta, normalDelta) / pushConstants.normalPhi  //
+                                   - dot(albedoDelta, albedoDelta) / pushConstants.albedoPhi);
+      const float weight = kernel[abs(dx)] * kernel[abs(dy)] * edgeWeight;
+
+      summedColor += weight * color;
+      summedWeight += weight;
+    }
+  }
+
+  // The center tap has an edge weight of 1, so summedWeight is never 0
+  outputColor[centerIndex] = summedColor / summedWeight;
+}
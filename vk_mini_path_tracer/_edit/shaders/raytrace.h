@@ -0,0 +1,874 @@
+// Copyright 2020 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+// The path tracing kernel. raytrace.comp.glsl and raytrace_rgba16f.comp.glsl compile it, after the #version line,
+// with the format of their output image in OUTPUT_IMAGE_FORMAT.
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_ray_query : require
+#extension GL_KHR_shader_subgroup_basic : require
+
+#include "../common.h"
+
+layout(local_size_x = WORKGROUP_WIDTH, local_size_y = WORKGROUP_HEIGHT, local_size_z = 1) in;
+
+// Specialization constants, set by main.cpp when it creates the pipeline (see common.h)
+layout(constant_id = SPEC_HIT_FETCH_MODE) const uint HIT_FETCH_MODE = HIT_FETCH_INDEXED;
+layout(constant_id = SPEC_INDEX_16BIT) const uint INDEX_16BIT = 0;
+layout(constant_id = SPEC_QUANTIZED_VERTICES) const uint QUANTIZED_VERTICES = 0;
+layout(constant_id = SPEC_ADAPTIVE_SAMPLING) const uint ADAPTIVE_SAMPLING = 0;
+layout(constant_id = SPEC_SAMPLER) const uint SAMPLER = SAMPLER_SOBOL;
+layout(constant_id = SPEC_AOV_MASK) const uint AOV_MASK = 0;
+layout(constant_id = SPEC_OUTPUT_IMAGE) const uint OUTPUT_IMAGE = 0;
+layout(constant_id = SPEC_PIXEL_SWIZZLE) const uint PIXEL_SWIZZLE = SWIZZLE_ROW_MAJOR;
+layout(constant_id = SPEC_PRIMARY_RAYS_ONLY) const uint PRIMARY_RAYS_ONLY = 0;
+layout(constant_id = SPEC_PERSISTENT_THREADS) const uint PERSISTENT_THREADS = 0;
+layout(constant_id = SPEC_SAMPLE_SPLIT) const uint SAMPLE_SPLIT = 1;
+layout(constant_id = SPEC_COUNT_RAYS) const uint COUNT_RAYS = 0;
+layout(constant_id = SPEC_TRAVERSAL_RAYS) const uint TRAVERSAL_RAYS = TRAVERSAL_OFF;
+
+layout(push_constant) uniform PushConstantBlock
+{
+  PushConstants pushConstants;
+};
+
+// The scalar layout qualifier here means to align types according to the alignment
+// of their scalar components, instead of e.g. padding them to std140 rules.
+layout(binding = BINDING_IMAGE_DATA, set = 0, scalar) buffer storageBuffer
+{
+  vec3 imageData[];
+};
+// With OUTPUT_IMAGE, the color goes to this storage image instead, one texel per pixel of the whole image, and one
+// layer per view. Its format qualifier is the image's format, as main.cpp picks the module by the format of the image
+// it binds, so that no pipeline needs shaderStorageImageWriteWithoutFormat.
+layout(binding = BINDING_OUTPUT_IMAGE, set = 0, OUTPUT_IMAGE_FORMAT) uniform writeonly image2DArray outputImage;
+layout(binding = BINDING_TLAS, set = 0) uniform accelerationStructureEXT tlas;
+layout(binding = BINDING_VERTICES, set = 0, scalar) buffer Vertices
+{
+  vec3 vertices[];
+};
+layout(binding = BINDING_INDICES, set = 0, scalar) buffer Indices
+{
+  uint indices[];
+};
+// Vertex positions quantized to 16 bits per axis: vertex i is quantizationOrigin + quantizationScale * q,
+// with q.x and q.y in the low and high bits of quantizedVertices[i].x, and q.z in quantizedVertices[i].y.
+layout(binding = BINDING_QUANTIZED_VERTICES, set = 0, scalar) readonly buffer QuantizedVertices
+{
+  vec3  quantizationOrigin;
+  vec3  quantizationScale;
+  uvec2 quantizedVertices[];
+};
+// Precomputed shading records, PRIMITIVE_RECORD_VEC4S aligned vec4s per triangle (see PrimitiveRecord in mesh.hpp).
+layout(binding = BINDING_PRIMITIVES, set = 0) readonly buffer Primitives
+{
+  vec4 primitiveRecords[];
+};
+
+// Adaptive sampling: running sums of each pixel's samples, from which main.cpp estimates the noise of each tile.
+layout(binding = BINDING_ACCUMULATION, set = 0) buffer Accumulation
+{
+  vec4 accumulation[];
+};
+// Adaptive sampling: workgroup i samples the tile activeTiles[i].
+layout(binding = BINDING_ACTIVE_TILES, set = 0) readonly buffer ActiveTiles
+{
+  uint activeTiles[];
+};
+
+// Persistent threads: the work counters. The last workgroup of a dispatch resets its counter, so each dispatch starts from 0.
+struct WorkCounter
+{
+  uint nextItem;            // Index of the next tile to take
+  uint finishedWorkgroups;  // Number of workgroups that found no more tiles
+};
+// The cameras, one per view (see Camera in common.h).
+layout(binding = BINDING_CAMERAS, set = 0, scalar) readonly buffer Cameras
+{
+  Camera cameras[];
+};
+layout(binding = BINDING_WORK_COUNTERS, set = 0) coherent buffer WorkCounters
+{
+  WorkCounter workCounters[WORK_COUNTER_COUNT];
+};
+shared uint sharedWorkItem;
+// Ray counting: the rays this invocation has traced, and their sum over the workgroup.
+layout(binding = BINDING_RAY_COUNT, set = 0) buffer RayCount
+{
+  uint rayCountLow;
+  uint rayCountHigh;
+};
+uint        tracedRays = 0;
+shared uint sharedRayCount;
+
+// Sample-parallel rendering: the sums of each invocation's samples, which the first invocation of each pixel adds up.
+// The arrays are sized by specialization constants, so that pipelines that don't use them reserve 1 element.
+shared vec4 sharedColorSums[(SAMPLE_SPLIT > 1) ? WORKGROUP_WIDTH * WORKGROUP_HEIGHT : 1];  // Sum of colors, sum of squared luminances
+shared vec3 sharedAlbedoSums[(SAMPLE_SPLIT > 1 && (AOV_MASK & AOV_ALBEDO) != 0) ? WORKGROUP_WIDTH * WORKGROUP_HEIGHT : 1];
+shared vec3 sharedNormalSums[(SAMPLE_SPLIT > 1 && (AOV_MASK & AOV_NORMAL) != 0) ? WORKGROUP_WIDTH * WORKGROUP_HEIGHT : 1];
+
+// Direction numbers of the first SOBOL_DIMENSIONS Sobol dimensions, 32 per dimension (see BuildSobolDirections in sampling.cpp).
+layout(binding = BINDING_SOBOL_DIRECTIONS, set = 0) readonly buffer SobolDirections
+{
+  uint sobolDirections[];
+};
+
+// Arbitrary output variables (AOVs) of the first bounce, each tightly packed in its own buffer. The shader
+// only writes the ones in AOV_MASK; main.cpp binds 1-element placeholders for the others. With adaptive sampling,
+// albedo and normal are running averages over all batches like the color, and the other AOVs are those of the
+// render's first sample, which only the first batch writes.
+layout(binding = BINDING_ALBEDO, set = 0, scalar) buffer AovAlbedo
+{
+  vec3 aovAlbedo[];
+};
+layout(binding = BINDING_NORMAL, set = 0, scalar) buffer AovNormal
+{
+  vec3 aovNormal[];
+};
+layout(binding = BINDING_AOV_DEPTH, set = 0, scalar) writeonly buffer AovDepth
+{
+  float aovDepth[];
+};
+layout(binding = BINDING_AOV_IDS, set = 0, scalar) writeonly buffer AovIds
+{
+  uvec2 aovIds[];
+};
+layout(binding = BINDING_AOV_BARYCENTRICS, set = 0, scalar) writeonly buffer AovBarycentrics
+{
+  vec2 aovBarycentrics[];
+};
+
+// Random number generation using pcg32i_random_t, using inc = 1. Our random state is a uint.
+uint stepRNG(uint rngState)
+{
+  return rngState * 747796405 + 1;
+}
+
+// Steps the RNG and returns a floating-point value between 0 and 1 inclusive.
+float stepAndOutputRNGFloat(inout uint rngState)
+{
+  // Condensed version of pcg_output_rxs_m_xs_32_32, with simple conversion to floating-point [0,1].
+  rngState  = stepRNG(rngState);
+  uint word = ((rngState >> ((rngState >> 28) + 4)) ^ rngState) * 277803737;
+  word      = (word >> 22) ^ word;
+  return float(word) / 4294967295.0f;
+}
+
+// Hashes a uint to a well-mixed uint (the PCG hash of Jarzynski and Olano).
+uint hashUint(uint v)
+{
+  const uint state = v * 747796405u + 2891336453u;
+  const uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+// Owen scrambling of the bits of x, using the hash-based permutation of Laine and Karras as described in
+// Burley, "Practical Hash-based Owen Scrambling" (JCGT 2020). It flips each bit depending on all higher bits.
+uint nestedUniformScramble(uint x, uint seed)
+{
+  x = bitfieldReverse(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return bitfieldReverse(x);
+}
+
+// Returns point `index` of Sobol dimension `dimension`, as 32 bits of fixed point in [0, 1).
+uint sobol(uint index, uint dimension)
+{
+  uint x = 0;
+  for(uint bit = 0; index != 0; bit++, index >>= 1)
+  {
+    if((index & 1u) != 0)
+    {
+      x ^= sobolDirections[32 * dimension + bit];
+    }
+  }
+  return x;
+}
+
+// The sampler hands out the random numbers of a path, one dimension at a time: 2 for the pixel jitter,
+// then 2 per bounce. With SAMPLER_PCG, these come from a PCG stream seeded by the pixel and the sample index.
+// With SAMPLER_SOBOL, they are dimensions of an Owen-scrambled Sobol sequence; dimension d is dimension
+// d % SOBOL_DIMENSIONS of the group d / SOBOL_DIMENSIONS, and each group shuffles the sample order and scrambles
+// the points with its own seeds, so that the groups are independent of each other and of other pixels.
+// Either way, a sample only depends on its pixel and sample index, and not on which dispatch, batch or process
+// takes it, so renders of disjoint sample ranges can be summed into the same image as one render of all of them.
+struct Sampler
+{
+  uint rngState;     // SAMPLER_PCG: state of the random number generator
+  uint pixelSeed;    // Hash of the pixel
+  uint sampleIndex;  // SAMPLER_SOBOL: index of the current sample in the pixel's sequence
+  uint dimension;    // SAMPLER_SOBOL: next dimension of the current sample
+};
+
+Sampler createSampler(uint pixelIndex)
+{
+  return Sampler(0u, hashUint(pixelIndex), 0u, 0u);
+}
+
+// Starts sample `sampleIndex` of the pixel.
+void startSample(inout Sampler sampler, uint sampleIndex)
+{
+  sampler.rngState    = hashUint(sampler.pixelSeed ^ hashUint(sampleIndex));
+  sampler.sampleIndex = sampleIndex;
+  sampler.dimension   = 0;
+}
+
+// Returns the next dimension of the current sample, in [0, 1].
+float nextSample(inout Sampler sampler)
+{
+  if(SAMPLER == SAMPLER_SOBOL)
+  {
+    const uint group     = sampler.dimension / SOBOL_DIMENSIONS;
+    const uint groupSeed = hashUint(sampler.pixelSeed ^ hashUint(group));
+    const uint index     = nestedUniformScramble(sampler.sampleIndex, groupSeed);
+    const uint x = nestedUniformScramble(sobol(index, sampler.dimension % SOBOL_DIMENSIONS), hashUint(groupSeed + sampler.dimension));
+    sampler.dimension++;
+    return float(x >> 8) / 16777216.0;  // The top 24 bits, which a float represents exactly
+  }
+  return stepAndOutputRNGFloat(sampler.rngState);
+}
+
+// Returns the color of the sky in a given direction (in linear color space)
+vec3 skyColor(vec3 direction)
+{
+  // +y in world space is up, so:
+  if(direction.y > 0.0f)
+  {
+    return mix(vec3(1.0f), vec3(0.25f, 0.5f, 1.0f), direction.y);
+  }
+  else
+  {
+    return vec3(0.03f);
+  }
+}
+
+// Reads index i of the index buffer, which holds either one index per uint or (with 16-bit indices)
+// two indices per uint, with the first one in the low bits.
+uint getIndex(uint i)
+{
+  if(INDEX_16BIT != 0)
+  {
+    const uint word = indices[i >> 1];
+    return ((i & 1u) == 0u) ? (word & 0xFFFFu) : (word >> 16);
+  }
+  return indices[i];
+}
+
+// Reads the position of vertex i, either exactly or decoded from its 16-bit fixed point copy.
+vec3 getVertex(uint i)
+{
+  if(QUANTIZED_VERTICES != 0)
+  {
+    const uvec2 q = quantizedVertices[i];
+    return quantizationOrigin + quantizationScale * vec3(q.x & 0xFFFFu, q.x >> 16, q.y);
+  }
+  return vertices[i];
+}
+
+// Decodes a unit vector stored with the octahedral mapping in 2 snorm16 values (see EncodeOctNormal in mesh.cpp).
+vec3 decodeOctNormal(uint encoded)
+{
+  const vec2 e = unpackSnorm2x16(encoded);
+  vec3       n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+  // Unfold the lower hemisphere:
+  const float t = max(-n.z, 0.0);
+  n.x += (n.x >= 0.0) ? -t : t;
+  n.y += (n.y >= 0.0) ? -t : t;
+  return normalize(n);
+}
+
+struct HitInfo
+{
+  vec3 color;
+  vec3 worldPosition;
+  vec3 worldNormal;
+  uint materialID;
+};
+
+// Same as getObjectHitInfo, but reads a single precomputed record instead of 3 indices and 3 vertices.
+HitInfo getObjectHitInfoFromRecord(rayQueryEXT rayQuery)
+{
+  HitInfo result;
+  // Get the ID of the triangle
+  const int primitiveID = rayQueryGetIntersectionPrimitiveIndexEXT(rayQuery, true);
+
+  // Get the whole record of the triangle in one go
+  const vec4 record0 = primitiveRecords[PRIMITIVE_RECORD_VEC4S * primitiveID + 0];  // v0, normal
+  const vec4 record1 = primitiveRecords[PRIMITIVE_RECORD_VEC4S * primitiveID + 1];  // edge1, material
+  const vec4 record2 = primitiveRecords[PRIMITIVE_RECORD_VEC4S * primitiveID + 2];  // edge2, original primitive ID
+
+  // Get the barycentric coordinates of the intersection
+  const vec2 barycentrics = rayQueryGetIntersectionBarycentricsEXT(rayQuery, true);
+
+  // p = (1-u-v)*v0 + u*v1 + v*v2 = v0 + u*(v1-v0) + v*(v2-v0)
+  const vec3   objectPos     = record0.xyz + barycentrics.x * record1.xyz + barycentrics.y * record2.xyz;
+  const mat4x3 objectToWorld = rayQueryGetIntersectionObjectToWorldEXT(rayQuery, true);
+  result.worldPosition = objectToWorld * vec4(objectPos, 1.0);
+  // Instances are only translated and uniformly scaled (see InstanceGridTransforms), so normals transform like directions:
+  result.worldNormal   = normalize(mat3(objectToWorld) * decodeOctNormal(floatBitsToUint(record0.w)));
+  result.materialID    = floatBitsToUint(record1.w);
+  result.color         = vec3(0.7f);
+
+  return result;
+}
+
+HitInfo getObjectHitInfo(rayQueryEXT rayQuery)
+{
+  if(HIT_FETCH_MODE == HIT_FETCH_RECORDS)
+  {
+    return getObjectHitInfoFromRecord(rayQuery);
+  }
+
+  HitInfo result;
+  // Get the ID of the triangle
+  const int primitiveID = rayQueryGetIntersectionPrimitiveIndexEXT(rayQuery, true);
+
+  // Get the indices of the vertices of the triangle
+  const uint i0 = getIndex(3 * primitiveID + 0);
+  const uint i1 = getIndex(3 * primitiveID + 1);
+  const uint i2 = getIndex(3 * primitiveID + 2);
+
+  // Get the vertices of the triangle
+  const vec3 v0 = getVertex(i0);
+  const vec3 v1 = getVertex(i1);
+  const vec3 v2 = getVertex(i2);
+
+  // Get the barycentric coordinates of the intersection
+  vec3 barycentrics = vec3(0.0, rayQueryGetIntersectionBarycentricsEXT(rayQuery, true));
+  barycentrics.x    = 1.0 - barycentrics.y - barycentrics.z;
+
+  // Compute the coordinates of the intersection
+  const vec3 objectPos = v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
+  // Transform it to world space with the transform of the instance that was hit:
+  const mat4x3 objectToWorld = rayQueryGetIntersectionObjectToWorldEXT(rayQuery, true);
+  result.worldPosition       = objectToWorld * vec4(objectPos, 1.0);
+
+  // Compute the normal of the triangle in object space, using the right-hand rule:
+  //    v2      .
+  //    |\      .
+  //    | \     .
+  //    |/ \    .
+  //    /   \   .
+  //   /|    \  .
+  //  L v0---v1 .
+  // n
+  const vec3 objectNormal = cross(v1 - v0, v2 - v0);
+  // Instances are only translated and uniformly scaled (see InstanceGridTransforms), so normals transform like directions:
+  result.worldNormal = normalize(mat3(objectToWorld) * objectNormal);
+
+  result.materialID = 0;  // Only the shading records store materials
+  result.color      = vec3(0.7f);
+
+  return result;
+}
+
+// Returns the point at distance `d` along the Hilbert curve through an n x n square, n a power of 2.
+uvec2 hilbertCurvePoint(uint n, uint d)
+{
+  uvec2 point = uvec2(0);
+  for(uint s = 1; s < n; s *= 2)
+  {
+    const uint rx = 1 & (d / 2);
+    const uint ry = 1 & (d ^ rx);
+    if(ry == 0)
+    {
+      // Rotate the quadrant
+      if(rx == 1)
+      {
+        point = uvec2(s - 1) - point;
+      }
+      point = point.yx;
+    }
+    point += s * uvec2(rx, ry);
+    d /= 4;
+  }
+  return point;
+}
+
+// Returns pixel `index` of the WORKGROUP_WIDTH x WORKGROUP_HEIGHT pixels of a tile, in the order PIXEL_SWIZZLE
+// selects (see common.h).
+uvec2 swizzledLocalPixel(uint index)
+{
+  // The curves go through squares of WORKGROUP_HEIGHT x WORKGROUP_HEIGHT pixels, side by side in the tile.
+  const uint square = WORKGROUP_HEIGHT;
+  if(PIXEL_SWIZZLE == SWIZZLE_MORTON)
+  {
+    // De-interleave the bits of the index within the square: even bits are x, odd bits are y.
+    const uint inSquare = index % (square * square);
+    uvec2      point    = uvec2(0);
+    for(uint bit = 0; (1u << (2 * bit)) < square * square; bit++)
+    {
+      point |= uvec2((inSquare >> (2 * bit)) & 1u, (inSquare >> (2 * bit + 1)) & 1u) << bit;
+    }
+    return uvec2((index / (square * square)) * square, 0) + point;
+  }
+  if(PIXEL_SWIZZLE == SWIZZLE_HILBERT)
+  {
+    return uvec2((index / (square * square)) * square, 0) + hilbertCurvePoint(square, index % (square * square));
+  }
+  if(PIXEL_SWIZZLE == SWIZZLE_SUBGROUP)
+  {
+    // Each run of gl_SubgroupSize indices gets one block of the tile; renderPixel numbers the invocations subgroup
+    // by subgroup, so that each subgroup gets one block (or, with SAMPLE_SPLIT, part of one).
+    const uint blockWidth   = min(gl_SubgroupSize, square);
+    const uint blockSize    = min(gl_SubgroupSize, square * square);
+    const uint blockHeight  = blockSize / blockWidth;
+    const uint block        = index / blockSize;
+    const uint inBlock      = index % blockSize;
+    const uint blocksPerRow = WORKGROUP_WIDTH / blockWidth;
+    return uvec2((block % blocksPerRow) * blockWidth + inBlock % blockWidth, (block / blocksPerRow) * blockHeight + inBlock / blockWidth);
+  }
+  return uvec2(index % WORKGROUP_WIDTH, index / WORKGROUP_WIDTH);
+}
+
+// Traversal benchmark: a uniform float in [0, 1) from the hash chain `state`, which it advances. The rays use this
+// instead of the sampler, so that they cost a few integer operations and no memory accesses.
+float nextHashFloat(inout uint state)
+{
+  state = hashUint(state);
+  return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+// Traversal benchmark: the random ray of `seed`, from a uniform point of the scene bounds in a uniform direction.
+void randomRay(uint seed, out vec3 origin, out vec3 direction)
+{
+  uint       state    = seed;
+  const vec3 sceneMin = vec3(pushConstants.sceneMin[0], pushConstants.sceneMin[1], pushConstants.sceneMin[2]);
+  const vec3 sceneMax = vec3(pushConstants.sceneMax[0], pushConstants.sceneMax[1], pushConstants.sceneMax[2]);
+  origin              = mix(sceneMin, sceneMax, vec3(nextHashFloat(state), nextHashFloat(state), nextHashFloat(state)));
+  const float z       = 2.0 * nextHashFloat(state) - 1.0;
+  const float phi     = 6.2831853 * nextHashFloat(state);
+  const float r       = sqrt(max(1.0 - z * z, 0.0));
+  direction           = vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// Traversal benchmark: traces the ray of `pixel` that TRAVERSAL_RAYS says, and returns its hit distance, or
+// AOV_NO_HIT_DEPTH if it misses.
+float traceTraversalRay(uvec2 pixel, uvec2 resolution, Camera camera)
+{
+  vec3 origin;
+  vec3 direction;
+  if(TRAVERSAL_RAYS == TRAVERSAL_CAMERA)
+  {
+    // As in renderPixel, through the center of the pixel
+    const vec2 screenUV = vec2((2.0 * (float(pixel.x) + 0.5) - resolution.x) / resolution.y,
+                               -(2.0 * (float(pixel.y) + 0.5) - resolution.y) / resolution.y);
+    origin              = vec3(camera.origin[0], camera.origin[1], camera.origin[2]);
+    direction           = normalize(vec3(camera.forward[0], camera.forward[1], camera.forward[2])
+                          + camera.fovVerticalSlope * screenUV.x * vec3(camera.right[0], camera.right[1], camera.right[2])
+                          + camera.fovVerticalSlope * screenUV.y * vec3(camera.up[0], camera.up[1], camera.up[2]));
+  }
+  else
+  {
+    // Mix the pixel's own random ray with that of its tile of the image (even seeds are pixels, odd ones tiles)
+    const uvec2 tile = pixel / gl_WorkGroupSize.xy;
+    vec3        tileOrigin;
+    vec3        tileDirection;
+    randomRay(2u * (resolution.x * pixel.y + pixel.x), origin, direction);
+    randomRay(2u * (tile.y * 65536u + tile.x) + 1u, tileOrigin, tileDirection);
+    origin    = mix(origin, tileOrigin, pushConstants.rayCoherence);
+    direction = mix(direction, tileDirection, pushConstants.rayCoherence);
+    direction = (dot(direction, direction) > 1e-12) ? normalize(direction) : tileDirection;
+  }
+
+  rayQueryEXT rayQuery;
+  tracedRays++;
+  rayQueryInitializeEXT(rayQuery, tlas, gl_RayFlagsOpaqueEXT, 0xFF, origin, 0.0, direction, AOV_NO_HIT_DEPTH);
+  while(rayQueryProceedEXT(rayQuery))
+  {
+  }
+  if(rayQueryGetIntersectionTypeEXT(rayQuery, true) == gl_RayQueryCommittedIntersectionTriangleEXT)
+  {
+    return rayQueryGetIntersectionTEXT(rayQuery, true);
+  }
+  return AOV_NO_HIT_DEPTH;
+}
+
+// Writes the final color of `pixel` of the image of `view`, whose index in the tile's per-pixel buffers is
+// `linearIndex`. Only the output image has more than one view.
+void writeColor(uvec2 pixel, uint view, uint linearIndex, vec3 color)
+{
+  if(OUTPUT_IMAGE != 0)
+  {
+    imageStore(outputImage, ivec3(pixel, view), vec4(color, 1.0));
+  }
+  else
+  {
+    imageData[pushConstants.outputOffset + linearIndex] = color;
+  }
+}
+
+// Renders this invocation's pixel of `workgroupTile`, a tile of WORKGROUP_WIDTH x WORKGROUP_HEIGHT pixels of the
+// part of the image this dispatch renders, counted in tiles. With SAMPLE_SPLIT > 1, the workgroup renders block
+// `pixelBlock` of the tile (see MAX_SAMPLE_SPLIT), and SAMPLE_SPLIT consecutive invocations share each pixel.
+// `view` is the index of the camera. All invocations of the workgroup must call this, as it has a barrier.
+void renderPixel(uvec2 workgroupTile, uint pixelBlock, uint view)
+{
+  // The resolution of the image, and the part of it (the tile) this dispatch renders. Without tiled
+  // rendering, the tile is the whole image.
+  const uvec2 resolution = uvec2(pushConstants.imageWidth, pushConstants.imageHeight);
+  const uvec2 tileOffset = uvec2(pushConstants.tileOffsetX, pushConstants.tileOffsetY);
+  const uvec2 tileSize   = uvec2(pushConstants.tileWidth, pushConstants.tileHeight);
+
+  // Get the coordinates of the pixel for this invocation in the tile:
+  //
+  // .-------.-> x
+  // |       |
+  // |       |
+  // '-------'
+  // v
+  // y
+  //
+  // The invocation's pixel is number pixelIndex of the tile in the order of PIXEL_SWIZZLE. The subgroup swizzle
+  // numbers the invocations subgroup by subgroup; this assumes full subgroups, which a workgroup size that is a
+  // multiple of the subgroup size gets on current GPUs. With SAMPLE_SPLIT, the invocations that share a pixel must
+  // have consecutive gl_LocalInvocationIndex (see the sums below), which current GPUs number subgroup by subgroup too.
+  uint pixelIndex = (PIXEL_SWIZZLE == SWIZZLE_SUBGROUP) ? gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID : gl_LocalInvocationIndex;
+  if(SAMPLE_SPLIT > 1)
+  {
+    pixelIndex = pixelBlock * (WORKGROUP_WIDTH * WORKGROUP_HEIGHT / SAMPLE_SPLIT) + gl_LocalInvocationIndex / SAMPLE_SPLIT;
+  }
+  const uvec2 tilePixel = workgroupTile * gl_WorkGroupSize.xy + swizzledLocalPixel(pixelIndex);
+  // and in the image:
+  const uvec2 pixel = tileOffset + tilePixel;
+
+  // If the pixel is outside of the tile or the image, don't take any samples. (The invocation can't return yet,
+  // because of the barrier of sample-parallel rendering.)
+  const bool insidePixel = (tilePixel.x < tileSize.x) && (tilePixel.y < tileSize.y) && (pixel.x < resolution.x) && (pixel.y < resolution.y);
+
+  // Each batch of adaptive sampling continues the pixel's sequence of samples where the previous one stopped.
+  const uint firstSample = (ADAPTIVE_SAMPLING != 0) ? pushConstants.firstSample : 0;
+  Sampler    sampler     = createSampler(resolution.x * (resolution.y * view + pixel.y) + pixel.x);
+
+  // This scene uses a right-handed coordinate system like the OBJ file format, where the
+  // +x axis points right, the +y axis points up, and the -z axis points into the screen.
+  // The camera of single-view rendering is located at (-0.001, 1, 6), and looks down -z.
+  const Camera camera        = cameras[view];
+  const vec3   cameraOrigin  = vec3(camera.origin[0], camera.origin[1], camera.origin[2]);
+  const vec3   cameraRight   = vec3(camera.right[0], camera.right[1], camera.right[2]);
+  const vec3   cameraUp      = vec3(camera.up[0], camera.up[1], camera.up[2]);
+  const vec3   cameraForward = vec3(camera.forward[0], camera.forward[1], camera.forward[2]);
+  // Define the field of view by the vertical slope of the topmost rays:
+  const float fovVerticalSlope = camera.fovVerticalSlope;
+
+  // The traversal benchmark traces one ray per pixel instead. TRAVERSAL_RAYS is a constant, so all invocations
+  // return here, and none waits at the barrier of sample-parallel rendering.
+  if(TRAVERSAL_RAYS != TRAVERSAL_OFF)
+  {
+    if(insidePixel && (gl_LocalInvocationIndex % SAMPLE_SPLIT) == 0)
+    {
+      writeColor(pixel, view, tileSize.x * tilePixel.y + tilePixel.x, vec3(traceTraversalRay(pixel, resolution, camera)));
+    }
+    return;
+  }
+
+  // The sum of the colors of all of the samples, and the sum of their squared luminances (for the variance).
+  vec3  summedPixelColor       = vec3(0.0);
+  float summedSquaredLuminance = 0.0;
+  // The sums of the first-hit albedos and normals, and the other AOVs of the first sample.
+  vec3  summedAlbedo      = vec3(0.0);
+  vec3  summedNormal      = vec3(0.0);
+  float firstDepth        = AOV_NO_HIT_DEPTH;
+  uvec2 firstIds          = uvec2(AOV_NO_HIT_ID);
+  vec2  firstBarycentrics = vec2(0.0);
+
+  // Limit the kernel to trace at most 64 samples; adaptive sampling takes its samples in batches instead.
+  const int NUM_SAMPLES = 64;
+  const int numSamples  = (ADAPTIVE_SAMPLING != 0) ? int(pushConstants.sampleCount) : NUM_SAMPLES;
+  // This invocation's range of the pixel's samples: all of them, unless it shares the pixel with others.
+  const uint sampleSlice = gl_LocalInvocationIndex % SAMPLE_SPLIT;
+  const int  sampleBegin = numSamples * int(sampleSlice) / int(SAMPLE_SPLIT);
+  const int  sampleEnd   = insidePixel ? numSamples * int(sampleSlice + 1) / int(SAMPLE_SPLIT) : sampleBegin;
+  for(int sampleIdx = sampleBegin; sampleIdx < sampleEnd; sampleIdx++)
+  {
+    startSample(sampler, firstSample + uint(sampleIdx));
+    // Rays always originate at the camera for now. In the future, they'll
+    // bounce around the scene.
+    vec3 rayOrigin = cameraOrigin;
+    // Compute the direction of the ray for this pixel. To do this, we first
+    // transform the screen coordinates to look like this, where a is the
+    // aspect ratio (width/height) of the screen:
+    //           1
+    //    .------+------.
+    //    |      |      |
+    // -a + ---- 0 ---- + a
+    //    |      |      |
+    //    '------+------'
+    //          -1
+    const vec2 randomPixelCenter = vec2(pixel) + vec2(nextSample(sampler), nextSample(sampler));
+    const vec2 screenUV          = vec2((2.0 * randomPixelCenter.x - resolution.x) / resolution.y,    //
+                               -(2.0 * randomPixelCenter.y - resolution.y) / resolution.y);  // Flip the y axis
+    // Create a ray direction:
+    vec3 rayDirection = cameraForward + fovVerticalSlope * screenUV.x * cameraRight + fovVerticalSlope * screenUV.y * cameraUp;
+    rayDirection      = normalize(rayDirection);
+
+    vec3 accumulatedRayColor = vec3(1.0);  // The amount of light that made it to the end of the current ray.
+
+    // Limit the kernel to trace at most 32 segments.
+    const int maxSegments = (PRIMARY_RAYS_ONLY != 0) ? 1 : 32;
+    for(int tracedSegments = 0; tracedSegments < maxSegments; tracedSegments++)
+    {
+      // Trace the ray and see if and where it intersects the scene!
+      // First, initialize a ray query object:
+      rayQueryEXT rayQuery;
+      tracedRays++;
+      rayQueryInitializeEXT(rayQuery,              // Ray query
+                            tlas,                  // Top-level acceleration structure
+                            gl_RayFlagsOpaqueEXT,  // Ray flags, here saying "treat all geometry as opaque"
+                            0xFF,                  // 8-bit instance mask, here saying "trace against all instances"
+                            rayOrigin,             // Ray origin
+                            0.0,                   // Minimum t-value
+                            rayDirection,          // Ray direction
+                            10000.0);              // Maximum t-value
+
+      // Start traversal, and loop over all ray-scene intersections. When this finishes,
+      // rayQuery stores a "committed" intersection, the closest intersection (if any).
+      while(rayQueryProceedEXT(rayQuery))
+      {
+      }
+
+      // Get the type of committed (true) intersection - nothing, a triangle, or
+      // a generated object
+      if(rayQueryGetIntersectionTypeEXT(rayQuery, true) == gl_RayQueryCommittedIntersectionTriangleEXT)
+      {
+        // Ray hit a triangle
+        HitInfo hitInfo = getObjectHitInfo(rayQuery);
+
+        if(tracedSegments == 0)
+        {
+          summedAlbedo += hitInfo.color;
+          summedNormal += faceforward(hitInfo.worldNormal, rayDirection, hitInfo.worldNormal);
+          if(sampleIdx == 0)
+          {
+            firstDepth        = rayQueryGetIntersectionTEXT(rayQuery, true);
+            firstIds          = uvec2(rayQueryGetIntersectionPrimitiveIndexEXT(rayQuery, true),  //
+                                      rayQueryGetIntersectionInstanceIdEXT(rayQuery, true));
+            firstBarycentrics = rayQueryGetIntersectionBarycentricsEXT(rayQuery, true);
+          }
+        }
+
+        // Apply color absorption
+        accumulatedRayColor *= hitInfo.color;
+
+        // Start a new ray at the hit position, but offset it slightly along
+        // the normal against rayDirection:
+        rayOrigin = hitInfo.worldPosition - 0.0001 * sign(dot(rayDirection, hitInfo.worldNormal)) * hitInfo.worldNormal;
+
+        // Diffuse Reflection Algorithm: Lambertian material model
+        // A surface, a normal at an intersection point, and a sphere (here represented by a circle) centered at that normal of radius 1.
+        // To sample a random Lambertian reflection direction, choose a random point on the sphere, then normalize it; this gives the needed distribution! 
+        // p is then a random point on the unit sphere centered at (0,0,0). We then add the world-space normal, then normalize, to get the reflected ray direction. 
+
+        const float theta = 6.2831853 * nextSample(sampler);   // Random in [0, 2pi] theta = 2pi * random_number
+        const float u     = 2.0 * nextSample(sampler) - 1.0;  // Random in [-1, 1] u = 2b - 1
+        const float r     = sqrt(1.0 - u * u);
+
+        rayDirection = hitInfo.worldNormal + vec3(r * cos(theta), r * sin(theta), u); // point p = (r*sin(theta), r*cos(theta), u) + world-space normal
+        rayDirection = normalize(rayDirection);                                            // normalize the ray direction p
+      }
+      else
+      {
+        // Ray hit the sky
+        if(tracedSegments == 0)
+        {
+          summedAlbedo += skyColor(rayDirection);  // The sky has no normal, so it adds none
+        }
+        accumulatedRayColor *= skyColor(rayDirection);
+        
+        // Sum this with the pixel's other samples.
+        // (Note that we treat a ray that didn't find a light source as if it had
+        // an accumulated color of (0, 0, 0)).
+        summedPixelColor += accumulatedRayColor;
+        const float luminance = dot(accumulatedRayColor, vec3(0.2126, 0.7152, 0.0722));
+        summedSquaredLuminance += luminance * luminance;
+    
+        break;
+      }
+    }
+  }
+
+  // Sample-parallel rendering: the first invocation of each pixel adds the sums of the others to its own. This goes
+  // through shared memory rather than subgroup operations, as the invocations of a pixel aren't guaranteed to be
+  // in the same subgroup.
+  if(SAMPLE_SPLIT > 1)
+  {
+    sharedColorSums[gl_LocalInvocationIndex] = vec4(summedPixelColor, summedSquaredLuminance);
+    if((AOV_MASK & AOV_ALBEDO) != 0)
+    {
+      sharedAlbedoSums[gl_LocalInvocationIndex] = summedAlbedo;
+    }
+    if((AOV_MASK & AOV_NORMAL) != 0)
+    {
+      sharedNormalSums[gl_LocalInvocationIndex] = summedNormal;
+    }
+    barrier();
+    if(sampleSlice == 0)
+    {
+      for(uint i = 1; i < SAMPLE_SPLIT; i++)
+      {
+        const vec4 sums = sharedColorSums[gl_LocalInvocationIndex + i];
+        summedPixelColor += sums.rgb;
+        summedSquaredLuminance += sums.a;
+        if((AOV_MASK & AOV_ALBEDO) != 0)
+        {
+          summedAlbedo += sharedAlbedoSums[gl_LocalInvocationIndex + i];
+        }
+        if((AOV_MASK & AOV_NORMAL) != 0)
+        {
+          summedNormal += sharedNormalSums[gl_LocalInvocationIndex + i];
+        }
+      }
+    }
+  }
+  // Only the first invocation of each pixel writes it (the first sample's AOVs are its own).
+  if(!insidePixel || sampleSlice != 0)
+  {
+    return;
+  }
+
+  // Get the index of this invocation in the buffers, which hold the pixels of the tile:
+  uint linearIndex = tileSize.x * tilePixel.y + tilePixel.x;
+  // Write the AOVs; AOV_MASK is a constant, so the compiler removes the code of the AOVs it doesn't contain.
+  // Adaptive sampling weighs the averages of the previous batches by their number of samples.
+  const uint  accumulatedSamples = (ADAPTIVE_SAMPLING != 0) ? pushConstants.accumulatedSamples : 0;
+  const float totalSamples       = float(accumulatedSamples + uint(numSamples));
+  if((AOV_MASK & AOV_ALBEDO) != 0)
+  {
+    if(accumulatedSamples > 0)
+    {
+      summedAlbedo += aovAlbedo[linearIndex] * float(accumulatedSamples);
+    }
+    aovAlbedo[linearIndex] = summedAlbedo / totalSamples;
+  }
+  if((AOV_MASK & AOV_NORMAL) != 0)
+  {
+    if(accumulatedSamples > 0)
+    {
+      summedNormal += aovNormal[linearIndex] * float(accumulatedSamples);
+    }
+    aovNormal[linearIndex] = summedNormal / totalSamples;
+  }
+  if(accumulatedSamples == 0)
+  {
+    if((AOV_MASK & AOV_DEPTH) != 0)
+    {
+      aovDepth[linearIndex] = firstDepth;
+    }
+    if((AOV_MASK & AOV_IDS) != 0)
+    {
+      aovIds[linearIndex] = firstIds;
+    }
+    if((AOV_MASK & AOV_BARYCENTRICS) != 0)
+    {
+      aovBarycentrics[linearIndex] = firstBarycentrics;
+    }
+  }
+  if(ADAPTIVE_SAMPLING != 0)
+  {
+    // Add this batch to the running sums, and write the average of all samples so far
+    vec4 sums = vec4(summedPixelColor, summedSquaredLuminance);
+    if(pushConstants.accumulatedSamples > 0)
+    {
+      sums += accumulation[linearIndex];
+    }
+    accumulation[linearIndex] = sums;
+    writeColor(pixel, view, linearIndex, sums.rgb / float(pushConstants.accumulatedSamples + numSamples));
+  }
+  else
+  {
+    writeColor(pixel, view, linearIndex, summedPixelColor / float(NUM_SAMPLES));  // Take the average
+  }
+}
+
+// Ray counting: adds the rays of the workgroup's invocations to BINDING_RAY_COUNT, with one global atomic per workgroup
+// (and a second one when the low word wraps around). All invocations of the workgroup must call it.
+void addRayCount()
+{
+  if(COUNT_RAYS == 0)
+  {
+    return;
+  }
+  if(gl_LocalInvocationIndex == 0)
+  {
+    sharedRayCount = 0;
+  }
+  barrier();
+  atomicAdd(sharedRayCount, tracedRays);
+  barrier();
+  if(gl_LocalInvocationIndex == 0)
+  {
+    const uint before = atomicAdd(rayCountLow, sharedRayCount);
+    if(before + sharedRayCount < before)
+    {
+      atomicAdd(rayCountHigh, 1u);
+    }
+  }
+}
+
+void main()
+{
+  if(PERSISTENT_THREADS == 0)
+  {
+    // One workgroup per tile (per block of a tile with SAMPLE_SPLIT) and view, the z dimension counting blocks and
+    // views. With adaptive sampling, only the workgroups of tiles that haven't converged yet are dispatched, so the
+    // workgroup ID indexes the list of active tiles instead of the image.
+    uvec2 workgroupTile = gl_WorkGroupID.xy;
+    if(ADAPTIVE_SAMPLING != 0)
+    {
+      const uint tile = activeTiles[gl_WorkGroupID.x];
+      workgroupTile   = uvec2(tile & 0xFFFFu, tile >> 16);
+    }
+    renderPixel(workgroupTile, gl_WorkGroupID.z % SAMPLE_SPLIT, gl_WorkGroupID.z / SAMPLE_SPLIT);
+    addRayCount();
+    return;
+  }
+
+  // Persistent threads: each workgroup takes the next tile from the work counter until there are none left, so
+  // workgroups that get cheap tiles take more of them, and none idles while tiles are left.
+  const uint tilesX    = (pushConstants.tileWidth + WORKGROUP_WIDTH - 1) / WORKGROUP_WIDTH;
+  const uint tilesY    = (pushConstants.tileHeight + WORKGROUP_HEIGHT - 1) / WORKGROUP_HEIGHT;
+  const uint viewItems = ((ADAPTIVE_SAMPLING != 0) ? pushConstants.activeTileCount : tilesX * tilesY) * SAMPLE_SPLIT;
+  const uint itemCount = viewItems * max(pushConstants.viewCount, 1u);
+  const uint counter   = pushConstants.workCounter;
+  while(true)
+  {
+    if(gl_LocalInvocationIndex == 0)
+    {
+      sharedWorkItem = atomicAdd(workCounters[counter].nextItem, 1);
+    }
+    barrier();
+    const uint item = sharedWorkItem;
+    barrier();  // Before invocation 0 overwrites sharedWorkItem
+    if(item >= itemCount)
+    {
+      break;
+    }
+    // The work items are the blocks of the tiles (the tiles without SAMPLE_SPLIT) of each view
+    const uint view     = item / viewItems;
+    const uint tileItem = (item % viewItems) / SAMPLE_SPLIT;
+    const uint block    = item % SAMPLE_SPLIT;
+    if(ADAPTIVE_SAMPLING != 0)
+    {
+      const uint tile = activeTiles[tileItem];
+      renderPixel(uvec2(tile & 0xFFFFu, tile >> 16), block, view);
+    }
+    else
+    {
+      renderPixel(uvec2(tileItem % tilesX, tileItem / tilesX), block, view);
+    }
+  }
+
+  // Once every workgroup has found the counter exhausted, none reads it again: the last one resets it.
+  if(gl_LocalInvocationIndex == 0)
+  {
+    memoryBarrierBuffer();
+    if(atomicAdd(workCounters[counter].finishedWorkgroups, 1) == gl_NumWorkGroups.x * gl_NumWorkGroups.y - 1)
+    {
+      atomicExchange(workCounters[counter].nextItem, 0);
+      atomicExchange(workCounters[counter].finishedWorkgroups, 0);
+    }
+  }
+  addRayCount();
+}
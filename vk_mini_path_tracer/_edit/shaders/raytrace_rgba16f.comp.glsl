@@ -0,0 +1,8 @@
+// Copyright 2020 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+// The path tracer of raytrace.h, writing rgba16f output images (--output-image rgba16f, and --views by default).
+#define OUTPUT_IMAGE_FORMAT rgba16f
+#include "raytrace.h"
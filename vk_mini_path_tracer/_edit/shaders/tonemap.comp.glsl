@@ -0,0 +1,99 @@
+// Copyright 2020 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#version 460
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "../common.h"
+
+// Turns the linear float image into a compact encoding on the GPU, so that the CPU reads back 4 or 8 bytes per
+// pixel instead of 12: display images are exposed, tonemapped and sRGB-encoded into RGBA8 or RGB10A2, and HDR
+// previews are exposed and packed into RGB9E5 or half floats.
+
+layout(local_size_x = WORKGROUP_WIDTH, local_size_y = WORKGROUP_HEIGHT, local_size_z = 1) in;
+
+layout(push_constant) uniform PushConstantBlock
+{
+  TonemapPushConstants pushConstants;
+};
+
+layout(binding = TONEMAP_BINDING_INPUT, set = 0, scalar) readonly buffer InputColor
+{
+  vec3 inputColor[];
+};
+layout(binding = TONEMAP_BINDING_OUTPUT, set = 0, scalar) writeonly buffer OutputColor
+{
+  uint outputColor[];
+};
+
+vec3 tonemap(vec3 color, uint curve)
+{
+  if(curve == TONEMAP_REINHARD)
+  {
+    return color / (1.0 + color);
+  }
+  if(curve == TONEMAP_ACES)
+  {
+    // Krzysztof Narkowicz, "ACES Filmic Tone Mapping Curve" (2016)
+    return (color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14);
+  }
+  return color;
+}
+
+// The sRGB transfer function, for values in [0, 1].
+vec3 linearToSrgb(vec3 color)
+{
+  return mix(12.92 * color, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, greaterThan(color, vec3(0.0031308)));
+}
+
+// Packs a color into the shared exponent format of EXT_texture_shared_exponent, rounding to nearest.
+uint packRgb9e5(vec3 color)
+{
+  const float maxValue = 65408.0;  // (2^9 - 1) / 2^9 * 2^15, the largest value the format holds
+  const vec3  clamped  = clamp(color, vec3(0.0), vec3(maxValue));
+  const float maxComponent = max(clamped.r, max(clamped.g, clamped.b));
+
+  // Shared exponent, biased by 15, such that the largest component's mantissa is < 512; log2(0) = -inf goes to -16.
+  int   exponent = int(max(-16.0, floor(log2(maxComponent)))) + 16;
+  float scale    = exp2(float(exponent - 15 - 9));
+  if(floor(maxComponent / scale + 0.5) >= 512.0)
+  {
+    exponent++;
+    scale *= 2.0;
+  }
+  const uvec3 mantissas = uvec3(floor(clamped / scale + 0.5));
+  return mantissas.r | (mantissas.g << 9) | (mantissas.b << 18) | (uint(exponent) << 27);
+}
+
+void main()
+{
+  const uvec2 pixel = gl_GlobalInvocationID.xy;
+  if((pixel.x >= pushConstants.width) || (pixel.y >= pushConstants.height))
+  {
+    return;
+  }
+  const uint index = pushConstants.width * pixel.y + pixel.x;
+  const vec3 color = max(inputColor[index] * pushConstants.exposure, vec3(0.0));
+
+  switch(pushConstants.encoding)
+  {
+    case ENCODING_RGBA8:
+      outputColor[index] = packUnorm4x8(vec4(linearToSrgb(clamp(tonemap(color, pushConstants.curve), 0.0, 1.0)), 1.0));
+      break;
+    case ENCODING_RGB10A2: {
+      const uvec3 rgb = uvec3(round(linearToSrgb(clamp(tonemap(color, pushConstants.curve), 0.0, 1.0)) * 1023.0));
+      outputColor[index] = rgb.r | (rgb.g << 10) | (rgb.b << 20) | (3u << 30);
+      break;
+    }
+    case ENCODING_RGB9E5:
+      outputColor[index] = packRgb9e5(color);
+      break;
+    default: {
+      // Clamp to the largest half, so that bright pixels don't become infinities
+      const vec3 clamped = min(color, vec3(65504.0));
+      outputColor[2 * index + 0] = packHalf2x16(clamped.rg);
+      outputColor[2 * index + 1] = packHalf2x16(vec2(clamped.b, 1.0));
+      break;
+    }
+  }
+}
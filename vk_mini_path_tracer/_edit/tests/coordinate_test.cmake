@@ -0,0 +1,35 @@
+# End-to-end test of distributed rendering, run by ctest (see ../CMakeLists.txt):
+#
+#   cmake -DEXECUTABLE=<renderer> -DWORK_DIR=<dir> [-DSPP=<samples per pixel>] -P coordinate_test.cmake
+#
+# Renders the default scene with --coordinate 2 (two local worker processes, four row bands), and checks that the
+# merged image has the same bits as one worker rendering the whole frame: each sample only depends on its pixel and
+# index, and bands without sample slices add each pixel's samples in the same order. Needs a Vulkan device with ray
+# queries, e.g. lavapipe.
+if(NOT SPP)
+  set(SPP 4)
+endif()
+set(RENDER_HEIGHT 600)  # render_height of main.cpp
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+function(run_renderer)
+  execute_process(COMMAND ${EXECUTABLE} ${ARGN} WORKING_DIRECTORY ${WORK_DIR} RESULT_VARIABLE RESULT)
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${EXECUTABLE} ${ARGN} failed: ${RESULT}")
+  endif()
+endfunction()
+
+# One worker renders the whole frame, then its partial render is merged on its own
+run_renderer(--worker-job 0,${RENDER_HEIGHT},0,${SPP} --partial single.bin)
+run_renderer(--merge single.bin --format pfm)
+file(RENAME ${WORK_DIR}/out.pfm ${WORK_DIR}/single.pfm)
+
+# Two local workers
+run_renderer(--coordinate 2 --row-bands 4 --spp ${SPP} --format pfm)
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/single.pfm ${WORK_DIR}/out.pfm RESULT_VARIABLE DIFFERENT)
+if(NOT DIFFERENT EQUAL 0)
+  message(FATAL_ERROR "The --coordinate 2 render differs from the single-process render")
+endif()
@@ -0,0 +1,359 @@
+// Tests of distributed.hpp that don't need Vulkan: the job partition, partial render files, merging, argument
+// quoting, and the coordinator, whose workers are this executable pretending to be the renderer. A fake worker
+// writes sums of made-up samples that, as the shader's, only depend on the pixel and sample index.
+//
+//   distributed_test WORK_DIR
+//
+// Returns 0 if all checks pass; prints the ones that fail.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "distributed.hpp"
+
+static int failedChecks = 0;
+
+#define CHECK(condition)                                                                                               \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if(!(condition))                                                                                                   \
+    {                                                                                                                  \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                                  \
+      failedChecks++;                                                                                                  \
+    }                                                                                                                  \
+  } while(false)
+
+// Size of the fake image; the height isn't a multiple of WORKGROUP_HEIGHT, so that the last band is partial.
+static const uint32_t image_width  = 24;
+static const uint32_t image_height = 4 * WORKGROUP_HEIGHT + 3;
+
+// A made-up sample of a pixel's color channel in [0, 4), which only depends on the pixel, sample and channel.
+static float FakeSample(uint32_t pixel, uint32_t sample, uint32_t channel)
+{
+  uint32_t hash = pixel * 0x9E3779B9u ^ (sample + 1) * 0x85EBCA6Bu ^ (channel + 1) * 0xC2B2AE35u;
+  hash ^= hash >> 16;
+  hash *= 0x7FEB352Du;
+  hash ^= hash >> 15;
+  return float(hash >> 8) * (4.0f / 16777216.0f);
+}
+
+// Renders `job` of the fake image as a worker would: each pixel's sums add its samples in sample order.
+static PartialRender FakeRender(const RenderJob& job)
+{
+  PartialRender partial;
+  partial.width  = image_width;
+  partial.height = image_height;
+  partial.job    = job;
+  partial.sums.resize(size_t(job.rowEnd - job.rowBegin) * image_width * 4, 0.0f);
+  for(uint32_t row = job.rowBegin; row < job.rowEnd; row++)
+  {
+    for(uint32_t x = 0; x < image_width; x++)
+    {
+      float* sums = &partial.sums[4 * (size_t(row - job.rowBegin) * image_width + x)];
+      for(uint32_t sample = job.firstSample; sample < job.firstSample + job.sampleCount; sample++)
+      {
+        float color[3];
+        for(uint32_t channel = 0; channel < 3; channel++)
+        {
+          color[channel] = FakeSample(row * image_width + x, sample, channel);
+          sums[channel] += color[channel];
+        }
+        const float luminance = 0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2];
+        sums[3] += luminance * luminance;
+      }
+    }
+  }
+  return partial;
+}
+
+// The worker side of the coordinator test, run as `distributed_test [--fail-once DIR] [--fail-always] --worker-job
+// JOB --partial FILE`. With --fail-once, the first attempt at each job whose first row is 0 exits with an error
+// without writing its file; DIR remembers which jobs have been attempted.
+static int RunFakeWorker(int argc, const char** argv)
+{
+  RenderJob   job;
+  std::string partialPath;
+  std::string failOnceDir;
+  for(int i = 1; i < argc; i++)
+  {
+    const bool hasValue = (i + 1 < argc);
+    if(strcmp(argv[i], "--worker-job") == 0 && hasValue)
+    {
+      if(!ParseRenderJob(argv[++i], job))
+      {
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "--partial") == 0 && hasValue)
+    {
+      partialPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--fail-once") == 0 && hasValue)
+    {
+      failOnceDir = argv[++i];
+    }
+    else if(strcmp(argv[i], "--fail-always") == 0)
+    {
+      return 1;
+    }
+  }
+  if(!failOnceDir.empty() && (job.rowBegin == 0))
+  {
+    const std::filesystem::path marker = std::filesystem::path(failOnceDir) / ("attempted_" + FormatRenderJob(job));
+    if(!std::filesystem::exists(marker))
+    {
+      std::ofstream(marker).put('\n');
+      return 1;
+    }
+  }
+  return WritePartial(partialPath, FakeRender(job)) ? 0 : 1;
+}
+
+static void TestPartitionFrame()
+{
+  const uint32_t cases[][4] = {{image_height, 64, 4, 1},  {image_height, 64, 3, 5}, {image_height, 5, 100, 9},
+                               {600, 64, 2, 1},           {600, 1, 7, 3},           {1, 3, 2, 2},
+                               {WORKGROUP_HEIGHT, 7, 1, 7}};
+  for(const auto& c : cases)
+  {
+    const uint32_t               height = c[0], totalSamples = c[1], rowBands = c[2], sampleSlices = c[3];
+    const std::vector<RenderJob> jobs = PartitionFrame(height, totalSamples, rowBands, sampleSlices);
+    const uint32_t               tileRows = (height + WORKGROUP_HEIGHT - 1) / WORKGROUP_HEIGHT;
+    CHECK(jobs.size() == size_t(std::min(rowBands, tileRows)) * std::min(sampleSlices, totalSamples));
+
+    // Every sample of every row is in exactly one job, and bands are made of whole tile rows
+    std::vector<uint32_t> coverage(size_t(height) * totalSamples, 0);
+    for(const RenderJob& job : jobs)
+    {
+      CHECK(job.rowBegin < job.rowEnd && job.rowEnd <= height && job.sampleCount > 0);
+      CHECK(job.rowBegin % WORKGROUP_HEIGHT == 0);
+      CHECK(job.rowEnd % WORKGROUP_HEIGHT == 0 || job.rowEnd == height);
+      for(uint32_t row = job.rowBegin; row < std::min(job.rowEnd, height); row++)
+      {
+        for(uint32_t sample = job.firstSample; sample < std::min(job.firstSample + job.sampleCount, totalSamples); sample++)
+        {
+          coverage[size_t(row) * totalSamples + sample]++;
+        }
+      }
+    }
+    CHECK(std::all_of(coverage.begin(), coverage.end(), [](uint32_t count) { return count == 1; }));
+  }
+}
+
+static void TestRenderJobText()
+{
+  const RenderJob job{8, 40, 16, 48};
+  RenderJob       parsed;
+  CHECK(FormatRenderJob(job) == "8,40,16,48");
+  CHECK(ParseRenderJob(FormatRenderJob(job).c_str(), parsed));
+  CHECK(FormatRenderJob(parsed) == FormatRenderJob(job));
+  CHECK(!ParseRenderJob("8,40,16", parsed));
+  CHECK(!ParseRenderJob("40,8,0,4", parsed));  // Empty row range
+  CHECK(!ParseRenderJob("0,8,0,0", parsed));   // No samples
+  CHECK(!ParseRenderJob("", parsed));
+}
+
+static void TestPartialFiles(const std::filesystem::path& dir)
+{
+  const std::string   path    = (dir / "partial.bin").string();
+  const PartialRender written = FakeRender({WORKGROUP_HEIGHT, 3 * WORKGROUP_HEIGHT, 4, 12});
+  CHECK(WritePartial(path, written));
+  CHECK(!std::filesystem::exists(path + ".tmp"));
+
+  PartialRender read;
+  CHECK(ReadPartial(path, read));
+  CHECK(read.width == written.width && read.height == written.height);
+  CHECK(FormatRenderJob(read.job) == FormatRenderJob(written.job));
+  CHECK(read.sums == written.sums);
+
+  PartialRender header;
+  CHECK(ReadPartial(path, header, true));
+  CHECK(FormatRenderJob(header.job) == FormatRenderJob(written.job) && header.sums.empty());
+
+  // Writing again replaces the file
+  const PartialRender rewritten = FakeRender({0, WORKGROUP_HEIGHT, 0, 1});
+  CHECK(WritePartial(path, rewritten));
+  CHECK(ReadPartial(path, read) && read.sums == rewritten.sums);
+
+  // A truncated file still has a valid header, but not all of its sums
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - sizeof(float));
+  CHECK(ReadPartial(path, header, true));
+  CHECK(!ReadPartial(path, read));
+  std::filesystem::resize_file(path, 5 * sizeof(uint32_t));
+  CHECK(!ReadPartial(path, header, true));
+
+  // Not a partial render, or no file
+  std::ofstream((dir / "not_partial.bin").string(), std::ios::binary) << std::string(64, 'x');
+  CHECK(!ReadPartial((dir / "not_partial.bin").string(), read, true));
+  CHECK(!ReadPartial((dir / "missing.bin").string(), read, true));
+}
+
+// Writes the partials of `jobs` to `dir` in-process, as one process rendering them one after the other would.
+static std::vector<std::string> WriteFakePartials(const std::filesystem::path& dir, const std::vector<RenderJob>& jobs)
+{
+  std::filesystem::create_directories(dir);
+  std::vector<std::string> paths;
+  for(size_t i = 0; i < jobs.size(); i++)
+  {
+    paths.push_back((dir / ("partial_" + std::to_string(i) + ".bin")).string());
+    CHECK(WritePartial(paths.back(), FakeRender(jobs[i])));
+  }
+  return paths;
+}
+
+static void TestMergePartials(const std::filesystem::path& dir)
+{
+  const uint32_t                 totalSamples = 12;
+  const std::vector<RenderJob>   jobs         = PartitionFrame(image_height, totalSamples, 3, 4);
+  const std::vector<std::string> paths        = WriteFakePartials(dir / "merge", jobs);
+
+  uint32_t           width = 0, height = 0, uncoveredPixels = 0;
+  std::vector<float> rgb;
+  CHECK(MergePartials(paths, width, height, rgb, uncoveredPixels));
+  CHECK(width == image_width && height == image_height && uncoveredPixels == 0);
+  CHECK(rgb.size() == size_t(image_width) * image_height * 3);
+
+  // Each pixel is close to the average of its samples (not equal, since the slices' sums are added in another order)
+  bool closeToAverage = true;
+  for(uint32_t pixel = 0; pixel < image_width * image_height; pixel++)
+  {
+    for(uint32_t channel = 0; channel < 3; channel++)
+    {
+      float sum = 0.0f;
+      for(uint32_t sample = 0; sample < totalSamples; sample++)
+      {
+        sum += FakeSample(pixel, sample, channel);
+      }
+      closeToAverage = closeToAverage && (std::abs(rgb[3 * pixel + channel] - sum / float(totalSamples)) < 1e-5f);
+    }
+  }
+  CHECK(closeToAverage);
+
+  // The partials are merged in job order, whatever order they are given in
+  std::vector<std::string> reversed(paths.rbegin(), paths.rend());
+  std::vector<float>       reversedRgb;
+  CHECK(MergePartials(reversed, width, height, reversedRgb, uncoveredPixels));
+  CHECK(reversedRgb.size() == rgb.size() && memcmp(reversedRgb.data(), rgb.data(), rgb.size() * sizeof(float)) == 0);
+
+  // Only the first band's jobs: the other rows are black and uncovered
+  const std::vector<std::string> firstBand(paths.begin(), paths.begin() + 4);
+  CHECK(MergePartials(firstBand, width, height, rgb, uncoveredPixels));
+  CHECK(uncoveredPixels == (image_height - jobs[0].rowEnd) * image_width);
+  CHECK(rgb[3 * size_t(jobs[0].rowEnd) * image_width] == 0.0f && rgb.back() == 0.0f);
+
+  // Partials of different image sizes, or one that can't be read
+  PartialRender other = FakeRender({0, WORKGROUP_HEIGHT, 0, 1});
+  other.height        = image_height + 1;
+  CHECK(WritePartial((dir / "other_size.bin").string(), other));
+  CHECK(!MergePartials({paths[0], (dir / "other_size.bin").string()}, width, height, rgb, uncoveredPixels));
+  CHECK(!MergePartials({paths[0], (dir / "missing.bin").string()}, width, height, rgb, uncoveredPixels));
+}
+
+#ifndef _WIN32
+// Runs `command` with std::system and returns what it printed.
+static std::string RunAndRead(const std::string& command, const std::filesystem::path& outputPath)
+{
+  if(std::system((command + " > " + QuoteArgument(outputPath.string())).c_str()) != 0)
+  {
+    return "(failed)";
+  }
+  std::ifstream file(outputPath, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void TestQuoteArgument(const std::filesystem::path& dir)
+{
+  const std::string arguments[] = {"plain", "two words", "it's", "'", "''", "$HOME `id` $(id)", "back\\slash\\",
+                                   "\"double\" quotes", "semi;colon && pipe | star *", "new\nline", ""};
+  const std::filesystem::path outputPath = dir / "quoted.txt";
+  for(const std::string& argument : arguments)
+  {
+    // Once for the local shell, and twice for a shell started by another, as for remote workers
+    CHECK(RunAndRead("printf %s " + QuoteArgument(argument), outputPath) == argument);
+    CHECK(RunAndRead("sh -c " + QuoteArgument("printf %s " + QuoteArgument(argument)), outputPath) == argument);
+  }
+}
+
+static void TestCoordinator(const std::filesystem::path& dir, const char* executable)
+{
+  // The partial directory's name needs quoting. The second worker's prefix joins its arguments and runs them through
+  // a second shell, as ssh does with the remote one.
+  const std::string remotePrefix = "sh -c 'eval \"$*\"' ssh";
+  const std::filesystem::path partialDir = dir / "it's a dir";
+  const std::filesystem::path markerDir  = dir / "attempts";
+  std::filesystem::create_directories(partialDir);
+  std::filesystem::create_directories(markerDir);
+
+  CoordinatorSettings settings;
+  settings.workerPrefixes = {"", remotePrefix};
+  settings.executable     = executable;
+  settings.arguments      = {"--fail-once", markerDir.string()};
+  settings.partialDir     = partialDir.string();
+  settings.jobs           = PartitionFrame(image_height, 10, 4, 2);
+
+  // Both jobs of the first band fail once and are reassigned; the result is the same as rendering the jobs in-process
+  const std::vector<std::string> paths = RunCoordinator(settings);
+  CHECK(paths.size() == settings.jobs.size());
+  uint32_t           width = 0, height = 0, uncoveredPixels = 0;
+  std::vector<float> rgb;
+  CHECK(MergePartials(paths, width, height, rgb, uncoveredPixels));
+  CHECK(uncoveredPixels == 0);
+
+  const std::vector<std::string> referencePaths = WriteFakePartials(dir / "reference", settings.jobs);
+  std::vector<float>             referenceRgb;
+  CHECK(MergePartials(referencePaths, width, height, referenceRgb, uncoveredPixels));
+  CHECK(rgb.size() == referenceRgb.size() && memcmp(rgb.data(), referenceRgb.data(), rgb.size() * sizeof(float)) == 0);
+
+  // Only the "remote" worker
+  settings.workerPrefixes = {remotePrefix};
+  CHECK(RunCoordinator(settings) == paths);
+
+  // Workers that always fail: the coordinator gives up instead of waiting forever
+  settings.arguments = {"--fail-always"};
+  CHECK(RunCoordinator(settings).empty());
+}
+#endif
+
+int main(int argc, const char** argv)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--worker-job") == 0)
+    {
+      return RunFakeWorker(argc, argv);
+    }
+  }
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+    return 2;
+  }
+  const std::filesystem::path dir = std::filesystem::absolute(argv[1]);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  TestPartitionFrame();
+  TestRenderJobText();
+  TestPartialFiles(dir);
+  TestMergePartials(dir);
+#ifndef _WIN32
+  TestQuoteArgument(dir);
+  TestCoordinator(dir, std::filesystem::absolute(argv[0]).string().c_str());
+#endif
+
+  if(failedChecks > 0)
+  {
+    fprintf(stderr, "%d checks failed\n", failedChecks);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,74 @@
+// Scene generator: writes the procedural scenes of GenerateScene (see procedural.hpp), from 1k to 100M triangles, as
+// OBJ and mesh cache files for scaling tests of BLAS builds and traversal. Both files start with the generator's
+// settings, and the renderer's --scene reads the cache file's (see main.cpp), so a run on a generated scene records
+// how to generate it again. Doesn't need Vulkan.
+//
+//   scene_generator [--triangles N] [--instances N] [--layout uniform|clustered|thin]
+//                   [--sizes uniform|lognormal|powerlaw] [--size F] [--seed N] [--obj FILE] [--cache FILE]
+//
+// N of --triangles can have a k or M suffix, e.g. 100M.
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "mesh.hpp"
+#include "procedural.hpp"
+
+int main(int argc, const char** argv)
+{
+  SceneGeneratorSettings settings;
+  std::string            objPath;
+  std::string            cachePath;
+  for(int i = 1; i < argc; i++)
+  {
+    const bool hasValue = (i + 1 < argc);
+    if(strcmp(argv[i], "--obj") == 0 && hasValue)
+    {
+      objPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--cache") == 0 && hasValue)
+    {
+      cachePath = argv[++i];
+    }
+    // The other options are the settings, e.g. --layout thin is layout=thin:
+    else if(strncmp(argv[i], "--", 2) == 0 && hasValue && ParseSceneGeneratorSetting(std::string(argv[i] + 2) + "=" + argv[i + 1], settings))
+    {
+      i++;
+    }
+    else
+    {
+      fprintf(stderr,
+              "Usage: %s [--triangles N] [--instances N] [--layout uniform|clustered|thin] "
+              "[--sizes uniform|lognormal|powerlaw] [--size F] [--seed N] [--obj FILE] [--cache FILE]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if(objPath.empty() && cachePath.empty())
+  {
+    fprintf(stderr, "Nothing to do: give --obj, --cache or both\n");
+    return 1;
+  }
+
+  const std::string description = FormatSceneGeneratorSettings(settings);
+  const auto        start       = std::chrono::steady_clock::now();
+  const Mesh        mesh        = GenerateScene(settings);
+  const auto        elapsedMs   = [&start]() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+  printf("Generated %u triangles, %u vertices (%s) in %.1f ms\n", mesh.numTriangles(), mesh.numVertices(), description.c_str(), elapsedMs());
+
+  if(!cachePath.empty() && !WriteMeshCache(cachePath, mesh, description))
+  {
+    fprintf(stderr, "Could not write %s\n", cachePath.c_str());
+    return 1;
+  }
+  if(!objPath.empty() && !WriteObjMesh(objPath, mesh, "Generated by scene_generator: " + description))
+  {
+    fprintf(stderr, "Could not write %s\n", objPath.c_str());
+    return 1;
+  }
+  printf("Wrote the files in %.1f ms\n", elapsedMs());
+  return 0;
+}